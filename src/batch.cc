@@ -0,0 +1,279 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file batch.cc Implementation of --batch.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "superblock.h"
+#include "conversion.h"
+#include "directories.h"
+#include "commandline.h"
+#include "forward_declarations.h"
+#include "init_files.h"
+#include "init_directories.h"
+#include "get_block.h"
+#include "restore.h"
+#include "utils.h"
+#include "output.h"
+#include "progress.h"
+#include "batch.h"
+
+namespace {
+
+struct Search {
+  std::string pattern;
+  bool start;				// True for search-start.
+  std::vector<std::pair<int, bool> > found;	// The blocks found and whether they are allocated.
+};
+
+struct Restore {
+  uint32_t inode;			// Used to order the restores; zero if unknown.
+  std::string path;			// The path for restore-file, or empty for restore-inode.
+  int seqnr;				// The sequence number for restore-inode.
+  bool operator<(Restore const& restore) const { return inode < restore.inode; }
+};
+
+void batch_error(std::string const& filename, int line_number, std::string const& message)
+{
+  std::cout << std::flush;
+  std::cerr << progname << ": --batch: " << filename << ':' << line_number << ": " << message << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+// Parse a number in [min, max], or return -1.
+long parse_number(std::string const& arg, long min, long max)
+{
+  char* endptr;
+  long value = strtol(arg.c_str(), &endptr, 10);
+  if (arg.empty() || *endptr != '\0' || value < min || value > max)
+    return -1;
+  return value;
+}
+
+void run_searches(std::vector<Search>& searches)
+{
+  int const chunk_blocks = std::max(1, scan_chunk_size / block_size_);
+  std::vector<unsigned char> buf(chunk_blocks * block_size_);
+  Progress progress("--batch search", block_count(super_block) - first_data_block(super_block), block_size_);
+  for (int group = 0; group < groups_; ++group)
+  {
+    // Like --search, skip everything up till the end of the inode table.
+    int first_block = group_descriptor_table[group].bg_inode_table + inodes_per_group_ * inode_size_ / block_size_;
+    int last_block = std::min(group_to_block(super_block, group) + blocks_per_group(super_block), block_count(super_block));
+    for (int block = first_block; block < last_block; block += chunk_blocks)
+    {
+      int count = std::min(chunk_blocks, last_block - block);
+      progress.update(block - first_data_block(super_block));
+      get_blocks(block, count, &buf[0]);
+      for (int i = 0; i < count; ++i)
+      {
+	unsigned int bit = block + i - first_data_block(super_block) - group * blocks_per_group(super_block);
+	bitmap_ptr bmp = get_bitmap_mask(bit);
+	bool allocated = (block_bitmap[group][bmp.index] & bmp.mask);
+	if ((commandline_allocated && !allocated) || (commandline_unallocated && allocated))
+	  continue;
+	for (std::vector<Search>::iterator search = searches.begin(); search != searches.end(); ++search)
+	  if (search_block(&buf[i * block_size_], search->pattern.data(), search->pattern.length(), search->start))
+	    search->found.push_back(std::make_pair(block + i, allocated));
+      }
+    }
+  }
+  for (std::vector<Search>::iterator search = searches.begin(); search != searches.end(); ++search)
+  {
+    if (commandline_allocated)
+      std::cout << "Allocated blocks ";
+    else if (commandline_unallocated)
+      std::cout << "Unallocated blocks ";
+    else
+      std::cout << "Blocks ";
+    std::cout << (search->start ? "starting with" : "containing") << " \"" << search->pattern << "\":";
+    for (std::vector<std::pair<int, bool> >::iterator iter = search->found.begin(); iter != search->found.end(); ++iter)
+    {
+      if (output_format != output_text)
+	output_record(OutputRecord(search->start ? "search_start" : "search").path(search->pattern).block(iter->first).
+	    state(iter->second ? "allocated" : "unallocated"));
+      else if (!commandline_allocated && iter->second)
+	std::cout << ' ' << iter->first << " (allocated)";
+      else
+	std::cout << ' ' << iter->first;
+    }
+    std::cout << '\n';
+  }
+}
+
+} // namespace
+
+void run_batch(std::string const& filename)
+{
+  std::ifstream file;
+  if (filename != "-")
+  {
+    file.open(filename.c_str());
+    if (!file)
+    {
+      std::cout << std::flush;
+      std::cerr << progname << ": --batch: failed to open \"" << filename << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  std::istream& in(filename == "-" ? std::cin : file);
+
+  // Read and check all commands first.
+  std::vector<std::pair<std::string, long> > queries;	// The inode and block commands, in order.
+  std::vector<Search> searches;
+  std::vector<Restore> restores;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(in, line))
+  {
+    ++line_number;
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::string::size_type space = line.find(' ');
+    std::string command = line.substr(0, space);
+    std::string arg = (space == std::string::npos) ? std::string() : line.substr(space + 1);
+    if (command == "inode" || command == "block")
+    {
+      long max = (command == "inode") ? (long)inode_count_ : (long)block_count(super_block) - 1;
+      long value = parse_number(arg, command == "inode" ? 1 : 0, max);
+      if (value == -1)
+	batch_error(filename, line_number, command + ": \"" + arg + "\" is not a number or out of range.");
+      queries.push_back(std::make_pair(command, value));
+    }
+    else if (command == "search" || command == "search-start")
+    {
+      if (arg.empty() || arg.length() > (size_t)block_size_)
+	batch_error(filename, line_number, command + ": the string must be between 1 and the block size characters long.");
+      Search search;
+      search.pattern = arg;
+      search.start = (command == "search-start");
+      searches.push_back(search);
+    }
+    else if (command == "restore-file")
+    {
+      if (arg.empty() || arg[0] == '/')
+	batch_error(filename, line_number, "restore-file: expected a path relative to the root of the partition.");
+      Restore restore;
+      restore.path = arg;
+      restores.push_back(restore);
+    }
+    else if (command == "restore-inode")
+    {
+      std::string::size_type at = arg.find('@');
+      long inode = parse_number(arg.substr(0, at), 1, inode_count_);
+      long seqnr = (at == std::string::npos) ? 0 : parse_number(arg.substr(at + 1), 0, 0x7fffffff);
+      if (inode == -1 || seqnr == -1)
+	batch_error(filename, line_number, "restore-inode: expected ino or ino@seqnr, got \"" + arg + "\".");
+      Restore restore;
+      restore.inode = inode;
+      restore.seqnr = (at == std::string::npos) ? latest : seqnr;
+      restores.push_back(restore);
+    }
+    else
+      batch_error(filename, line_number, "unknown command \"" + command + "\".");
+  }
+
+  // The inode and block commands use the same code as --inode and --block.
+  bool print = commandline_print;
+  for (std::vector<std::pair<std::string, long> >::iterator query = queries.begin(); query != queries.end(); ++query)
+  {
+    std::cout << "\nBatch: " << query->first << ' ' << query->second << '\n';
+    // Like on the commandline, --print is implied when --ls isn't used.
+    commandline_print = print || !commandline_ls;
+    if (query->first == "inode")
+    {
+      commandline_inode = query->second;
+      commandline_group = inode_to_group(super_block, commandline_inode);
+      handle_commandline_inode();
+      commandline_inode = -1;
+    }
+    else
+    {
+      commandline_block = query->second;
+      commandline_group = block_to_group(super_block, commandline_block);
+      handle_commandline_block();
+      commandline_block = -1;
+    }
+    commandline_group = -1;
+  }
+  commandline_print = print;
+
+  if (!searches.empty())
+  {
+    if (commandline_allocated && commandline_unallocated)
+    {
+      commandline_allocated = commandline_unallocated = false;
+      forget_parsed_directory_blocks();
+    }
+    std::cout << "\nBatch: " << searches.size() << " searches\n";
+    run_searches(searches);
+  }
+
+  if (!restores.empty())
+  {
+    // Restore in the order of the inode numbers: the inodes, and usually the data
+    // of the files, are then read in the order in which they are on the device.
+    init_files();
+    for (std::vector<Restore>::iterator restore = restores.begin(); restore != restores.end(); ++restore)
+    {
+      if (restore->path.empty())
+	continue;
+      restore->inode = 0;
+      path_to_inode_map_type::iterator inode_iter = path_to_inode_map.find(restore->path);
+      if (inode_iter != path_to_inode_map.end())
+	restore->inode = inode_iter->second;
+      else
+      {
+	all_directories_type::iterator directory_iter = all_directories.find(restore->path);
+	if (directory_iter != all_directories.end())
+	  restore->inode = directory_iter->second.inode_number();
+      }
+    }
+    std::stable_sort(restores.begin(), restores.end());
+    std::cout << "\nBatch: " << restores.size() << " restores\n";
+    init_outputdir();
+    for (std::vector<Restore>::iterator restore = restores.begin(); restore != restores.end(); ++restore)
+    {
+      if (!restore->path.empty())
+      {
+	restore_file(restore->path);
+	continue;
+      }
+      std::ostringstream oss;
+      oss << "inode." << restore->inode;
+      if (restore->seqnr != latest)
+	oss << '@' << restore->seqnr;
+      restore_inode(restore->inode, get_inode(restore->inode), oss.str(), restore->seqnr);
+    }
+  }
+}
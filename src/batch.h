@@ -0,0 +1,46 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file batch.h Declaration of --batch.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#ifndef USE_PCH
+#include <string>
+#endif
+
+// Run the commands in 'filename' ("-" is stdin), one per line:
+//
+//   inode N                Like --inode N.
+//   block N                Like --block N.
+//   search str             Like --search str.
+//   search-start str       Like --search-start str.
+//   restore-file path      Like --restore-file path.
+//   restore-inode N[@seq]  Like --restore-inode N[@seq].
+//
+// Empty lines and lines starting with '#' are ignored. The commands are checked
+// before anything is done. The inode and block commands are run in the order given,
+// then all searches are done in a single pass over the device, and finally all
+// files are restored in the order of their inode numbers.
+void run_batch(std::string const& filename);
+
+#endif // BATCH_H
@@ -0,0 +1,125 @@
+#! /bin/sh
+
+# Usage: bench.sh [--micro] EXT3GREP MKEXT3IMAGE
+#
+# Times ext3grep on synthetic images written by mkext3image. Run with "make bench".
+# With --micro ("make microbench") a block corpus is exported from each image
+# with --export-block-corpus, and the kernels are timed on it with --microbench.
+#
+# Environment variables:
+#   BENCH_DIR        Directory for the images and results (default: ./bench).
+#   BENCH_SCENARIOS  Scenarios to run (default: "small medium").
+#                    Available: small medium large fragmented.
+#   BENCH_FLAGS      Extra options for ext3grep, for example "--threads 8".
+#
+# Images are only generated again when the options of their scenario changed.
+# The results are written as one JSON object per line, to stdout and appended
+# to $BENCH_DIR/results.jsonl. The phases stage1, stage2 and init_files are
+# derived from the differences between runs of --dump-names with and without
+# the stage files; the other phases are the wall clock time of one run.
+# The results of --micro are appended to $BENCH_DIR/microbench.jsonl instead.
+
+MICRO=no
+if test "$1" = "--micro"; then
+  MICRO=yes
+  shift
+fi
+if test $# -ne 2; then
+  echo "Usage: $0 [--micro] EXT3GREP MKEXT3IMAGE" >&2
+  exit 1
+fi
+
+EXT3GREP=`cd \`dirname $1\` && pwd`/`basename $1`
+MKEXT3IMAGE=`cd \`dirname $2\` && pwd`/`basename $2`
+BENCH_DIR=${BENCH_DIR-bench}
+BENCH_SCENARIOS=${BENCH_SCENARIOS-"small medium"}
+NEEDLE=ext3grep-bench-needle
+
+mkdir -p "$BENCH_DIR" || exit 1
+cd "$BENCH_DIR" || exit 1
+
+scenario_options()
+{
+  case $1 in
+    small)	echo "--size 256M --block-size 1024 --depth 3";;
+    medium)	echo "--size 2G --depth 4 --files-per-dir 32 --fragmentation 5";;
+    large)	echo "--size 8G --depth 5 --files-per-dir 32 --file-size 128K --fragmentation 5";;
+    fragmented)	echo "--size 1G --fragmentation 30 --delete-files 30 --delete-dirs 5 --transactions 64";;
+    *)		echo "$0: unknown scenario \"$1\"" >&2; exit 1;;
+  esac
+}
+
+now()
+{
+  date +%s.%N
+}
+
+# Print one result line.
+result()
+{
+  echo "{\"scenario\":\"$1\",\"phase\":\"$2\",\"seconds\":$3,\"status\":$4}" | tee -a results.jsonl
+}
+
+# run SCENARIO PHASE COMMAND...: time COMMAND, print its result and set 'seconds'.
+run()
+{
+  scenario=$1
+  phase=$2
+  shift 2
+  start=`now`
+  "$@" > $scenario.$phase.out 2>&1
+  status=$?
+  end=`now`
+  seconds=`awk "BEGIN { printf \"%.3f\", $end - $start }"`
+  result $scenario $phase $seconds $status
+}
+
+difference()
+{
+  awk "BEGIN { d = $1 - $2; if (d < 0) d = 0; printf \"%.3f\", d }"
+}
+
+for scenario in $BENCH_SCENARIOS; do
+  options=`scenario_options $scenario` || exit 1
+  image=$scenario.img
+  if test ! -f $image -o ! -f $image.options || test "`cat $image.options`" != "$options"; then
+    rm -f $image $image.options
+    run $scenario generate "$MKEXT3IMAGE" $options $image
+    test $status -eq 0 || { cat $scenario.generate.out >&2; exit 1; }
+    echo "$options" > $image.options
+    rm -f $scenario.corpus
+  fi
+
+  if test $MICRO = yes; then
+    if test ! -f $scenario.corpus; then
+      run $scenario export_corpus "$EXT3GREP" $BENCH_FLAGS $image --export-block-corpus $scenario.corpus
+      test $status -eq 0 || { cat $scenario.export_corpus.out >&2; exit 1; }
+    fi
+    "$EXT3GREP" $BENCH_FLAGS $image --microbench $scenario.corpus > $scenario.microbench.out 2>&1 ||
+      { cat $scenario.microbench.out >&2; exit 1; }
+    grep '^{' $scenario.microbench.out | sed -e "s/^{/{\"scenario\":\"$scenario\",/" | tee -a microbench.jsonl
+    continue
+  fi
+
+  rm -f $image.ext3grep.*
+  run $scenario dump_names_cold "$EXT3GREP" $BENCH_FLAGS $image --dump-names
+  cold=$seconds
+  rm -f $image.ext3grep.stage2
+  run $scenario dump_names_stage1_cached "$EXT3GREP" $BENCH_FLAGS $image --dump-names
+  stage1_cached=$seconds
+  run $scenario dump_names_cached "$EXT3GREP" $BENCH_FLAGS $image --dump-names
+  cached=$seconds
+  run $scenario startup "$EXT3GREP" $BENCH_FLAGS $image --superblock
+  startup=$seconds
+  result $scenario stage1 `difference $cold $stage1_cached` 0
+  result $scenario stage2 `difference $stage1_cached $cached` 0
+  result $scenario init_files `difference $cached $startup` 0
+
+  run $scenario search "$EXT3GREP" $BENCH_FLAGS $image --search $NEEDLE
+  rm -f $image.ext3grep.timestamps
+  run $scenario histogram "$EXT3GREP" $BENCH_FLAGS $image --histogram=dtime
+  run $scenario histogram_cached "$EXT3GREP" $BENCH_FLAGS $image --histogram=dtime
+  rm -rf RESTORED_FILES
+  run $scenario restore_all "$EXT3GREP" $BENCH_FLAGS $image --restore-all
+  rm -rf RESTORED_FILES
+done
@@ -0,0 +1,142 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file block_cache.cc Implementation of a sharded, thread-safe block cache with CLOCK eviction.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstring>
+#include <map>
+#include <vector>
+#include <pthread.h>
+#include "debug.h"
+#endif
+
+#include "block_cache.h"
+#include "globals.h"
+
+namespace {
+
+// Each shard has its own lock, so that threads reading different blocks rarely wait for each other.
+size_t const number_of_shards = 16;
+
+struct BlockCacheShard {
+  pthread_mutex_t mutex;		// Protects everything below.
+  std::map<int, size_t> slot_of_block;	// Maps block numbers to slots.
+  std::vector<int> slot_block;		// The block in each slot, or -1 if the slot is unused.
+  std::vector<bool> referenced;		// The CLOCK reference bit of each slot.
+  unsigned char* data;			// The contents of all slots.
+  size_t hand;				// The CLOCK hand: the next slot to consider for eviction.
+  uint64_t hits;
+  uint64_t misses;
+};
+
+BlockCacheShard S_shards[number_of_shards];
+size_t S_slots_per_shard;		// Zero if the cache is disabled.
+
+inline BlockCacheShard& shard_of(int block)
+{
+  return S_shards[static_cast<uint32_t>(block) % number_of_shards];
+}
+
+} // namespace
+
+void init_block_cache(size_t size)
+{
+  S_slots_per_shard = size / block_size_ / number_of_shards;
+  if (S_slots_per_shard == 0)
+    return;
+  for (size_t i = 0; i < number_of_shards; ++i)
+  {
+    BlockCacheShard& shard(S_shards[i]);
+    pthread_mutex_init(&shard.mutex, NULL);
+    shard.slot_block.assign(S_slots_per_shard, -1);
+    shard.referenced.assign(S_slots_per_shard, false);
+    shard.data = new unsigned char [S_slots_per_shard * block_size_];
+    shard.hand = 0;
+    shard.hits = 0;
+    shard.misses = 0;
+  }
+}
+
+bool block_cache_get(int block, unsigned char* block_buf)
+{
+  if (!S_slots_per_shard)
+    return false;
+  BlockCacheShard& shard(shard_of(block));
+  pthread_mutex_lock(&shard.mutex);
+  std::map<int, size_t>::iterator iter = shard.slot_of_block.find(block);
+  bool hit = (iter != shard.slot_of_block.end());
+  if (hit)
+  {
+    ++shard.hits;
+    shard.referenced[iter->second] = true;
+    std::memcpy(block_buf, shard.data + iter->second * block_size_, block_size_);
+  }
+  else
+    ++shard.misses;
+  pthread_mutex_unlock(&shard.mutex);
+  return hit;
+}
+
+void block_cache_put(int block, unsigned char const* block_buf)
+{
+  if (!S_slots_per_shard)
+    return;
+  BlockCacheShard& shard(shard_of(block));
+  pthread_mutex_lock(&shard.mutex);
+  // Another thread might have read the same block in the meantime.
+  if (shard.slot_of_block.find(block) == shard.slot_of_block.end())
+  {
+    // Find a slot that wasn't referenced since the hand passed it the last time.
+    while (shard.referenced[shard.hand])
+    {
+      shard.referenced[shard.hand] = false;
+      shard.hand = (shard.hand + 1) % S_slots_per_shard;
+    }
+    size_t slot = shard.hand;
+    shard.hand = (shard.hand + 1) % S_slots_per_shard;
+    if (shard.slot_block[slot] != -1)
+      shard.slot_of_block.erase(shard.slot_block[slot]);
+    shard.slot_block[slot] = block;
+    shard.slot_of_block[block] = slot;
+    std::memcpy(shard.data + slot * block_size_, block_buf, block_size_);
+  }
+  pthread_mutex_unlock(&shard.mutex);
+}
+
+BlockCacheStatistics block_cache_statistics(void)
+{
+  BlockCacheStatistics statistics;
+  statistics.hits = 0;
+  statistics.misses = 0;
+  if (!S_slots_per_shard)
+    return statistics;
+  for (size_t i = 0; i < number_of_shards; ++i)
+  {
+    BlockCacheShard& shard(S_shards[i]);
+    pthread_mutex_lock(&shard.mutex);
+    statistics.hits += shard.hits;
+    statistics.misses += shard.misses;
+    pthread_mutex_unlock(&shard.mutex);
+  }
+  return statistics;
+}
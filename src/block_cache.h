@@ -0,0 +1,50 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file block_cache.h Declarations for the block cache used by get_block.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <stdint.h>
+#endif
+
+struct BlockCacheStatistics {
+  uint64_t hits;
+  uint64_t misses;
+};
+
+// Allocate a cache of at most 'size' bytes for get_block. A size of zero disables the cache.
+// Must be called after block_size_ is known, and before any thread is started.
+void init_block_cache(size_t size);
+
+// Copy block from the cache to block_buf and return true, or return false if block isn't cached.
+bool block_cache_get(int block, unsigned char* block_buf);
+
+// Add block, with contents block_buf, to the cache.
+void block_cache_put(int block, unsigned char const* block_buf);
+
+// Return the number of hits and misses since the cache was initialized.
+BlockCacheStatistics block_cache_statistics(void);
+
+#endif // BLOCK_CACHE_H
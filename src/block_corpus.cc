@@ -0,0 +1,194 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file block_corpus.cc Implementation of --export-block-corpus.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "superblock.h"
+#include "is_blockdetection.h"
+#include "forward_declarations.h"
+#include "indirect_blocks.h"
+#include "get_block.h"
+#include "block_corpus.h"
+#include "progress.h"
+
+// File layout (native byte order):
+//
+//   block_corpus_header_st
+//   for each class: the block numbers (uint32_t) and then the contents of those blocks.
+
+char const* const corpus_class_name[corpus_classes] = { "directory", "indirect", "inode_table", "data" };
+
+namespace {
+
+char const magic[8] = { 'e', '3', 'g', 'c', 'o', 'r', 'p', '1' };
+
+uint32_t const max_blocks_per_class = 4096;
+
+struct block_corpus_header_st {
+  char magic[8];
+  uint32_t block_size;
+  uint32_t count[corpus_classes];
+};
+
+// Classify block 'blocknr' with contents 'block' the way stage 1 sees it.
+corpus_class classify_block(unsigned char* block, int blocknr, int group)
+{
+  int inode_table = group_descriptor_table[group].bg_inode_table;
+  if (blocknr >= inode_table && blocknr < inode_table + inodes_per_group_ * inode_size_ / block_size_)
+    return corpus_inode_table;
+  DirectoryBlockStats stats;
+  if (is_directory(block, blocknr, stats, false) != isdir_no)
+    return corpus_directory;
+  if (is_indirect_block(block))
+    return corpus_indirect;
+  return corpus_data;
+}
+
+void write_failed(std::string const& filename)
+{
+  int error = errno;
+  std::cout << std::flush;
+  std::cerr << progname << ": failed to write \"" << filename << "\": " << strerror(error) << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+void export_block_corpus(std::string const& filename)
+{
+  DoutEntering(dc::notice, "export_block_corpus(\"" << filename << "\")");
+  std::cout << "Sampling at most " << max_blocks_per_class << " blocks of each class for '" << filename << "'.\n";
+  // Reservoir sampling, so that the sample is spread evenly over the whole file system.
+  std::vector<uint32_t> sample[corpus_classes];
+  uint64_t seen[corpus_classes] = { 0, };
+  uint32_t random = 2463534242U;	// xorshift32 state; the same device always results in the same corpus.
+  int const chunk_blocks = std::max(1, scan_chunk_size / block_size_);
+  std::vector<unsigned char> buf(chunk_blocks * block_size_);
+  Progress progress("--export-block-corpus", block_count(super_block) - first_data_block(super_block), block_size_);
+  for (int group = 0; group < groups_; ++group)
+  {
+    int first_block = first_data_block(super_block) + group * blocks_per_group(super_block);
+    int last_block = std::min(first_block + blocks_per_group(super_block), block_count(super_block));
+    for (int block = first_block; block < last_block; block += chunk_blocks)
+    {
+      int count = std::min(chunk_blocks, last_block - block);
+      progress.update(block - first_data_block(super_block));
+      get_blocks(block, count, &buf[0]);
+      for (int i = 0; i < count; ++i)
+      {
+        corpus_class cls = classify_block(&buf[i * block_size_], block + i, group);
+	if (++seen[cls] <= max_blocks_per_class)
+	  sample[cls].push_back(block + i);
+	else
+	{
+	  random ^= random << 13;
+	  random ^= random >> 17;
+	  random ^= random << 5;
+	  uint64_t index = random % seen[cls];
+	  if (index < max_blocks_per_class)
+	    sample[cls][index] = block + i;
+	}
+      }
+    }
+  }
+  block_corpus_header_st header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.block_size = block_size_;
+  for (int cls = 0; cls < corpus_classes; ++cls)
+  {
+    std::sort(sample[cls].begin(), sample[cls].end());
+    header.count[cls] = sample[cls].size();
+  }
+  std::ofstream output(filename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!output.is_open())
+    write_failed(filename);
+  output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  for (int cls = 0; cls < corpus_classes; ++cls)
+  {
+    if (sample[cls].empty())
+      continue;
+    output.write(reinterpret_cast<char const*>(&sample[cls][0]), sample[cls].size() * sizeof(uint32_t));
+    for (std::vector<uint32_t>::iterator iter = sample[cls].begin(); iter != sample[cls].end(); ++iter)
+      output.write(reinterpret_cast<char const*>(get_block(*iter, &buf[0])), block_size_);
+  }
+  output.close();
+  if (output.fail())
+    write_failed(filename);
+  for (int cls = 0; cls < corpus_classes; ++cls)
+    std::cout << corpus_class_name[cls] << ": " << sample[cls].size() << " of " << seen[cls] << " blocks.\n";
+}
+
+void load_block_corpus(std::string const& filename, BlockCorpus& corpus)
+{
+  std::ifstream input(filename.c_str(), std::ios::binary);
+  if (!input.is_open())
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": failed to open \"" << filename << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  block_corpus_header_st header;
+  input.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!input.good() || std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": \"" << filename << "\" is not a block corpus (see --export-block-corpus)." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (header.block_size != (uint32_t)block_size_)
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": the blocks in \"" << filename << "\" are " << header.block_size <<
+        " bytes, but the block size of " << device_name << " is " << block_size_ << " bytes." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  corpus.block_size = block_size_;
+  for (int cls = 0; cls < corpus_classes; ++cls)
+  {
+    corpus.blocknr[cls].resize(header.count[cls]);
+    corpus.data[cls].resize((size_t)header.count[cls] * block_size_);
+    if (header.count[cls] == 0)
+      continue;
+    input.read(reinterpret_cast<char*>(&corpus.blocknr[cls][0]), header.count[cls] * sizeof(uint32_t));
+    input.read(reinterpret_cast<char*>(&corpus.data[cls][0]), corpus.data[cls].size());
+  }
+  if (!input.good())
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": \"" << filename << "\" is truncated." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
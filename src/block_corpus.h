@@ -0,0 +1,60 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file block_corpus.h Declaration of the block corpus used by --microbench.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BLOCK_CORPUS_H
+#define BLOCK_CORPUS_H
+
+#ifndef USE_PCH
+#include <string>
+#include <vector>
+#include <stdint.h>
+#endif
+
+// The classes of blocks in a block corpus.
+enum corpus_class {
+  corpus_directory,			// is_directory() returned isdir_start or isdir_extended.
+  corpus_indirect,			// is_indirect_block() returned true.
+  corpus_inode_table,			// The block is part of an inode table.
+  corpus_data,				// Any other block.
+  corpus_classes
+};
+
+extern char const* const corpus_class_name[corpus_classes];
+
+// A sample of the blocks of a file system, per class.
+struct BlockCorpus {
+  size_t block_size;
+  std::vector<uint32_t> blocknr[corpus_classes];	// The block numbers, sorted.
+  std::vector<unsigned char> data[corpus_classes];	// The contents of those blocks, block_size_ bytes each.
+
+
+  unsigned char* block(int cls, size_t index) { return &data[cls][index * block_size]; }
+};
+
+// Write a sample of at most 4096 blocks of each class to 'filename'.
+void export_block_corpus(std::string const& filename);
+
+// Read a file written by export_block_corpus into corpus.
+void load_block_corpus(std::string const& filename, BlockCorpus& corpus);
+
+#endif // BLOCK_CORPUS_H
@@ -23,28 +23,43 @@
 
 #ifndef USE_PCH
 #include "sys.h"
+#include <algorithm>
 #endif
 
 #include "blocknr_vector_type.h"
+#include "scratch_memory.h"
 
-blocknr_vector_type& blocknr_vector_type::operator=(std::vector<uint32_t> const& vec)
+static uint32_t* allocate_blocknr_vector(uint32_t capacity)
 {
-  if (!empty())
-    erase();
-  uint32_t size = vec.size();
-  if (size > 0)
+  uint32_t* ptr = static_cast<uint32_t*>(scratch_node_alloc((capacity + 2) * sizeof(uint32_t)));
+  ptr[1] = capacity;
+  return ptr;
+}
+
+static void free_blocknr_vector(uint32_t* ptr)
+{
+  scratch_node_free(ptr, (ptr[1] + 2) * sizeof(uint32_t));
+}
+
+void blocknr_vector_type::erase(void)
+{
+  if (!empty() && is_vector())
+    free_blocknr_vector(blocknr_vector);
+  blocknr = 0;
+}
+
+void blocknr_vector_type::assign(uint32_t const* blocks, uint32_t size)
+{
+  erase();
+  if (size == 1)
+    blocknr = ((size_t)blocks[0] << 1) | 1;
+  else if (size > 1)
   {
-    if (size == 1)
-      blocknr = (vec[0] << 1) | 1; 
-    else
-    {
-      blocknr_vector = new uint32_t [size + 1]; 
-      blocknr_vector[0] = size;
-      for (uint32_t i = 0; i < size; ++i)
-        blocknr_vector[i + 1] = vec[i];
-    }
+    blocknr_vector = allocate_blocknr_vector(size);
+    blocknr_vector[0] = size;
+    for (uint32_t i = 0; i < size; ++i)
+      blocknr_vector[i + 2] = blocks[i];
   }
-  return *this;
 }
 
 void blocknr_vector_type::push_back(uint32_t bnr)
@@ -52,47 +67,46 @@ void blocknr_vector_type::push_back(uint32_t bnr)
   if (empty())
   {
     ASSERT(bnr);
-    blocknr = (bnr << 1) | 1;
+    blocknr = ((size_t)bnr << 1) | 1;
   }
   else if (is_vector())
   {
-    uint32_t size = blocknr_vector[0] + 1;
-    uint32_t* ptr = new uint32_t [size + 1]; 
-    ptr[0] = size;
-    for (uint32_t i = 1; i < size; ++i)
-      ptr[i] = blocknr_vector[i];
-    ptr[size] = bnr;
-    delete [] blocknr_vector;
-    blocknr_vector = ptr;
+    uint32_t size = blocknr_vector[0];
+    if (size == blocknr_vector[1])
+    {
+      uint32_t* ptr = allocate_blocknr_vector(2 * size);
+      for (uint32_t i = 0; i < size; ++i)
+        ptr[i + 2] = blocknr_vector[i + 2];
+      free_blocknr_vector(blocknr_vector);
+      blocknr_vector = ptr;
+    }
+    blocknr_vector[size + 2] = bnr;
+    blocknr_vector[0] = size + 1;
   }
   else
   {
-    uint32_t* ptr = new uint32_t [3];
+    uint32_t* ptr = allocate_blocknr_vector(2);
     ptr[0] = 2;
-    ptr[1] = blocknr >> 1;
-    ptr[2] = bnr;
+    ptr[2] = blocknr >> 1;
+    ptr[3] = bnr;
     blocknr_vector = ptr;
   }
 }
 
+// Remove blknr, keeping the remaining block numbers in the same order.
 void blocknr_vector_type::remove(uint32_t blknr)
 {
   ASSERT(is_vector());
   uint32_t size = blocknr_vector[0];
-  int found = 0;
-  for (uint32_t j = 1; j <= size; ++j)
-    if (blocknr_vector[j] == blknr)
-    {
-      found = j;
-      break;
-    }
-  ASSERT(found);
-  blocknr_vector[found] = blocknr_vector[size];
+  uint32_t* begin = blocknr_vector + 2;
+  uint32_t* found = std::find(begin, begin + size, blknr);
+  ASSERT(found != begin + size);
+  std::copy(found + 1, begin + size, found);
   blocknr_vector[0] = --size;
   if (size == 1)
   {
-    int last_block = blocknr_vector[1];
-    delete [] blocknr_vector;
-    blocknr = (last_block << 1) | 1;
+    uint32_t last_block = begin[0];
+    free_blocknr_vector(blocknr_vector);
+    blocknr = ((size_t)last_block << 1) | 1;
   }
 }
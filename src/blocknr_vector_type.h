@@ -34,21 +34,27 @@
 
 #define BVASSERT(x) ASSERT(x)
 
+// A vector of block numbers that is just as large as a pointer.
+// A single block number is stored inline, with the least significant bit set.
+// More block numbers are stored in an array allocated with scratch_node_alloc:
+// blocknr_vector[0] is the size, blocknr_vector[1] the capacity (which is
+// doubled when needed) and the block numbers follow, in insertion order.
 union blocknr_vector_type {
   size_t blocknr;		// This must be a size_t in order to align the least significant bit with the least significant bit of blocknr_vector.
   uint32_t* blocknr_vector;
 
   void push_back(uint32_t blocknr);
   void remove(uint32_t blocknr);
-  void erase(void) { if (is_vector()) delete [] blocknr_vector; blocknr = 0; }
-  blocknr_vector_type& operator=(std::vector<uint32_t> const& vec);
+  void erase(void);
+  void assign(uint32_t const* blocks, uint32_t size);
+  blocknr_vector_type& operator=(std::vector<uint32_t> const& vec) { assign(vec.empty() ? NULL : &vec[0], vec.size()); return *this; }
 
   bool empty(void) const { return blocknr == 0; }
   // The rest is only valid if empty() returned false.
   bool is_vector(void) const { BVASSERT(!empty()); return !(blocknr & 1); }
   uint32_t size(void) const { return is_vector() ? blocknr_vector[0] : 1; }
-  uint32_t first_entry(void) const { return is_vector() ? blocknr_vector[1] : (blocknr >> 1); }
-  uint32_t operator[](int index) const { BVASSERT(index >= 0 && (size_t)index < size()); return (index == 0) ? first_entry() : blocknr_vector[index + 1]; }
+  uint32_t first_entry(void) const { return is_vector() ? blocknr_vector[2] : (blocknr >> 1); }
+  uint32_t operator[](int index) const { BVASSERT(index >= 0 && (size_t)index < size()); return (index == 0) ? first_entry() : blocknr_vector[index + 2]; }
 };
 
 #endif // BLOCKNR_VECTOR_TYPE_H
@@ -24,6 +24,7 @@
 #ifndef USE_PCH
 #include "sys.h"
 #include <iostream>
+#include <cstdlib>
 #include <unistd.h>
 #include <getopt.h>
 #endif
@@ -32,6 +33,8 @@
 #include "globals.h"
 #include "restore.h"
 #include "accept.h"
+#include "output.h"
+#include "server.h"
 
 // Commandline options.
 bool commandline_superblock = false;
@@ -67,10 +70,73 @@ std::vector<std::string> commandline_restore_file;
 std::string commandline_restore_inode;
 bool commandline_restore_all = false;
 bool commandline_show_hardlinks = false;
+std::string commandline_export_block_corpus;
+std::string commandline_microbench;
 bool commandline_debug = false;
 bool commandline_debug_malloc = false;
 bool commandline_custom = false;
 bool commandline_accept_all = false;
+size_t commandline_memory_limit = 0;
+std::string commandline_scratch_dir = ".";
+int commandline_threads = 0;
+size_t commandline_block_cache = 64 << 20;
+std::string commandline_stats;
+std::string commandline_trace;
+output_format_type commandline_format = output_text;
+int commandline_max_warnings = 10;
+std::string commandline_serve;
+std::string commandline_batch;
+
+// Reset the options of a query to their default values. Used by --serve before
+// decoding the options of a query, so that no option of the server or of a
+// previous query is left behind. The options that took effect when the server
+// started (--memory-limit, --scratch-dir, --threads, --block-cache, --stats,
+// --trace and --max-warnings) are not reset: the query inherits them.
+void reset_commandline_options(void)
+{
+  commandline_superblock = false;
+  commandline_group = -1;
+  commandline_inode_to_block = -1;
+  commandline_inode = -1;
+  commandline_block = -1;
+  commandline_journal_block = -1;
+  commandline_journal_transaction = -1;
+  commandline_print = false;
+  commandline_ls = false;
+  commandline_journal = false;
+  commandline_dump_names = false;
+  commandline_depth = 0;
+  commandline_deleted = false;
+  commandline_directory = false;
+  commandline_before = 0;
+  commandline_after = 0;
+  commandline_allocated = false;
+  commandline_unallocated = false;
+  commandline_reallocated = false;
+  commandline_action = false;
+  commandline_search_zeroed_inodes = false;
+  commandline_zeroed_inodes = false;
+  commandline_show_path_inodes = false;
+  commandline_search.clear();
+  commandline_search_start.clear();
+  commandline_search_inode = -1;
+  commandline_histogram = hist_none;
+  commandline_inode_dirblock_table.clear();
+  commandline_show_journal_inodes = -1;
+  commandline_restore_file.clear();
+  commandline_restore_inode.clear();
+  commandline_restore_all = false;
+  commandline_show_hardlinks = false;
+  commandline_export_block_corpus.clear();
+  commandline_microbench.clear();
+  commandline_debug = false;
+  commandline_debug_malloc = false;
+  commandline_custom = false;
+  commandline_accept_all = false;
+  commandline_format = output_text;
+  commandline_serve.clear();
+  commandline_batch.clear();
+}
 
 //-----------------------------------------------------------------------------
 //
@@ -95,6 +161,21 @@ static void print_usage(std::ostream& os)
   os << "  --accept-all           Simply accept everything as filename.\n";
   os << "  --journal              Show content of journal.\n";
   os << "  --show-path-inodes     Show the inode of each directory component in paths.\n";
+  os << "  --memory-limit size    Back large tables with a scratch file once they use more\n";
+  os << "                         than 'size' bytes. A suffix K, M or G may be used.\n";
+  os << "  --scratch-dir dir      Create the scratch file in 'dir' (default: current dir).\n";
+  os << "  --threads n            Use 'n' threads (default: the number of CPUs).\n";
+  os << "  --block-cache size     Cache at most 'size' bytes of blocks read from the device\n";
+  os << "                         (default: 64M). Use 0 to disable the cache.\n";
+  os << "  --stats file           Write the number of blocks read, the get_block latency,\n";
+  os << "                         cache hits and other counters of each phase as JSON\n";
+  os << "                         to 'file' when ext3grep exits.\n";
+  os << "  --max-warnings n       Print at most 'n' warnings of each kind that can occur\n";
+  os << "                         once per block or entry (default: 10). Use 0 to print\n";
+  os << "                         them all.\n";
+  os << "  --trace file           Write the time spent in the stages, per group, per\n";
+  os << "                         directory, per restored file and per work item of each\n";
+  os << "                         thread to 'file' in the Chrome trace event format.\n";
 #ifdef CWDEBUG
   os << "  --debug                Turn on printing of debug output.\n";
   os << "  --debug-malloc         Turn on debugging of memory allocations.\n";
@@ -169,6 +250,43 @@ static void print_usage(std::ostream& os)
   os << "                         them being hard linked to a more recently deleted file\n";
   os << "                         and as such polute the output.\n";
   os << "  --show-hardlinks       Show all inodes that are shared by two or more files.\n";
+  os << "  --format=[text|jsonl|csv|tsv]\n";
+  os << "                         Write the results of --dump-names, --ls, --search*,\n";
+  os << "                         --histogram, --show-hardlinks and --journal-transaction\n";
+  os << "                         to stdout as JSON lines, CSV or TSV, with the fields\n";
+  os << "                         action, path, inode, block, journal_block, group, time,\n";
+  os << "                         dtime, state, sequence and count. All other output is\n";
+  os << "                         then written to stderr.\n";
+  os << "  --export-block-corpus file\n";
+  os << "                         Write a sample of the directory, indirect, inode table\n";
+  os << "                         and other blocks to 'file', for use with --microbench.\n";
+  os << "  --serve socket         Load everything once and answer queries on the unix\n";
+  os << "                         socket 'socket' until killed. The queries are sent with\n";
+  os << "                         --client and are run in a child process each.\n";
+  os << "  --client socket [options]\n";
+  os << "                         Send 'options' (without device-file) as a query to the\n";
+  os << "                         server on 'socket' and print the answer.\n";
+  os << "  --batch file           Run the commands in 'file' (- is stdin), one per line:\n";
+  os << "                         inode N, block N, search str, search-start str,\n";
+  os << "                         restore-file path and restore-inode N[@seq]. All\n";
+  os << "                         searches are done in a single pass over the device.\n";
+  os << "  --microbench file      Time is_directory, iterate_over_directory,\n";
+  os << "                         is_indirect_block, the --search matcher, the block\n";
+  os << "                         bitmap loop and blocknr_vector_type on the blocks in\n";
+  os << "                         'file', a file written by --export-block-corpus.\n";
+}
+
+#ifdef USE_SVN
+extern char const* svn_revision;
+#endif
+
+static void print_running(void)
+{
+#ifdef USE_SVN
+  std::cout << "Running " << svn_revision << '\n';
+#else
+  std::cout << "Running ext3grep version " VERSION "\n";
+#endif
 }
 
 static void print_version(void)
@@ -218,12 +336,44 @@ enum opts {
   opt_restore_inode,
   opt_restore_all,
   opt_show_hardlinks,
+  opt_export_block_corpus,
+  opt_microbench,
   opt_help,
   opt_debug,
   opt_debug_malloc,
-  opt_custom
+  opt_custom,
+  opt_memory_limit,
+  opt_scratch_dir,
+  opt_threads,
+  opt_block_cache,
+  opt_stats,
+  opt_trace,
+  opt_format,
+  opt_max_warnings,
+  opt_serve,
+  opt_batch
 };
 
+// Parse a size argument, which may have a K, M or G suffix.
+static size_t parse_size(char const* option, char const* arg, bool allow_zero)
+{
+  char* endptr;
+  unsigned long long size = strtoull(arg, &endptr, 10);
+  if (*endptr == 'K' || *endptr == 'k')
+    size <<= 10, ++endptr;
+  else if (*endptr == 'M' || *endptr == 'm')
+    size <<= 20, ++endptr;
+  else if (*endptr == 'G' || *endptr == 'g')
+    size <<= 30, ++endptr;
+  if (*endptr != '\0' || endptr == arg || (size == 0 && !allow_zero) || size != static_cast<size_t>(size))
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": " << option << ": " << arg << ": invalid size." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return size;
+}
+
 void decode_commandline_options(int& argc, char**& argv)
 {
   int short_option;
@@ -265,9 +415,21 @@ void decode_commandline_options(int& argc, char**& argv)
     {"restore-file", 1, &long_option, opt_restore_file},
     {"restore-all", 0, &long_option, opt_restore_all},
     {"show-hardlinks", 0, &long_option, opt_show_hardlinks},
+    {"export-block-corpus", 1, &long_option, opt_export_block_corpus},
+    {"microbench", 1, &long_option, opt_microbench},
     {"debug", 0, &long_option, opt_debug},
     {"debug-malloc", 0, &long_option, opt_debug_malloc},
     {"custom", 0, &long_option, opt_custom},
+    {"memory-limit", 1, &long_option, opt_memory_limit},
+    {"scratch-dir", 1, &long_option, opt_scratch_dir},
+    {"threads", 1, &long_option, opt_threads},
+    {"block-cache", 1, &long_option, opt_block_cache},
+    {"stats", 1, &long_option, opt_stats},
+    {"trace", 1, &long_option, opt_trace},
+    {"format", 1, &long_option, opt_format},
+    {"max-warnings", 1, &long_option, opt_max_warnings},
+    {"serve", 1, &long_option, opt_serve},
+    {"batch", 1, &long_option, opt_batch},
     {NULL, 0, NULL, 0}
   };
 
@@ -283,9 +445,11 @@ void decode_commandline_options(int& argc, char**& argv)
         switch (long_option)
         {
           case opt_help:
+            print_running();
             print_usage(std::cout);
             exit(EXIT_SUCCESS);
           case opt_version:
+            print_running();
             print_version();
             exit(EXIT_SUCCESS);
 	  case opt_debug:
@@ -297,6 +461,68 @@ void decode_commandline_options(int& argc, char**& argv)
 	  case opt_custom:
 	    commandline_custom = true;
 	    break;
+	  case opt_memory_limit:
+	    commandline_memory_limit = parse_size("--memory-limit", optarg, false);
+	    break;
+	  case opt_block_cache:
+	    commandline_block_cache = parse_size("--block-cache", optarg, true);
+	    break;
+	  case opt_stats:
+	    commandline_stats = optarg;
+	    break;
+	  case opt_trace:
+	    commandline_trace = optarg;
+	    break;
+	  case opt_serve:
+	    commandline_serve = optarg;
+	    break;
+	  case opt_batch:
+	    commandline_batch = optarg;
+	    break;
+	  case opt_max_warnings:
+	  {
+	    char* endptr;
+	    long max_warnings = strtol(optarg, &endptr, 10);
+	    if (*endptr != '\0' || endptr == optarg || max_warnings < 0)
+	    {
+	      std::cout << std::flush;
+	      std::cerr << progname << ": --max-warnings: " << optarg << ": expected a number." << std::endl;
+	      exit(EXIT_FAILURE);
+	    }
+	    commandline_max_warnings = max_warnings;
+	    break;
+	  }
+	  case opt_format:
+	  {
+	    std::string format_arg(optarg);
+	    if (format_arg == "text")
+	      commandline_format = output_text;
+	    else if (format_arg == "jsonl")
+	      commandline_format = output_jsonl;
+	    else if (format_arg == "csv")
+	      commandline_format = output_csv;
+	    else if (format_arg == "tsv")
+	      commandline_format = output_tsv;
+	    else
+	    {
+	      std::cout << std::flush;
+	      std::cerr << progname << ": --format: " << format_arg << ": unknown output format." << std::endl;
+	      exit(EXIT_FAILURE);
+	    }
+	    break;
+	  }
+	  case opt_scratch_dir:
+	    commandline_scratch_dir = optarg;
+	    break;
+	  case opt_threads:
+	    commandline_threads = atoi(optarg);
+	    if (commandline_threads < 1)
+	    {
+	      std::cout << std::flush;
+	      std::cerr << progname << ": --threads: " << optarg << ": need at least one thread." << std::endl;
+	      exit(EXIT_FAILURE);
+	    }
+	    break;
 	  case opt_superblock:
 	    commandline_superblock = true;
 	    break;
@@ -377,6 +603,12 @@ void decode_commandline_options(int& argc, char**& argv)
 	  case opt_show_hardlinks:
 	    commandline_show_hardlinks = true;
 	    break;
+	  case opt_export_block_corpus:
+	    commandline_export_block_corpus = optarg;
+	    break;
+	  case opt_microbench:
+	    commandline_microbench = optarg;
+	    break;
 	  case opt_search_inode:
             commandline_search_inode = atoi(optarg);
 	    if (commandline_search_inode <= 0)
@@ -487,11 +719,17 @@ void decode_commandline_options(int& argc, char**& argv)
         break;
       case 'v':
       case 'V':
+        print_running();
         print_version();
         exit(EXIT_SUCCESS);
     }
   }
 
+  // This must be done before anything is written to std::cout.
+  init_output(commandline_format);
+  if (!serving_query)
+    print_running();
+
   if (exclusive1 > 1)
   {
     std::cout << std::flush;
@@ -535,7 +773,11 @@ void decode_commandline_options(int& argc, char**& argv)
        !commandline_restore_inode.empty() ||
        !commandline_restore_file.empty() ||
        commandline_restore_all ||
-       commandline_show_hardlinks);
+       commandline_show_hardlinks ||
+       !commandline_export_block_corpus.empty() ||
+       !commandline_microbench.empty() ||
+       !commandline_serve.empty() ||
+       !commandline_batch.empty());
   if (!commandline_action && !commandline_superblock)
   {
     std::cout << "No action specified; implying --superblock.\n";
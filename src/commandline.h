@@ -28,9 +28,11 @@
 #include <string>		// Needed for std::string
 #include <vector>		// Needed for std::vector
 #include <time.h>		// Needed for time_t
+#include <cstddef>		// Needed for size_t
 #endif
 
 #include "histogram.h"		// Needed for hist_type
+#include "output.h"		// Needed for output_format_type
 
 // Commandline options.
 extern bool commandline_superblock;
@@ -66,9 +68,21 @@ extern std::vector<std::string> commandline_restore_file;
 extern std::string commandline_restore_inode;
 extern bool commandline_restore_all;
 extern bool commandline_show_hardlinks;
+extern std::string commandline_export_block_corpus;
+extern std::string commandline_microbench;
 extern bool commandline_debug;
 extern bool commandline_debug_malloc;
 extern bool commandline_custom;
 extern bool commandline_accept_all;
+extern size_t commandline_memory_limit;
+extern std::string commandline_scratch_dir;
+extern int commandline_threads;
+extern size_t commandline_block_cache;
+extern std::string commandline_stats;
+extern std::string commandline_trace;
+extern output_format_type commandline_format;
+extern int commandline_max_warnings;
+extern std::string commandline_serve;
+extern std::string commandline_batch;
 
 #endif // COMMANDLINE_H
@@ -43,6 +43,7 @@
 #include "get_block.h"
 #include "init_consts.h"
 #include "print_inode_to.h"
+#include "progress.h"
 
 // The first part of this file was written and used for custom job:
 // recovering emails on a 40 GB partition that had no information
@@ -1659,22 +1660,9 @@ int outfd;
 #endif
 int count = 0;
 
-struct timeval& operator-=(struct timeval& t1, struct timeval const& t2)
-{
-  t1.tv_sec -= t2.tv_sec;
-  if ((t1.tv_usec -= t2.tv_usec) < 0)
-  {
-    t1.tv_usec += 1000000;
-    --t1.tv_sec;
-  }
-  return t1;
-}
-
 static char const zeroes[4096] = { 0, };
-struct timeval start_time;
-struct timeval current_time;
 int const total_blocks = 78643200;
-int remaining_blocks = total_blocks;
+static Progress* progress;
 
 // This function is called for every data block.
 void process_data_block(int block_number)
@@ -1703,17 +1691,7 @@ void process_data_block(int block_number)
   }
 #endif
   ++count;
-  --remaining_blocks;
-  if (remaining_blocks % 10000 == 0)
-  {
-    gettimeofday(&current_time, NULL);
-    current_time -= start_time;
-    double seconds = current_time.tv_sec + current_time.tv_usec * 1e-6;
-    double blocks_per_second = (total_blocks - remaining_blocks) / seconds;
-    std::cout << "Speed: " << (blocks_per_second * 4.096e-3) << " MB/s. ";
-    double remaining_minutes = remaining_blocks / blocks_per_second / 60;
-    std::cout << "ETA: " << std::fixed << remaining_minutes << " minutes." << std::endl;
-  }
+  progress->update(count);
 }
 
 void custom(void)
@@ -1731,7 +1709,8 @@ void custom(void)
 #if DO_ACTUAL_RECOVERY
   outfd = ::open("/home/carlo/RECOVERED.MOSES-DRIVE-322GB.VDMK-flat.vmdk", O_WRONLY|O_CREAT|O_TRUNC|O_LARGEFILE, 0644);
 #endif
-  gettimeofday(&start_time, NULL);
+  Progress recovery_progress("Recovery", total_blocks, 4096);
+  progress = &recovery_progress;
   int blocknrs[] = { 163021314, 163021315, 163021316, 163021317, 163021318, 163021319, 163054082, 163054083, 163054084, 163054085, 163054086, 163054087 };
   for (int i = 0; i < (int)(sizeof(blocknrs) / sizeof(int)); ++i)
   {
@@ -0,0 +1,93 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file diagnostics.cc Rate limited warnings.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <pthread.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "diagnostics.h"
+
+uint64_t diag_occurrences_[diag_categories];
+unsigned int diag_reported_[diag_categories];
+unsigned int diag_limit_;
+
+namespace {
+
+pthread_mutex_t S_mutex = PTHREAD_MUTEX_INITIALIZER;	// Protects diag_reported_ and S_printed.
+std::set<uint64_t> S_printed[diag_categories];		// The keys of the messages that were printed.
+
+// Used in the summary: "<count> <description>".
+char const* const S_descriptions[diag_categories] = {
+  "notes about inodes with a non-zero dtime and a non-zero block list",
+  "warnings about directory entries with a zero inode",
+  "warnings about directory blocks with unlikely characters",
+  "warnings about extended directory blocks"
+};
+
+void print_summary(void)
+{
+  bool header = false;
+  for (int category = 0; category < diag_categories; ++category)
+  {
+    uint64_t suppressed = diag_occurrences_[category] - diag_reported_[category];
+    // Don't mention duplicates, unless the limit was reached too.
+    if (!suppressed || !diag_limit_ || diag_reported_[category] < diag_limit_)
+      continue;
+    if (!header)
+    {
+      std::cout << std::flush;
+      std::cerr << progname << ": not all warnings were printed (use --max-warnings to change the limit of " << diag_limit_ << "):\n";
+      header = true;
+    }
+    std::cerr << "  " << suppressed << " more " << S_descriptions[category] << ".\n";
+  }
+  if (header)
+    std::cerr << std::flush;
+}
+
+} // namespace
+
+bool diag_report_slow(diag_category category, uint64_t key)
+{
+  bool print = false;
+  pthread_mutex_lock(&S_mutex);
+  if (diag_wanted(category) && (key == diag_no_key || S_printed[category].insert(key).second))
+  {
+    ++diag_reported_[category];
+    print = true;
+  }
+  pthread_mutex_unlock(&S_mutex);
+  return print;
+}
+
+void init_diagnostics(unsigned int limit)
+{
+  diag_limit_ = limit;
+  atexit(print_summary);
+}
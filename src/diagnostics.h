@@ -0,0 +1,71 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file diagnostics.h Declaration of the rate limited warnings.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#ifndef USE_PCH
+#include <stdint.h>
+#endif
+
+// Warnings and notes that can be printed once per block or entry, and therefore
+// thousands of times on a damaged file system, belong to one of these categories.
+// Only the first --max-warnings different ones of each category are printed;
+// the rest is only counted and mentioned in a summary when the program exits.
+enum diag_category {
+  diag_nonzero_dtime,		// filter_dir_entry: an inode with a dtime that still has a block list.
+  diag_zero_inode,		// is_directory: a dir entry with a zero inode and a sensible name.
+  diag_unlikely_characters,	// is_directory: a directory rejected because of unlikely characters.
+  diag_extended_directory,	// Stage 2: an extended directory block that can't be linked reliably.
+  diag_categories
+};
+
+// Pass this as key to diag_report for messages that are never duplicates.
+uint64_t const diag_no_key = ~(uint64_t)0;
+
+extern uint64_t diag_occurrences_[diag_categories];
+extern unsigned int diag_reported_[diag_categories];
+extern unsigned int diag_limit_;
+
+// Return false when the next message of 'category' certainly won't be printed.
+// Use this to avoid formatting a message that will be thrown away.
+inline bool diag_wanted(diag_category category)
+{
+  return !diag_limit_ || diag_reported_[category] < diag_limit_;
+}
+
+// Count one occurrence of a message of 'category' and return true if it should be printed.
+// Messages with the same key as a message that was already printed are not printed again.
+// This function is thread-safe, and doesn't allocate memory once the limit is reached.
+bool diag_report_slow(diag_category category, uint64_t key);
+inline bool diag_report(diag_category category, uint64_t key)
+{
+  __sync_fetch_and_add(&diag_occurrences_[category], 1);
+  return diag_wanted(category) && diag_report_slow(category, key);
+}
+
+// Print at most 'limit' messages per category (0 means no limit), and
+// print a summary of the suppressed messages when the program exits.
+void init_diagnostics(unsigned int limit);
+
+#endif // DIAGNOSTICS_H
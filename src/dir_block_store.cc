@@ -0,0 +1,266 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file dir_block_store.cc Implementation of the store of directory blocks found in stage 1.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "ext3.h"
+#include "debug.h"
+#endif
+
+#include "dir_block_store.h"
+#include "globals.h"
+
+// File layout (native byte order; the file is only meant to be read on the machine that wrote it):
+//
+//   magic (8 bytes), block size, s_wtime and s_mtime of the superblock (uint32_t each)
+//   the compressed blocks, back to back
+//   the index: one dir_block_store_entry_st per block, in increasing block number
+//   the number of index entries (uint64_t), the offset of the index (uint64_t), magic (8 bytes)
+//
+// A block is compressed by replacing runs of four or more zero bytes (directory blocks
+// contain a lot of them) with their length. It is encoded as alternating literal
+// runs and zero runs, each starting with its length as a variable length integer,
+// starting with a literal run.
+
+namespace {
+
+char const magic[8] = { 'e', '3', 'g', 'd', 'i', 'r', 'b', '2' };
+
+// What is stored after the magic at the start of the file.
+struct dir_block_store_header_st {
+  uint32_t block_size;
+  uint32_t wtime;		// The store is only used while the file system wasn't written to.
+  uint32_t mtime;
+};
+
+struct dir_block_store_entry_st {
+  uint32_t blocknr;
+  uint32_t length;		// The size of the compressed block.
+  uint64_t offset;		// The offset of the compressed block in the file.
+};
+
+bool operator<(dir_block_store_entry_st const& entry, int blocknr) { return entry.blocknr < (uint32_t)blocknr; }
+
+std::ofstream S_output;
+std::string S_output_filename;
+uint64_t S_output_offset;
+std::vector<dir_block_store_entry_st> S_index;
+int S_fd = -1;			// The store that is opened for reading, or -1.
+
+// The size of the buffer needed to compress one block.
+size_t const max_compressed_size = 2 * EXT3_MAX_BLOCK_SIZE;
+
+void put_length(unsigned char*& out, size_t length)
+{
+  while (length >= 0x80)
+  {
+    *out++ = (length & 0x7f) | 0x80;
+    length >>= 7;
+  }
+  *out++ = length;
+}
+
+size_t get_length(unsigned char const*& in)
+{
+  size_t length = 0;
+  int shift = 0;
+  unsigned char c;
+  do
+  {
+    c = *in++;
+    length |= (size_t)(c & 0x7f) << shift;
+    shift += 7;
+  }
+  while ((c & 0x80));
+  return length;
+}
+
+size_t compress_block(unsigned char const* block, unsigned char* out)
+{
+  unsigned char* const start = out;
+  int pos = 0;
+  while (pos < block_size_)
+  {
+    // Find the next run of at least four zeroes.
+    int literal_end = pos;
+    int zeroes = 0;
+    while (literal_end < block_size_)
+    {
+      int run = 0;
+      while (literal_end + run < block_size_ && block[literal_end + run] == 0)
+        ++run;
+      if (run >= 4 || literal_end + run == block_size_)
+      {
+        zeroes = run;
+        break;
+      }
+      literal_end += run + 1;
+    }
+    put_length(out, literal_end - pos);
+    std::memcpy(out, block + pos, literal_end - pos);
+    out += literal_end - pos;
+    put_length(out, zeroes);
+    pos = literal_end + zeroes;
+  }
+  return out - start;
+}
+
+void decompress_block(unsigned char const* in, unsigned char* block)
+{
+  int pos = 0;
+  while (pos < block_size_)
+  {
+    size_t literal = get_length(in);
+    ASSERT(pos + literal <= (size_t)block_size_);
+    std::memcpy(block + pos, in, literal);
+    in += literal;
+    pos += literal;
+    size_t zeroes = get_length(in);
+    ASSERT(pos + zeroes <= (size_t)block_size_);
+    std::memset(block + pos, 0, zeroes);
+    pos += zeroes;
+  }
+}
+
+void store_error(char const* what, std::string const& filename)
+{
+  int error = errno;
+  std::cout << std::flush;
+  std::cerr << progname << ": " << what << " \"" << filename << "\": " << strerror(error) << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+} // namespace
+
+void dir_block_store_create(std::string const& filename)
+{
+  S_output_filename = filename;
+  S_output.open(filename.c_str(), std::ios::binary | std::ios::trunc);
+  if (!S_output.is_open())
+    store_error("failed to create", filename);
+  dir_block_store_header_st header;
+  header.block_size = block_size_;
+  header.wtime = super_block.s_wtime;
+  header.mtime = super_block.s_mtime;
+  S_output.write(magic, sizeof(magic));
+  S_output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  S_output_offset = sizeof(magic) + sizeof(header);
+  S_index.clear();
+}
+
+void dir_block_store_add(int blocknr, unsigned char const* block)
+{
+  ASSERT(S_index.empty() || S_index.back().blocknr < (uint32_t)blocknr);
+  unsigned char buf[max_compressed_size];
+  dir_block_store_entry_st entry;
+  entry.blocknr = blocknr;
+  entry.length = compress_block(block, buf);
+  entry.offset = S_output_offset;
+  S_output.write(reinterpret_cast<char const*>(buf), entry.length);
+  S_output_offset += entry.length;
+  S_index.push_back(entry);
+}
+
+void dir_block_store_close(void)
+{
+  uint64_t count = S_index.size();
+  if (count)
+    S_output.write(reinterpret_cast<char const*>(&S_index[0]), count * sizeof(dir_block_store_entry_st));
+  S_output.write(reinterpret_cast<char const*>(&count), sizeof(count));
+  S_output.write(reinterpret_cast<char const*>(&S_output_offset), sizeof(S_output_offset));
+  S_output.write(magic, sizeof(magic));
+  S_output.close();
+  if (S_output.fail())
+    store_error("failed to write", S_output_filename);
+  if (!dir_block_store_open(S_output_filename))
+    store_error("failed to read back", S_output_filename);
+}
+
+bool dir_block_store_open(std::string const& filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+  off_t size = lseek(fd, 0, SEEK_END);
+  char header_magic[sizeof(magic)];
+  dir_block_store_header_st header;
+  char trailer[sizeof(uint64_t) + sizeof(uint64_t) + sizeof(magic)];
+  uint64_t count;
+  uint64_t index_offset;
+  off_t const header_size = sizeof(header_magic) + sizeof(header);
+  bool ok = size >= header_size + (off_t)sizeof(trailer) &&
+      pread(fd, header_magic, sizeof(header_magic), 0) == sizeof(header_magic) &&
+      pread(fd, &header, sizeof(header), sizeof(header_magic)) == sizeof(header) &&
+      pread(fd, trailer, sizeof(trailer), size - sizeof(trailer)) == sizeof(trailer);
+  if (ok)
+  {
+    std::memcpy(&count, trailer, sizeof(count));
+    std::memcpy(&index_offset, trailer + sizeof(count), sizeof(index_offset));
+    ok = std::memcmp(header_magic, magic, sizeof(magic)) == 0 &&
+        std::memcmp(trailer + sizeof(count) + sizeof(index_offset), magic, sizeof(magic)) == 0 &&
+	header.block_size == (uint32_t)block_size_ &&
+	header.wtime == super_block.s_wtime &&
+	header.mtime == super_block.s_mtime &&
+	index_offset + count * sizeof(dir_block_store_entry_st) + sizeof(trailer) == (uint64_t)size;
+  }
+  if (ok)
+  {
+    S_index.resize(count);
+    if (count)
+      ok = pread(fd, &S_index[0], count * sizeof(dir_block_store_entry_st), index_offset) == (ssize_t)(count * sizeof(dir_block_store_entry_st));
+  }
+  if (!ok)
+  {
+    S_index.clear();
+    close(fd);
+    return false;
+  }
+  if (S_fd != -1)
+    close(S_fd);
+  S_fd = fd;
+  return true;
+}
+
+bool dir_block_store_get(int blocknr, unsigned char* block_buf)
+{
+  if (S_fd == -1)
+    return false;
+  std::vector<dir_block_store_entry_st>::const_iterator iter = std::lower_bound(S_index.begin(), S_index.end(), blocknr);
+  if (iter == S_index.end() || iter->blocknr != (uint32_t)blocknr)
+    return false;
+  unsigned char buf[max_compressed_size];
+  ASSERT(iter->length <= sizeof(buf));
+  ssize_t len = pread(S_fd, buf, iter->length, iter->offset);
+  ASSERT(len == (ssize_t)iter->length);
+  decompress_block(buf, block_buf);
+  return true;
+}
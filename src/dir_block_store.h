@@ -0,0 +1,53 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file dir_block_store.h Declarations for the store of directory blocks found in stage 1.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DIR_BLOCK_STORE_H
+#define DIR_BLOCK_STORE_H
+
+#ifndef USE_PCH
+#include <string>
+#endif
+
+// Stage 1 reads every block of the device, and writes the contents of all blocks that
+// look like directory blocks to a side file next to the stage1 file, compressed and
+// indexed by block number. Once that store is opened, get_block serves those blocks
+// from it, so that later stages (and later runs) don't have to seek all over the device.
+
+// Start writing a new store to 'filename'.
+void dir_block_store_create(std::string const& filename);
+
+// Append the contents of block 'blocknr'. Must be called with increasing block numbers.
+void dir_block_store_add(int blocknr, unsigned char const* block);
+
+// Finish writing the store and open it for reading.
+void dir_block_store_close(void);
+
+// Open an existing store. Returns false if it doesn't exist, is incomplete, or was
+// written before the file system was last written to or mounted (see s_wtime and s_mtime).
+bool dir_block_store_open(std::string const& filename);
+
+// Copy block 'blocknr' from the store to block_buf and return true, or return false if it isn't in the store.
+// This function is thread-safe.
+bool dir_block_store_get(int blocknr, unsigned char* block_buf);
+
+#endif // DIR_BLOCK_STORE_H
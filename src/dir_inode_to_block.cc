@@ -29,6 +29,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <cerrno>
+#include <set>
+#include <vector>
 #endif
 
 #include "blocknr_vector_type.h"
@@ -40,13 +42,22 @@
 #include "print_inode_to.h"
 #include "directories.h"
 #include "journal.h"
+#include "dir_inode_to_block.h"
+#include "parallel.h"
+#include "xxhash.h"
+#include "dir_block_store.h"
+#include "inode_catalog.h"
+#include "inode.h"
+#include "stats.h"
+#include "trace.h"
+#include "progress.h"
 
 //-----------------------------------------------------------------------------
 //
 // dir_inode_to_block
 //
 
-// dir_inode_to_block_cache is an array of either
+// dir_inode_to_block_cache maps directory inodes to either
 // one block number stored directly, or pointers to an
 // array with more than one block (allocated with new).
 // The first entry of such an array contains the length
@@ -54,8 +65,12 @@
 //
 // This pseudo vector only stores non-zero block values.
 // If 'blocknr' is empty, then the vector is empty.
+// Inodes that were never seen in a directory block
+// have no entry in the map at all.
 
-blocknr_vector_type* dir_inode_to_block_cache;
+dir_inode_to_block_cache_type dir_inode_to_block_cache;
+bool dir_inode_to_block_cache_initialized;
+directory_block_hash_map_type directory_block_hash_map;
 std::vector<int> extended_blocks;
 
 #define INCLUDE_JOURNAL 1
@@ -76,18 +91,99 @@ bool does_not_end_on_END(std::string const& cachename)
   return does_not;
 }
 
+// A block that refers to an inode that is also referred to by other blocks,
+// and what the journal knows about it.
+struct SharedCandidate {
+  int block;				// The block number.
+  bool in_journal;			// True if block is part of the journal.
+  bool has_descriptor;			// True if block has a descriptor in the journal.
+  uint32_t descriptor_sequence;		// The sequence number of that descriptor, if any.
+  uint32_t largest_sequence;		// The result of find_largest_journal_sequence_number(block).
+  uint64_t content_hash;		// The xxhash64 of the content of the block.
+};
+
+// An inode that is referred to by more than one block.
+struct SharedInode {
+  dir_inode_to_block_cache_type::iterator inode_iter;
+  std::vector<SharedCandidate> candidates;
+  std::vector<SharedCandidate> remaining;	// The candidates that are left after looking at the journal.
+  std::vector<int> duplicates;			// The remaining blocks that are exactly equal to an earlier one.
+};
+
+// Collect what the journal and stage 1 know about the blocks of shared_inode.
+static void analyse_shared_inode(SharedInode& shared_inode)
+{
+  blocknr_vector_type const bv = shared_inode.inode_iter->second;
+  uint32_t const size = bv.size();
+  shared_inode.candidates.resize(size);
+  unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  for (uint32_t j = 0; j < size; ++j)
+  {
+    SharedCandidate& candidate(shared_inode.candidates[j]);
+    candidate.block = bv[j];
+    candidate.in_journal = is_journal(candidate.block);
+    block_in_journal_to_descriptors_map_type::iterator iter = block_in_journal_to_descriptors_map.find(candidate.block);
+    candidate.has_descriptor = (iter != block_in_journal_to_descriptors_map.end());
+    candidate.descriptor_sequence = candidate.has_descriptor ? iter->second->sequence() : 0;
+    candidate.largest_sequence = find_largest_journal_sequence_number(candidate.block);
+    directory_block_hash_map_type::iterator hash_iter = directory_block_hash_map.find(candidate.block);
+    if (hash_iter != directory_block_hash_map.end())
+      candidate.content_hash = hash_iter->second;
+    else	// The stage 1 file was written by an older version.
+      candidate.content_hash = xxhash64(get_block(candidate.block, block_buf), block_size_);
+  }
+}
+
+// Called in parallel for each SharedInode: find the remaining blocks that are exactly equal to an earlier one.
+// Blocks with a content hash that we saw before are identical to an earlier block and are
+// found without reading them. The other blocks are read and only compared with the
+// blocks that have the same DirectoryBlock::hash.
+static void find_duplicate_blocks(size_t index, void* data)
+{
+  SharedInode& shared_inode((*static_cast<std::vector<SharedInode>*>(data))[index]);
+  if (shared_inode.remaining.size() < 2)
+    return;
+  std::set<uint64_t> content_hashes;
+  std::list<DirectoryBlock> dir_blocks;
+  typedef std::map<uint64_t, std::vector<std::list<DirectoryBlock>::iterator> > hash_to_dir_blocks_type;
+  hash_to_dir_blocks_type hash_to_dir_blocks;
+  for (std::vector<SharedCandidate>::iterator iter = shared_inode.remaining.begin(); iter != shared_inode.remaining.end(); ++iter)
+  {
+    bool found_duplicate = !content_hashes.insert(iter->content_hash).second;
+    if (!found_duplicate)
+    {
+      std::list<DirectoryBlock>::iterator dir_iter = dir_blocks.insert(dir_blocks.end(), DirectoryBlock());
+      dir_iter->read_block(iter->block, dir_iter);
+      std::vector<std::list<DirectoryBlock>::iterator>& same_hash(hash_to_dir_blocks[dir_iter->hash()]);
+      for (std::vector<std::list<DirectoryBlock>::iterator>::iterator iter2 = same_hash.begin(); iter2 != same_hash.end(); ++iter2)
+	if ((*iter2)->exactly_equal(*dir_iter))
+	{
+	  found_duplicate = true;
+	  break;
+	}
+      if (found_duplicate)
+	dir_blocks.erase(dir_iter);
+      else
+	same_hash.push_back(dir_iter);
+    }
+    if (found_duplicate)
+      shared_inode.duplicates.push_back(iter->block);
+  }
+}
+
 void init_dir_inode_to_block_cache(void)
 {
-  if (dir_inode_to_block_cache)
+  if (dir_inode_to_block_cache_initialized)
     return;
 
   DoutEntering(dc::notice, "init_dir_inode_to_block_cache()");
+  StatsPhase stats_phase("stage1");
+  TraceSpan trace_span("init_dir_inode_to_block_cache");
 
   ASSERT(sizeof(size_t) == sizeof(uint32_t*));	// Used in blocknr_vector_type.
   ASSERT(sizeof(size_t) == sizeof(blocknr_vector_type));
 
-  dir_inode_to_block_cache = new blocknr_vector_type [inode_count_ + 1];
-  std::memset(dir_inode_to_block_cache, 0, sizeof(blocknr_vector_type) * (inode_count_ + 1));
+  dir_inode_to_block_cache_initialized = true;
   std::string device_name_basename = device_name.substr(device_name.find_last_of('/') + 1);
   std::string cache_stage1 = device_name_basename + ".ext3grep.stage1";
   struct stat sb;
@@ -109,36 +205,52 @@ void init_dir_inode_to_block_cache(void)
     std::cout << "Finding all blocks that might be directories.\n";
     std::cout << "D: block containing directory start, d: block containing more directory entries.\n";
     std::cout << "Each plus represents a directory start that references the same inode as a directory start that we found previously.\n";
-    static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+    // Every block is read once, so the blocks are read in chunks, bypassing the block cache.
+    int const chunk_blocks = std::max(1, scan_chunk_size / block_size_);
+    std::vector<unsigned char> chunk_buf(chunk_blocks * block_size_);
+    dir_block_store_create(cache_stage1 + ".blocks");
+    // The output is not flushed; the progress is reported by 'progress' instead.
+    Progress progress("Stage 1", block_count(super_block) - first_data_block(super_block), block_size_);
     for (int group = 0; group < groups_; ++group)
     {
-      std::cout << "\nSearching group " << group << ": " << std::flush;
+      TraceSpan trace_span("stage1 group", "group", group);
+      std::cout << "\nSearching group " << group << ": ";
       int first_block = first_data_block(super_block) + group * blocks_per_group(super_block);
       int last_block = std::min(first_block + blocks_per_group(super_block), block_count(super_block));
-      for (int block = first_block; block < last_block; ++block)
+      for (int chunk = first_block; chunk < last_block; chunk += chunk_blocks)
       {
+	int count = std::min(chunk_blocks, last_block - chunk);
+	get_blocks(chunk, count, &chunk_buf[0]);
+	for (int block = chunk; block < chunk + count; ++block)
+	{
+	  progress.update(block - first_data_block(super_block));
 #if !INCLUDE_JOURNAL
-	if (is_journal(block))
-	  continue;
+	  if (is_journal(block))
+	    continue;
 #endif
-	unsigned char* block_ptr = get_block(block, block_buf);
-	DirectoryBlockStats stats;
-	is_directory_type result = is_directory(block_ptr, block, stats, false);
-	if (result == isdir_start)
-	{
-	  ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(block_ptr);
-	  ASSERT(dir_entry->name_len == 1 && dir_entry->name[0] == '.');
-	  if (dir_inode_to_block_cache[dir_entry->inode].empty())
-	    std::cout << 'D' << std::flush;
-	  else
-	    std::cout << '+' << std::flush;
-	  dir_inode_to_block_cache[dir_entry->inode].push_back(block);
+	  unsigned char* block_ptr = &chunk_buf[(block - chunk) * block_size_];
+	  DirectoryBlockStats stats;
+	  is_directory_type result = is_directory(block_ptr, block, stats, false);
+	  if (result == isdir_start)
+	  {
+	    ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(block_ptr);
+	    ASSERT(dir_entry->name_len == 1 && dir_entry->name[0] == '.');
+	    blocknr_vector_type& bv(dir_inode_to_block_cache[dir_entry->inode]);
+	    if (bv.empty())
+	      std::cout << 'D';
+	    else
+	      std::cout << '+';
+	    bv.push_back(block);
+	    directory_block_hash_map[block] = xxhash64(block_ptr, block_size_);
+	    dir_block_store_add(block, block_ptr);
+	  }
+	  else if (result == isdir_extended)
+	  {
+	    std::cout << 'd';
+	    extended_blocks.push_back(block);
+	    dir_block_store_add(block, block_ptr);
+	  }
 	}
-	else if (result == isdir_extended)
-	{
-	  std::cout << 'd' << std::flush;
-	  extended_blocks.push_back(block);
-        }
       }
     }
     std::cout << '\n';
@@ -147,16 +259,18 @@ void init_dir_inode_to_block_cache(void)
     cache.open(cache_stage1.c_str());
     cache << "# Stage 1 data for " << device_name << ".\n";
     cache << "# Inodes and directory start blocks that use it for dir entry '.'.\n";
-    cache << "# INODE : BLOCK [BLOCK ...]\n";
-    for (uint32_t i = 1; i <= inode_count_; ++i)
+    cache << "# INODE : BLOCK/HASH [BLOCK/HASH ...]\n";
+    for (dir_inode_to_block_cache_type::iterator iter = dir_inode_to_block_cache.begin(); iter != dir_inode_to_block_cache.end(); ++iter)
     {
-      blocknr_vector_type const bv = dir_inode_to_block_cache[i];
-      if (bv.empty())
-	continue;
-      cache << i << " :";
+      blocknr_vector_type const bv = iter->second;
+      cache << iter->first << " :";
       uint32_t const size = bv.size();
       for (uint32_t j = 0; j < size; ++j)
-	cache << ' ' << bv[j];
+      {
+        directory_block_hash_map_type::iterator hash_iter = directory_block_hash_map.find(bv[j]);
+	ASSERT(hash_iter != directory_block_hash_map.end());
+	cache << ' ' << bv[j] << '/' << std::hex << hash_iter->second << std::dec;
+      }
       cache << '\n';
     }
     cache << "# Extended directory blocks.\n";
@@ -164,10 +278,13 @@ void init_dir_inode_to_block_cache(void)
       cache << *iter << '\n';
     cache << "# END\n";
     cache.close();
+    dir_block_store_close();
   }
   else
   {
     std::cout << "Loading " << cache_stage1 << "...\n";
+    if (!dir_block_store_open(cache_stage1 + ".blocks"))
+      std::cout << "Note: no (complete or up to date) " << cache_stage1 << ".blocks; directory blocks will be read from the device.\n";
     std::ifstream cache;
     cache.open(cache_stage1.c_str());
     if (!cache.is_open())
@@ -182,8 +299,7 @@ void init_dir_inode_to_block_cache(void)
     char c;
     for(;;)
     {
-      cache.get(c);
-      if (c == '#')
+      if (cache.get(c) && c == '#')	// Don't loop forever when the file ends on a comment.
         cache.ignore(std::numeric_limits<int>::max(), '\n');
       else
       {
@@ -191,17 +307,25 @@ void init_dir_inode_to_block_cache(void)
         break;
       }
     }
+    std::vector<uint32_t> blocknr;	// Reused for every line.
     while (cache >> inode)
     {
       cache >> c;
       if (cache.eof())
 	break;
       ASSERT(c == ':');
-      std::vector<uint32_t> blocknr;
+      blocknr.clear();
       while(cache >> block)
       {
 	blocknr.push_back(block);
 	c = cache.get();
+	if (c == '/')	// The content hash (not written by older versions).
+	{
+	  uint64_t hash;
+	  cache >> std::hex >> hash >> std::dec;
+	  directory_block_hash_map[block] = hash;
+	  c = cache.get();
+	}
 	if (c != ' ')
 	{
 	  ASSERT(c == '\n');
@@ -213,8 +337,7 @@ void init_dir_inode_to_block_cache(void)
     cache.clear();
     for(;;)
     {
-      cache.get(c);
-      if (c == '#')
+      if (cache.get(c) && c == '#')	// Don't loop forever when the file ends on a comment.
         cache.ignore(std::numeric_limits<int>::max(), '\n');
       else
       {
@@ -227,72 +350,73 @@ void init_dir_inode_to_block_cache(void)
     cache.close();
   }
   int inc = 0, sinc = 0, ainc = 0, asinc = 0, cinc = 0;
+  for (dir_inode_to_block_cache_type::iterator iter = dir_inode_to_block_cache.begin(); iter != dir_inode_to_block_cache.end(); ++iter)
+  {
+    ++inc;
+    if (iter->second.is_vector())
+    {
+      ++sinc;
+      if (is_allocated(iter->first))
+	++asinc;
+    }
+  }
+  // Only this loop needs to visit all inodes: it looks for allocated directory inodes.
+  init_inode_catalog();
+  std::vector<uint8_t> selected(inode_count_, 1);
+  catalog_select_flags(0, inode_count_, catalog_allocated, catalog_allocated, &selected[0]);
+  catalog_select_directories(0, inode_count_, &selected[0]);
   for (uint32_t i = 1; i <= inode_count_; ++i)
   {
-    bool allocated = is_allocated(i);
-    blocknr_vector_type const bv = dir_inode_to_block_cache[i];
-    if (allocated)
+    if (!selected[i - 1])
+      continue;
+    ++ainc;
+    uint32_t first_block = inode_catalog.first_block[i - 1];
+    // If the inode is an allocated directory, it must reference at least one block.
+    if (!first_block)
+    {
+      std::cout << std::flush;
+      std::cerr << progname << ": inode " << i << " is an allocated inode that does not reference any block. "
+	  "This seems to indicate a corrupted file system. Manual investigation is needed." << std::endl;
+    }
+    ASSERT(first_block);
+    // If inode is an allocated directory, then we must have found it's directory block already.
+    dir_inode_to_block_cache_type::iterator iter = dir_inode_to_block_cache.find(i);
+    if (iter == dir_inode_to_block_cache.end())
     {
-      InodePointer inode = get_inode(i);
-      if (is_directory(inode))
+      std::cout << std::flush;
+      std::cerr << "---- Mail this to the mailinglist -------------------------------\n";
+      std::cerr << "WARNING: inode " << i << " is an allocated inode without directory block pointing to it!" << std::endl;
+      std::cerr << "         inode_size_ = " << inode_size_ << '\n';
+      std::cerr << "         Inode " << i << ":";
+      print_inode_to(std::cerr, get_inode(i));
+      DirectoryBlockStats stats;
+      unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+      get_block(first_block, block_buf);
+      is_directory_type isdir = is_directory(block_buf, first_block, stats, false);
+      std::cerr << "         is_directory(" << first_block << ") returns " << isdir << '\n';
+      if (isdir == isdir_no)
       {
-	++ainc;
-	uint32_t first_block = inode->block()[0];
-	// If the inode is an allocated directory, it must reference at least one block.
-	if (!first_block)
-	{
-	  std::cout << std::flush;
-	  std::cerr << progname << ": inode " << i << " is an allocated inode that does not reference any block. "
-	      "This seems to indicate a corrupted file system. Manual investigation is needed." << std::endl;
-	}
-	ASSERT(first_block);
-	// If inode is an allocated directory, then we must have found it's directory block already.
-	if (bv.empty())
-	{
-	  std::cout << std::flush;
-	  std::cerr << "---- Mail this to the mailinglist -------------------------------\n";
-	  std::cerr << "WARNING: inode " << i << " is an allocated inode without directory block pointing to it!" << std::endl;
-	  std::cerr << "         inode_size_ = " << inode_size_ << '\n';
-	  std::cerr << "         Inode " << i << ":";
-	  print_inode_to(std::cerr, inode);
-	  DirectoryBlockStats stats;
-	  unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
-          get_block(first_block, block_buf);
-	  is_directory_type isdir = is_directory(block_buf, first_block, stats, false);
-	  std::cerr << "         is_directory(" << first_block << ") returns " << isdir << '\n';
-	  if (isdir == isdir_no)
-	  {
-	    std::cerr << "         Hex dump:\n";
-	    print_block_to(std::cerr, block_buf); 
-	  }
-	  std::cerr << "-----------------------------------------------------------------\n";
-	  continue;
-	}
-	int count = 0;
-	uint32_t size = bv.size();
-	for (uint32_t j = 0; j < size; ++j)
-	  if (bv[j] == first_block)
-	  {
-	    ++count;
-	    break;	// Remaining blocks have different value.
-	  }
-	// We must have found the actual directory.
-	ASSERT(count == 1);
-	// Replace the blocks we found with the canonical block.
-	dir_inode_to_block_cache[i].erase();
-	dir_inode_to_block_cache[i].push_back(first_block);
-	++cinc;
+	std::cerr << "         Hex dump:\n";
+	print_block_to(std::cerr, block_buf); 
       }
-    }
-    if (bv.empty())
+      std::cerr << "-----------------------------------------------------------------\n";
       continue;
-    ++inc;
-    if (bv.is_vector())
-    {
-      ++sinc;
-      if (allocated)
-	++asinc;
     }
+    blocknr_vector_type const bv = iter->second;
+    int count = 0;
+    uint32_t size = bv.size();
+    for (uint32_t j = 0; j < size; ++j)
+      if (bv[j] == first_block)
+      {
+	++count;
+	break;	// Remaining blocks have different value.
+      }
+    // We must have found the actual directory.
+    ASSERT(count == 1);
+    // Replace the blocks we found with the canonical block.
+    iter->second.erase();
+    iter->second.push_back(first_block);
+    ++cinc;
   }
   std::cout << "Result of stage one:\n";
   std::cout << "  " << inc << " inodes are referenced by one or more directory blocks, " <<
@@ -301,24 +425,26 @@ void init_dir_inode_to_block_cache(void)
       asinc << " of those inodes " << ((asinc == 1) ? "is" : "are") << " still allocated.\n";
   std::cout << "  " << extended_blocks.size() << " blocks contain an extended directory.\n";
   // Resolve shared inodes.
+  // Collect the inodes that are referenced by more than one block.
+  std::vector<SharedInode> shared_inodes;
+  for (dir_inode_to_block_cache_type::iterator inode_iter = dir_inode_to_block_cache.begin(); inode_iter != dir_inode_to_block_cache.end(); ++inode_iter)
+  {
+    blocknr_vector_type const bv = inode_iter->second;
+    if (bv.empty() || bv.size() == 1)
+      continue;
+    shared_inodes.push_back(SharedInode());
+    shared_inodes.back().inode_iter = inode_iter;
+    analyse_shared_inode(shared_inodes.back());
+  }
   int esinc = 0, jsinc = 0, hsinc = 0;
-  for (uint32_t i = 1; i <= inode_count_; ++i)
+  for (std::vector<SharedInode>::iterator shared_inode = shared_inodes.begin(); shared_inode != shared_inodes.end(); ++shared_inode)
   {
+    dir_inode_to_block_cache_type::iterator inode_iter = shared_inode->inode_iter;
+    uint32_t const i = inode_iter->first;
     // All blocks refering to this inode.
-    blocknr_vector_type const bv = dir_inode_to_block_cache[i];
-    // None?
-    if (bv.empty())
-      continue;
-    uint32_t size = bv.size();
-    // Only one? Then we're done.
-    if (size == 1)
-      continue;
-
-    // Make a list of these blocks as DirectoryBlock.
-    std::list<DirectoryBlock> dirs(size);
-    std::list<DirectoryBlock>::iterator iter = dirs.begin();
-    for (uint32_t j = 0; j < size; ++j, ++iter)
-      iter->read_block(bv[j], iter);
+    std::list<SharedCandidate> dirs(shared_inode->candidates.begin(), shared_inode->candidates.end());
+    uint32_t size = dirs.size();
+    std::list<SharedCandidate>::iterator iter;
 
     // Remove blocks that are part of the journal, except if all blocks
     // are part of the journal: then keep the block with the highest
@@ -332,17 +458,13 @@ void init_dir_inode_to_block_cache(void)
     while (iter != dirs.end())
     {
       ++total_block_count;
-      if (is_journal(iter->block()))
+      if (iter->in_journal)
       {
         ++journal_block_count;
-	block_in_journal_to_descriptors_map_type::iterator iter2 = block_in_journal_to_descriptors_map.find(iter->block());
-	if (iter2 != block_in_journal_to_descriptors_map.end())
-	{
-	  uint32_t sequence = iter2->second->sequence();
-	  highest_sequence = std::max(highest_sequence, sequence);
-	}
+	if (iter->has_descriptor)
+	  highest_sequence = std::max(highest_sequence, iter->descriptor_sequence);
 	else
-	  min_block = std::min(min_block, iter->block());
+	  min_block = std::min(min_block, iter->block);
       }
       else
         break;	// No need to continue.
@@ -354,14 +476,13 @@ void init_dir_inode_to_block_cache(void)
     while (iter != dirs.end())
     {
 #if !INCLUDE_JOURNAL
-      ASSERT(!is_journal(iter->block()));
+      ASSERT(!iter->in_journal);
 #else
-      if (is_journal(iter->block()))
+      if (iter->in_journal)
       {
         if (need_keep_one_journal)
 	{
-	  block_in_journal_to_descriptors_map_type::iterator iter2 = block_in_journal_to_descriptors_map.find(iter->block());
-	  if (highest_sequence == 0 && iter->block() == min_block)
+	  if (highest_sequence == 0 && iter->block == min_block)
 	  {
 	    std::cout << std::flush;
 	    std::cerr << "WARNING: More than one directory block references inode " << i <<
@@ -370,16 +491,16 @@ void init_dir_inode_to_block_cache(void)
 		" but we're disregarding it because ext3grep can't deal with journal blocks without a descriptor block.";
 	    std::cerr << std::endl;
 	  }
-	  if (iter2 != block_in_journal_to_descriptors_map.end() && iter2->second->sequence() == highest_sequence)
+	  if (iter->has_descriptor && iter->descriptor_sequence == highest_sequence)
 	  {
 	    ++iter;
 	    continue;
 	  }
 	}
 	if (size > 1)
-	  dir_inode_to_block_cache[i].remove(iter->block());
+	  inode_iter->second.remove(iter->block);
 	else
-	  dir_inode_to_block_cache[i].erase();
+	  inode_iter->second.erase();
 	--size;
 	iter = dirs.erase(iter);
       }
@@ -399,15 +520,12 @@ void init_dir_inode_to_block_cache(void)
     // Find blocks in the journal and select the one with the highest sequence number.
     int best_blocknr = -1;
     uint32_t max_sequence = 0;
-    iter = dirs.begin();
     for (iter = dirs.begin(); iter != dirs.end(); ++iter)
     {
-      int blocknr = iter->block();
-      uint32_t sequence_found = find_largest_journal_sequence_number(blocknr);
-      if (sequence_found > max_sequence)
+      if (iter->largest_sequence > max_sequence)
       {
-	max_sequence = sequence_found;
-	best_blocknr = blocknr;
+	max_sequence = iter->largest_sequence;
+	best_blocknr = iter->block;
       }
     }
     if (best_blocknr != -1)
@@ -415,9 +533,9 @@ void init_dir_inode_to_block_cache(void)
       iter = dirs.begin();
       while (iter != dirs.end())
       {
-	if (iter->block() != best_blocknr)
+	if (iter->block != best_blocknr)
 	{
-	  dir_inode_to_block_cache[i].remove(iter->block());
+	  inode_iter->second.remove(iter->block);
 	  iter = dirs.erase(iter);
 	}
 	else
@@ -431,33 +549,27 @@ void init_dir_inode_to_block_cache(void)
       continue;
     }
 
-    // Remove blocks that are exactly equal.
-    iter = dirs.begin();
-    while (iter != dirs.end())
-    {
-      bool found_duplicate = false;
-      for (std::list<DirectoryBlock>::iterator iter2 = dirs.begin(); iter2 != iter; ++iter2)
-	if (iter2->exactly_equal(*iter))
-	{
-	  found_duplicate = true;
-	  break;
-	}
-      if (found_duplicate)
-      {
-	dir_inode_to_block_cache[i].remove(iter->block());
-	iter = dirs.erase(iter);
-      }
-      else
-	++iter;
-    }
+    // The remaining blocks are compared below.
+    shared_inode->remaining.assign(dirs.begin(), dirs.end());
+  }	// Next inode.
+
+  // Remove blocks that are exactly equal. Reading and comparing the blocks is done in parallel,
+  // removing them from dir_inode_to_block_cache is done here.
+  if (load_all_inode_tables())
+    for_each_parallel(shared_inodes.size(), find_duplicate_blocks, &shared_inodes);
+  else
+    for (size_t index = 0; index < shared_inodes.size(); ++index)
+      find_duplicate_blocks(index, &shared_inodes);
+  for (std::vector<SharedInode>::iterator shared_inode = shared_inodes.begin(); shared_inode != shared_inodes.end(); ++shared_inode)
+  {
+    if (shared_inode->remaining.size() < 2)
+      continue;
+    for (std::vector<int>::iterator block = shared_inode->duplicates.begin(); block != shared_inode->duplicates.end(); ++block)
+      shared_inode->inode_iter->second.remove(*block);
     // Only one left? Then we're done with this inode.
-    if (dirs.size() == 1)
-    {
+    if (shared_inode->remaining.size() - shared_inode->duplicates.size() == 1)
       ++esinc;
-      continue;
-    }
-
-  }	// Next inode.
+  }
 
   std::cout << "Result of stage two:\n";
   if (cinc > 0)
@@ -473,15 +585,15 @@ void init_dir_inode_to_block_cache(void)
     std::cout << "  " << sinc - asinc - jsinc - esinc - hsinc << " remaining inodes to solve...\n";
     std::cout << "Blocks sharing the same inode:\n";
     std::cout << "# INODE : BLOCK [BLOCK ...]\n";
-    for (uint32_t i = 1; i <= inode_count_; ++i)
+    for (dir_inode_to_block_cache_type::iterator iter = dir_inode_to_block_cache.begin(); iter != dir_inode_to_block_cache.end(); ++iter)
     {
-      blocknr_vector_type const bv = dir_inode_to_block_cache[i];
+      blocknr_vector_type const bv = iter->second;
       if (bv.empty())
 	continue;
       uint32_t size = bv.size();
       if (size == 1)
 	continue;
-      std::cout << i << " :";
+      std::cout << iter->first << " :";
       for (uint32_t j = 0; j < size; ++j)
 	std::cout << ' ' << bv[j];
       std::cout << '\n';
@@ -497,11 +609,11 @@ void init_directories(void);
 int dir_inode_to_block(uint32_t inode)
 {
   ASSERT(inode > 0 && inode <= inode_count_);
-  if (!dir_inode_to_block_cache)
+  if (!dir_inode_to_block_cache_initialized)
     init_directories();
-  blocknr_vector_type const bv = dir_inode_to_block_cache[inode];
-  if (bv.empty())
+  dir_inode_to_block_cache_type::const_iterator iter = dir_inode_to_block_cache.find(inode);
+  if (iter == dir_inode_to_block_cache.end() || iter->second.empty())
     return -1;
   // In case of multiple values... return one.
-  return bv[0];
+  return iter->second[0];
 }
@@ -27,14 +27,29 @@
 #ifndef USE_PCH
 #include <string>
 #include <vector>
+#include <map>
+#include <stdint.h>
 #endif
 
 #include "blocknr_vector_type.h"
+#include "scratch_memory.h"
+
+// Only a small fraction of all inodes are directories, so the block numbers
+// of directory inodes are stored in a map keyed by inode number.
+typedef std::map<uint32_t, blocknr_vector_type, std::less<uint32_t>,
+    scratch_allocator<std::pair<uint32_t const, blocknr_vector_type> > > dir_inode_to_block_cache_type;
+
+// The xxhash64 of the content of each directory start block, computed during stage 1.
+// Blocks with the same hash are considered to be identical.
+typedef std::map<int, uint64_t, std::less<int>,
+    scratch_allocator<std::pair<int const, uint64_t> > > directory_block_hash_map_type;
 
 bool does_not_end_on_END(std::string const& cachename);
 void init_dir_inode_to_block_cache(void);
 int dir_inode_to_block(uint32_t inode);
-extern blocknr_vector_type* dir_inode_to_block_cache;
+extern dir_inode_to_block_cache_type dir_inode_to_block_cache;
+extern bool dir_inode_to_block_cache_initialized;
+extern directory_block_hash_map_type directory_block_hash_map;
 extern std::vector<int> extended_blocks;
 
 #endif // DIR_INIDE_TO_BLOCK_H
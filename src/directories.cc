@@ -23,6 +23,11 @@
 
 #ifndef USE_PCH
 #include "sys.h"
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <pthread.h>
 #include "ext3.h"
 #endif
 
@@ -33,6 +38,11 @@
 #include "indirect_blocks.h"
 #include "get_block.h"
 #include "directories.h"
+#include "dir_inode_to_block.h"
+#include "parallel.h"
+#include "diagnostics.h"
+#include "session.h"
+#include "xxhash.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -51,17 +61,95 @@ static int const mode_map[8] = {
    0xA000  // EXT3_FT_SYMLINK
 };
 
-struct iterate_data_st {
-  bool (*action)(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void*);
-  Parent* parent;
-  void* data;
-  unsigned char* block_buf;
+// The xxhash64, like the content hash of stage 1, of everything that exactly_equal compares.
+uint64_t DirectoryBlock::hash(void) const
+{
+  std::string data;
+  for (std::vector<DirEntry>::const_iterator iter = M_dir_entry.begin(); iter != M_dir_entry.end(); ++iter)
+  {
+    int32_t const values[3] = { iter->M_inode, iter->M_file_type, iter->index.next };
+    data.append(reinterpret_cast<char const*>(values), sizeof(values));
+    data += iter->M_name;
+    data += '\0';			// File names never contain a NUL.
+  }
+  return xxhash64(reinterpret_cast<unsigned char const*>(data.data()), data.length());
+}
+
+// The state of one directory that is being iterated over by iterate_over_directory.
+// Recursion into subdirectories is done with an explicit stack of these, rather than
+// with recursive function calls, so that deep directory trees do not exhaust the stack.
+struct DirectoryFrame {
+  Parent* parent;			// The parent passed to the action for the dir entries of this directory.
+  bool owns_parent;			// Set if parent must be deleted by this frame.
+  std::vector<int> blocks;		// The blocks of this directory that still have to be iterated over, in reverse order.
+  unsigned char const* block;		// The block that is currently being iterated over, or NULL.
+  int blocknr;
+  bool searching_deleted;		// Set when all linked dir entries of block were processed.
+  int offset;				// The offset of the next dir entry in block.
+  ext3_dir_entry_2 const* map[EXT3_MAX_BLOCK_SIZE / EXT3_DIR_PAD];	// Linked dir entries, by offset.
+  unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+
+  DirectoryFrame(Parent* parent_, bool owns_parent_) : parent(parent_), owns_parent(owns_parent_), block(NULL) { }
+  ~DirectoryFrame() { if (owns_parent) delete parent; }
+
+  void begin_block(unsigned char const* block_, int blocknr_);
+  ext3_dir_entry_2 const* next_dir_entry(bool& deleted);
+};
+
+void DirectoryFrame::begin_block(unsigned char const* block_, int blocknr_)
+{
+  block = block_;
+  blocknr = blocknr_;
+  searching_deleted = false;
+  offset = 0;
+  std::memset(map, 0, sizeof(map));
+}
+
+// Return the next dir entry of the current block, or NULL when there are no more.
+// First all linked dir entries are returned, and then those deleted dir entries
+// that can be found in between.
+ext3_dir_entry_2 const* DirectoryFrame::next_dir_entry(bool& deleted)
+{
+  if (!searching_deleted)
+  {
+    if (offset < block_size_)
+    {
+      ext3_dir_entry_2 const* dir_entry = reinterpret_cast<ext3_dir_entry_2 const*>(block + offset);
+      map[offset / EXT3_DIR_PAD] = dir_entry;
+      offset += dir_entry->rec_len;
+      deleted = false;
+      return dir_entry;
+    }
+    // Search for deleted entries.
+    searching_deleted = true;
+    offset = block_size_ - EXT3_DIR_REC_LEN(1);
+  }
+  while (offset > 0)
+  {
+    int current_offset = offset;
+    offset -= EXT3_DIR_PAD;
+    if (!map[current_offset / EXT3_DIR_PAD])
+    {
+      DirectoryBlockStats stats;
+      if (is_directory(const_cast<unsigned char*>(block), blocknr, stats, false, false, current_offset))
+      {
+        deleted = true;
+	return reinterpret_cast<ext3_dir_entry_2 const*>(block + current_offset);
+      }
+    }
+  }
+  block = NULL;
+  return NULL;
+}
 
-  iterate_data_st(void) : block_buf(NULL) { }
-  ~iterate_data_st() { if (block_buf) delete [] block_buf; }
+// What filter_dir_entry found out about a directory that should be recursed into.
+struct recursion_st {
+  InodePointer inode;
+  bool deleted;
+  bool allocated;
+  bool reallocated;
 };
 
-int depth;
 bool read_block_action(ext3_dir_entry_2 const& dir_entry, Inode const& inode,
     bool deleted, bool allocated, bool reallocated, bool zero_inode, bool linked, bool filtered, Parent* parent, void* data);
 #ifdef CPPGRAPH
@@ -69,10 +157,27 @@ void iterate_over_directory__with__read_block_action(void) { (void)read_block_ac
 #endif
 bool init_directories_action(ext3_dir_entry_2 const& dir_entry, Inode const&, bool, bool, bool, bool, bool, bool, Parent* parent, void*);
 
-static void filter_dir_entry(ext3_dir_entry_2 const& dir_entry,
+// Return true if a dir entry that refers to 'inode' is filtered out by the command line options.
+static bool is_filtered(InodePointer const& inode, bool deleted, bool allocated, bool reallocated)
+{
+  return !(
+      (!commandline_allocated || allocated) &&
+      (!commandline_unallocated || !allocated) &&
+      (!commandline_deleted || deleted) &&
+      (!commandline_directory || is_directory(inode)) &&
+      (!reallocated || commandline_reallocated) &&
+      (reallocated ||
+	  (!inode->is_deleted() && !commandline_deleted) ||
+	  (inode->has_valid_dtime() && commandline_after <= (time_t)inode->dtime() && (!commandline_before || (time_t)inode->dtime() < commandline_before))));
+}
+
+// Call action for dir_entry, if it isn't filtered.
+// Returns true if the caller should recurse into the directory that dir_entry refers to,
+// which is never the case when parent is NULL or when depth reached commandline_depth.
+static bool filter_dir_entry(ext3_dir_entry_2 const& dir_entry,
                              bool deleted, bool linked,
 			     bool (*action)(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void*),
-			     Parent* parent, void* data)
+			     Parent* parent, void* data, int depth, recursion_st& recursion)
 {
   InodePointer inode;
   int file_type = (dir_entry.file_type & 7);
@@ -90,23 +195,20 @@ static void filter_dir_entry(ext3_dir_entry_2 const& dir_entry,
     // however - in the case of symlinks, the name of the symlink is (still) in this place.
     // Only printing this for regular files and directories, as also char/block devices seem to
     // sometimes have a non-zero block list, and we don't "recover" those anyway.
-    if (inode->has_valid_dtime() && inode->block()[0] != 0 && (is_regular_file(inode) || is_directory(inode)))
+    if (inode->has_valid_dtime() && inode->block()[0] != 0 && (is_regular_file(inode) || is_directory(inode)) &&
+        diag_report(diag_nonzero_dtime, dir_entry.inode))
     {
       time_t dtime = inode->dtime();
-      std::string dtime_str(std::ctime(&dtime));
-      std::cout << "Note: Inode " << dir_entry.inode << " has non-zero dtime (" << inode->dtime() <<
+      char dtime_buf[32];
+      std::string dtime_str(ctime_r(&dtime, dtime_buf));
+      // Written at once, because this can be called from several threads.
+      std::ostringstream note;
+      note << "Note: Inode " << dir_entry.inode << " has non-zero dtime (" << inode->dtime() <<
 	  "  " << dtime_str.substr(0, dtime_str.length() - 1) << ") but non-zero block list (" << inode->block()[0] <<
 	  ") [ext3grep does" << (inode->is_deleted() ? "" : " not") << " consider this inode to be deleted]\n";
+      std::cout << note.str();
     }
-    filtered = !(
-	(!commandline_allocated || allocated) &&
-	(!commandline_unallocated || !allocated) &&
-	(!commandline_deleted || deleted) &&
-	(!commandline_directory || is_directory(inode)) &&
-	(!reallocated || commandline_reallocated) &&
-	(reallocated ||
-	    (!inode->is_deleted() && !commandline_deleted) ||
-	    (inode->has_valid_dtime() && commandline_after <= (time_t)inode->dtime() && (!commandline_before || (time_t)inode->dtime() < commandline_before))));
+    filtered = is_filtered(inode, deleted, allocated, reallocated);
   }
   if (no_filtering)	// Also no recursion.
     // inode is dereferenced here in good faith that no reference to it is kept (since there are no structs or classes that do so).
@@ -115,135 +217,179 @@ static void filter_dir_entry(ext3_dir_entry_2 const& dir_entry,
   {
     // inode is dereferenced here in good faith that no reference to it is kept (since there are no structs or classes that do so).
     if (action(dir_entry, *inode, deleted, allocated, reallocated, zero_inode, linked, filtered, parent, data))
-      return;	// Recursion aborted.
+      return false;	// Recursion aborted.
     // Handle recursion.
     if (parent && is_directory(inode) && depth < commandline_depth)
     {
       // Skip "." and ".." when iterating recursively.
       if ((dir_entry.name_len == 1 && dir_entry.name[0] == '.') ||
 	  (dir_entry.name_len == 2 && dir_entry.name[0] == '.' && dir_entry.name[1] == '.'))
-        return;
-      iterate_data_st idata;
-      idata.action = action;
-      idata.data = data;
-      Parent new_parent(parent, &dir_entry, inode, dir_entry.inode);
-      idata.parent = &new_parent;
-      // Break possible loops as soon as we see an inode number that we encountered before.
-      static std::vector<uint32_t> inodes(64);
-      if (inodes.size() < (size_t)depth + 1)
-        inodes.resize(inodes.size() * 2);
-      for (int d = 1; d < depth; ++d)
-      {
-        if (inodes[d] == dir_entry.inode)
-	{
-	  std::cout << "Detected loop for inode " << dir_entry.inode << " (" << idata.parent->dirname(commandline_show_path_inodes) << ").\n";
-	  return;
-	}
-      }
-      inodes[depth] = dir_entry.inode;
-      ++depth;
-      if (!deleted && allocated && !reallocated)	// Existing directory?
-      {
-        InodePointer inoderef(get_inode(dir_entry.inode));
-	bool reused_or_corrupted_indirect_block3 = iterate_over_all_blocks_of(inoderef, dir_entry.inode, iterate_over_existing_directory_action, &idata);
-	ASSERT(!reused_or_corrupted_indirect_block3);
-      }
-      else
-      {
-        // We only know the first block, but that is enough to construct the directory tree.
-	int blocknr = dir_inode_to_block(dir_entry.inode);
-	if (blocknr != -1)
-	{
-	  // There could be loops if we linked the wrong directory to an inode.
-	  // In any case we have to break those loops. Try to be smart about it:
-
-	  // Find the dtime of the parent, or a parent of the parent.
-	  uint32_t dtime = 0;
-	  Parent* parent_iter = parent;
-          while (!dtime)
-	  {
-	    if (!parent_iter)
-	      break;
-	    if (parent_iter->M_inode->has_valid_dtime())
-	      dtime = parent_iter->M_inode->dtime();
-	    parent_iter = parent_iter->M_parent;
-	  }
-	  // It turns out that a parent can be time-stamped as deleted before
-	  // it's subdirectories when using rm -rf (?). Allow for 60 seconds
-	  // of time difference.
-	  if (!dtime || !inode->has_valid_dtime() || dtime + 60 >= inode->dtime())
-	  {
-	    // Now, before actually processing this new directory, check if the inode it contains for ".." is equal to the inode
-	    // of it's parent directory!
-	    idata.block_buf = new unsigned char [block_size_];
-	    get_block(blocknr, idata.block_buf);
-	    ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(idata.block_buf);
-	    ASSERT(dir_entry->name_len == 1 && dir_entry->name[0] == '.');
-	    dir_entry = reinterpret_cast<ext3_dir_entry_2*>(idata.block_buf + dir_entry->rec_len);
-	    ASSERT(dir_entry->name_len == 2 && dir_entry->name[0] == '.' && dir_entry->name[1] == '.');
-	    if (dir_entry->inode == parent->M_inodenr)
-	      iterate_over_directory_action(blocknr, &idata);
-	    else
-	      std::cout << "The directory \"" << idata.parent->dirname(commandline_show_path_inodes) << "\" is lost.\n";
-	  }
-	}
-	else
-	  std::cout << "Cannot find a directory block for inode " << dir_entry.inode << ".\n";
-      }
-      --depth;
+        return false;
+      recursion.inode = inode;
+      recursion.deleted = deleted;
+      recursion.allocated = allocated;
+      recursion.reallocated = reallocated;
+      return true;
     }
   }
+  return false;
 }
 
 #ifdef CPPGRAPH
 void iterate_over_directory__with__init_directories_action(void) { (void)init_directories_action(*(ext3_dir_entry_2 const*)NULL, *(Inode const*)NULL, 0, 0, 0, 0, 0, 0, NULL, NULL); }
 #endif
 
-void iterate_over_directory_action(int blocknr, void* data)
+static void collect_directory_blocks_action(int blocknr, int, void* data)
 {
-  iterate_data_st* idata = reinterpret_cast<iterate_data_st*>(data);
-  iterate_over_directory(idata->block_buf, blocknr, idata->action, idata->parent, idata->data);
+  std::vector<int>* blocks = reinterpret_cast<std::vector<int>*>(data);
+  blocks->push_back(blocknr);
 }
 
-void iterate_over_existing_directory_action(int blocknr, int, void* data)
+// Return a new frame for the directory that dir_entry, in the directory of the last frame
+// on the stack, refers to; or NULL if that directory cannot or should not be iterated over.
+static DirectoryFrame* recurse_into(ext3_dir_entry_2 const& dir_entry, recursion_st const& recursion, std::vector<DirectoryFrame*> const& stack)
 {
-  iterate_data_st* idata = reinterpret_cast<iterate_data_st*>(data);
-  unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
-  get_block(blocknr, block_buf);
-  iterate_over_directory(block_buf, blocknr, idata->action, idata->parent, idata->data);
+  Parent* parent = stack.back()->parent;
+  DirectoryFrame* frame = new DirectoryFrame(new Parent(parent, &dir_entry, recursion.inode, dir_entry.inode), true);
+  // Break possible loops as soon as we see an inode number that we encountered before.
+  // stack[0] is the directory that iterate_over_directory was called for, and stack[1]
+  // the first directory that was recursed into; neither is taken into account.
+  for (size_t d = 2; d < stack.size(); ++d)
+  {
+    if (stack[d]->parent->M_inodenr == dir_entry.inode)
+    {
+      std::cout << "Detected loop for inode " << dir_entry.inode << " (" << frame->parent->dirname(commandline_show_path_inodes) << ").\n";
+      delete frame;
+      return NULL;
+    }
+  }
+  if (!recursion.deleted && recursion.allocated && !recursion.reallocated)	// Existing directory?
+  {
+    InodePointer inoderef(get_inode(dir_entry.inode));
+    bool reused_or_corrupted_indirect_block3 = iterate_over_all_blocks_of(inoderef, dir_entry.inode, collect_directory_blocks_action, &frame->blocks);
+    ASSERT(!reused_or_corrupted_indirect_block3);
+    std::reverse(frame->blocks.begin(), frame->blocks.end());
+    return frame;
+  }
+  // We only know the first block, but that is enough to construct the directory tree.
+  int blocknr = dir_inode_to_block(dir_entry.inode);
+  if (blocknr != -1)
+  {
+    // There could be loops if we linked the wrong directory to an inode.
+    // In any case we have to break those loops. Try to be smart about it:
+
+    // Find the dtime of the parent, or a parent of the parent.
+    uint32_t dtime = 0;
+    Parent* parent_iter = parent;
+    while (!dtime)
+    {
+      if (!parent_iter)
+	break;
+      if (parent_iter->M_inode->has_valid_dtime())
+	dtime = parent_iter->M_inode->dtime();
+      parent_iter = parent_iter->M_parent;
+    }
+    // It turns out that a parent can be time-stamped as deleted before
+    // it's subdirectories when using rm -rf (?). Allow for 60 seconds
+    // of time difference.
+    if (!dtime || !recursion.inode->has_valid_dtime() || dtime + 60 >= recursion.inode->dtime())
+    {
+      // Now, before actually processing this new directory, check if the inode it contains for ".." is equal to the inode
+      // of it's parent directory!
+      get_block(blocknr, frame->block_buf);
+      ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(frame->block_buf);
+      ASSERT(dir_entry->name_len == 1 && dir_entry->name[0] == '.');
+      dir_entry = reinterpret_cast<ext3_dir_entry_2*>(frame->block_buf + dir_entry->rec_len);
+      ASSERT(dir_entry->name_len == 2 && dir_entry->name[0] == '.' && dir_entry->name[1] == '.');
+      if (dir_entry->inode == parent->M_inodenr)
+      {
+        frame->begin_block(frame->block_buf, blocknr);
+	return frame;
+      }
+      std::cout << "The directory \"" << frame->parent->dirname(commandline_show_path_inodes) << "\" is lost.\n";
+    }
+  }
+  else
+    std::cout << "Cannot find a directory block for inode " << dir_entry.inode << ".\n";
+  delete frame;
+  return NULL;
 }
 
-void iterate_over_directory(unsigned char* block, int blocknr,
-    bool (*action)(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void*), Parent* parent, void* data)
+// Queue the first blocks of the subdirectories in the current block of frame for prefetching.
+static void prefetch_subdirectories(BlockPrefetcher& prefetcher, DirectoryFrame const& frame)
 {
-  ext3_dir_entry_2 const* dir_entry;
-  ext3_dir_entry_2 const* map[EXT3_MAX_BLOCK_SIZE / EXT3_DIR_PAD];
-  std::memset(map, 0, sizeof(map));
+  std::vector<int> blocks;
+  for (int offset = 0; offset < block_size_;)
+  {
+    ext3_dir_entry_2 const* dir_entry = reinterpret_cast<ext3_dir_entry_2 const*>(frame.block + offset);
+    if (dir_entry->rec_len == 0)
+      break;
+    offset += dir_entry->rec_len;
+    if (dir_entry->inode == 0 || dir_entry->inode > inode_count_ ||
+        (dir_entry->name_len == 1 && dir_entry->name[0] == '.') ||
+	(dir_entry->name_len == 2 && dir_entry->name[0] == '.' && dir_entry->name[1] == '.') ||
+        (feature_incompat_filetype && (dir_entry->file_type & 7) != EXT3_FT_DIR))
+      continue;
+    int blocknr = dir_inode_to_block(dir_entry->inode);
+    if (blocknr != -1)
+      blocks.push_back(blocknr);
+  }
+  // The prefetcher reads the last queued block first.
+  for (std::vector<int>::reverse_iterator iter = blocks.rbegin(); iter != blocks.rend(); ++iter)
+    prefetcher.prefetch(*iter);
+}
 
+// If prefetcher is not NULL, the first blocks of subdirectories are read ahead with it.
+// It is created by the caller, so that its threads are reused for all directories of a stage.
+void iterate_over_directory(unsigned char* block, int blocknr,
+    bool (*action)(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void*), Parent* parent, void* data,
+    BlockPrefetcher* prefetcher)
+{
   if (action == read_block_action)
     ++no_filtering;
 
-  int offset = 0;
-  while (offset < block_size_)
-  {
-    dir_entry = reinterpret_cast<ext3_dir_entry_2 const*>(block + offset);
-    filter_dir_entry(*dir_entry, false, true, action, parent, data);
-    map[offset / EXT3_DIR_PAD] = dir_entry;
-    offset += dir_entry->rec_len;
-  }
+  // Only when recursing is it worth to read the blocks of subdirectories ahead.
+  if (!parent || no_filtering || !dir_inode_to_block_cache_initialized || (prefetcher && !prefetcher->active()))
+    prefetcher = NULL;
 
-  // Search for deleted entries.
-  offset = block_size_ - EXT3_DIR_REC_LEN(1);
-  while (offset > 0)
+  std::vector<DirectoryFrame*> stack;
+  stack.push_back(new DirectoryFrame(parent, false));
+  stack.back()->begin_block(block, blocknr);
+  if (prefetcher)
+    prefetch_subdirectories(*prefetcher, *stack.back());
+  while (!stack.empty())
   {
-    dir_entry = reinterpret_cast<ext3_dir_entry_2 const*>(block + offset);
-    if (!map[offset / EXT3_DIR_PAD])
+    DirectoryFrame* frame = stack.back();
+    bool deleted;
+    ext3_dir_entry_2 const* dir_entry = frame->block ? frame->next_dir_entry(deleted) : NULL;
+    if (!dir_entry)
     {
-      DirectoryBlockStats stats;
-      if (is_directory(block, blocknr, stats, false, false, offset))
-        filter_dir_entry(*dir_entry, true, false, action, parent, data);
+      if (frame->blocks.empty())
+      {
+        delete frame;
+	stack.pop_back();
+      }
+      else
+      {
+	get_block(frame->blocks.back(), frame->block_buf);
+	frame->begin_block(frame->block_buf, frame->blocks.back());
+	frame->blocks.pop_back();
+	if (prefetcher)
+	  prefetch_subdirectories(*prefetcher, *frame);
+      }
+      continue;
+    }
+    recursion_st recursion;
+    if (filter_dir_entry(*dir_entry, deleted, !deleted, action, frame->parent, data, stack.size() - 1, recursion))
+    {
+      DirectoryFrame* subdirectory = recurse_into(*dir_entry, recursion, stack);
+      if (subdirectory)
+      {
+        stack.push_back(subdirectory);
+	if (prefetcher && subdirectory->block)
+	  prefetch_subdirectories(*prefetcher, *subdirectory);
+      }
     }
-    offset -= EXT3_DIR_PAD;
   }
 
   if (action == read_block_action)
@@ -268,6 +414,17 @@ bool DirectoryBlock::exactly_equal(DirectoryBlock const& dir) const
   return true;
 }
 
+void DirectoryBlock::refilter(void)
+{
+  for (std::vector<DirEntry>::iterator iter = M_dir_entry.begin(); iter != M_dir_entry.end(); ++iter)
+  {
+    if (iter->zero_inode)
+      iter->filtered = !commandline_zeroed_inodes;
+    else
+      iter->filtered = is_filtered(get_inode(iter->M_inode), iter->deleted, iter->allocated, iter->reallocated);
+  }
+}
+
 bool read_block_action(ext3_dir_entry_2 const& dir_entry, Inode const& inode,
     bool deleted, bool allocated, bool reallocated, bool zero_inode, bool linked, bool filtered, Parent*, void* data)
 {
@@ -301,14 +458,44 @@ struct DirEntrySortPred {
   bool operator()(DirEntry const& de1, DirEntry const& de2) const { return de1.dir_entry < de2.dir_entry; }
 };
 
+// Parsed directory blocks, so that a block that is read more than once is only parsed once.
+// The contents of a parsed block only depend on the command line options and the (constant)
+// inodes, so they stay valid. Only the last max_parsed_directory_blocks blocks are kept.
+// Both containers are only accessed under parsed_directory_blocks_mutex.
+typedef std::map<int, std::vector<DirEntry> > parsed_directory_blocks_type;
+static parsed_directory_blocks_type parsed_directory_blocks;
+static std::deque<int> parsed_directory_blocks_fifo;
+static size_t const max_parsed_directory_blocks = 65536;
+static pthread_mutex_t parsed_directory_blocks_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+void forget_parsed_directory_blocks(void)
+{
+  pthread_mutex_lock(&parsed_directory_blocks_mutex);
+  parsed_directory_blocks.clear();
+  parsed_directory_blocks_fifo.clear();
+  pthread_mutex_unlock(&parsed_directory_blocks_mutex);
+}
+
 void DirectoryBlock::read_block(int block, std::list<DirectoryBlock>::iterator list_iter)
 {
   M_block = block;
-  static bool using_static_buffer = false;
-  ASSERT(!using_static_buffer);
-  static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  pthread_mutex_lock(&parsed_directory_blocks_mutex);
+  parsed_directory_blocks_type::iterator parsed = parsed_directory_blocks.find(block);
+  bool found = parsed != parsed_directory_blocks.end();
+  if (found)
+    M_dir_entry = parsed->second;
+  pthread_mutex_unlock(&parsed_directory_blocks_mutex);
+  if (found)
+  {
+    for (std::vector<DirEntry>::iterator iter = M_dir_entry.begin(); iter != M_dir_entry.end(); ++iter)
+      iter->M_directory_iterator = list_iter;
+    return;
+  }
+  static __thread bool using_block_buf = false;
+  ASSERT(!using_block_buf);
+  unsigned char* block_buf = scratch_block(scratch_directory_block);
   get_block(block, block_buf);
-  using_static_buffer = true;
+  using_block_buf = true;
 #ifdef CPPGRAPH
   // Let cppgraph know that we call read_block_action from here.
   iterate_over_directory__with__read_block_action();
@@ -345,5 +532,18 @@ void DirectoryBlock::read_block(int block, std::list<DirectoryBlock>::iterator l
     iter->index.next = next;
   }
   delete [] index_to_dir_entry;
-  using_static_buffer = false;
+  using_block_buf = false;
+  pthread_mutex_lock(&parsed_directory_blocks_mutex);
+  // Another thread might have parsed the same block in the meantime.
+  if (parsed_directory_blocks.find(block) == parsed_directory_blocks.end())
+  {
+    if (parsed_directory_blocks_fifo.size() == max_parsed_directory_blocks)
+    {
+      parsed_directory_blocks.erase(parsed_directory_blocks_fifo.front());
+      parsed_directory_blocks_fifo.pop_front();
+    }
+    parsed_directory_blocks.insert(parsed_directory_blocks_type::value_type(block, M_dir_entry));
+    parsed_directory_blocks_fifo.push_back(block);
+  }
+  pthread_mutex_unlock(&parsed_directory_blocks_mutex);
 }
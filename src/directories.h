@@ -70,7 +70,10 @@ class DirectoryBlock {
     void read_dir_entry(ext3_dir_entry_2 const& dir_entry, Inode const& inode,
         bool deleted, bool allocated, bool reallocated, bool zero_inode, bool linked, bool filtered, std::list<DirectoryBlock>::iterator iter);
 
+    void refilter(void);		// Recalculate DirEntry::filtered after the command line options changed.
+
     bool exactly_equal(DirectoryBlock const& dir) const;
+    uint64_t hash(void) const;		// Equal for blocks that are exactly_equal.
     int block(void) const { return M_block; }
     void print(void) const;
 
@@ -106,6 +109,8 @@ class Directory {
 #endif
 };
 
-extern int depth;	// Used in print_directory
+// DirectoryBlock::read_block caches parsed blocks. Call this when the
+// command line options that influence parsing are changed.
+void forget_parsed_directory_blocks(void);
 
 #endif // DIRECTORIES_H
@@ -30,6 +30,7 @@
 #include "init_directories.h"
 #include "init_files.h"
 #include "commandline.h"
+#include "output.h"
 
 void dump_names(void)
 {
@@ -47,6 +48,15 @@ void dump_names(void)
     {
       if (commandline_restore_all)
 	restore_file(*iter);
+      else if (output_format != output_text)
+      {
+	// Paths of directories are in all_directories, all other paths in path_to_inode_map.
+	path_to_inode_map_type::iterator file_iter = path_to_inode_map.find(*iter);
+	if (file_iter != path_to_inode_map.end())
+	  output_record(OutputRecord("name").path(*iter).inode(file_iter->second));
+	else
+	  output_record(OutputRecord("name").path(*iter).inode(all_directories.find(*iter)->second.inode_number()));
+      }
       else
 	std::cout << *iter << '\n';
     }
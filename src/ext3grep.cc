@@ -63,19 +63,292 @@
 #include "indirect_blocks.h"
 #include "restore.h"
 #include "get_block.h"
+#include "block_cache.h"
+#include "inode_catalog.h"
+#include "timestamp_index.h"
+#include "directories.h"
 #include "init_consts.h"
 #include "print_inode_to.h"
+#include "utils.h"
+#include "block_corpus.h"
+#include "microbench.h"
+#include "stats.h"
+#include "trace.h"
+#include "progress.h"
+#include "diagnostics.h"
+#include "server.h"
+#include "batch.h"
+#include "session.h"
+#include "output.h"
 
 //-----------------------------------------------------------------------------
 //
 // main
 //
 
-#ifdef USE_SVN
-extern char const* svn_revision;
+extern void custom(void);
+
+// Show info on inode commandline_inode (--inode).
+void handle_commandline_inode(void)
+{
+  InodePointer inode(get_inode(commandline_inode));
+  if (commandline_print)
+  {
+    std::cout << "\nHex dump of inode " << commandline_inode << ":\n";
+    dump_hex_to(std::cout, (unsigned char const*)&(*inode), inode_size_);
+    std::cout << '\n';
+  }
+  unsigned int bit = commandline_inode - 1 - commandline_group * inodes_per_group_;
+  ASSERT(bit < 8U * block_size_);
+  bitmap_ptr bmp = get_bitmap_mask(bit);
+  bool allocated = (inode_bitmap[commandline_group][bmp.index] & bmp.mask);
+  if (allocated)
+    std::cout << "Inode is Allocated\n";
+  else
+    std::cout << "Inode is Unallocated\n";
+  if (commandline_print)
+  {
+    std::cout << "Group: " << commandline_group << '\n';
+    print_inode_to(std::cout, *inode);
+  }
+  if (is_directory(inode))
+    print_directory_inode(commandline_inode);
+}
+
+// Show info on block commandline_block, or journal block commandline_journal_block (--block, --journal-block).
+void handle_commandline_block(void)
+{
+  if (commandline_journal && commandline_block != -1)
+  {
+    print_block_descriptors(commandline_block);
+  }
+  else
+  {
+    if (commandline_journal_block != -1 && commandline_journal)
+    {
+      // Translate block number.
+      commandline_block = journal_block_to_real_block(commandline_journal_block);
+      commandline_group = block_to_group(super_block, commandline_block);
+    }
+    unsigned char* block = new unsigned char[block_size_];    
+    if (EXTERNAL_BLOCK && commandline_block == 0)
+    {
+      assert(block_size_ == sizeof(someones_block));
+      std::memcpy(block, someones_block, block_size_);
+      DirectoryBlockStats stats;
+      int blocknr = commandline_block;
+      commandline_block = -1;
+      inode_count_ = someones_inode_count;
+      is_directory_type isdir = is_directory(block, blocknr, stats, false);
+      std::cout << "is_directory returned " << isdir << " for someones_block." << std::endl;
+      exit(EXIT_SUCCESS);
+    }
+    else
+    {
+      device.seekg(block_to_offset(commandline_block));
+      ASSERT(device.good());
+      device.read(reinterpret_cast<char*>(block), block_size_);
+      ASSERT(device.good());
+    }
+    if (commandline_print)
+    {
+      std::cout << "Hex dump of block " << commandline_block << ":\n";
+      print_block_to(std::cout, block);
+      std::cout << '\n';
+    }
+    std::cout << "Group: " << commandline_group << '\n';
+    unsigned int bit = commandline_block - first_data_block(super_block) - commandline_group * blocks_per_group(super_block);
+    ASSERT(bit < 8U * block_size_);
+    bitmap_ptr bmp = get_bitmap_mask(bit);
+    DirectoryBlockStats stats;
+    is_directory_type isdir = is_directory(block, commandline_block, stats, false);
+    if (block_bitmap[commandline_group] == NULL)
+      load_meta_data(commandline_group);
+    bool allocated = (block_bitmap[commandline_group][bmp.index] & bmp.mask);
+    bool journal = is_journal(commandline_block);
+    if (isdir == isdir_no)
+    {
+      if (allocated)
+      {
+	std::cout << "Block " << commandline_block;
+	if (journal)
+	{
+	  std::cout << " belongs to the journal.";
+	  int real_block;
+	  journal_header_t* header = reinterpret_cast<journal_header_t*>(block);
+	  if (be2le(header->h_magic) == JFS_MAGIC_NUMBER)
+	  {
+	    std::cout << "\n\n";
+	    switch (be2le(header->h_blocktype))
+	    {
+	      case JFS_DESCRIPTOR_BLOCK:
+	      {
+		std::cout << *header << '\n';
+		journal_block_tag_t* journal_block_tag = reinterpret_cast<journal_block_tag_t*>(block + sizeof(journal_header_t));
+		int curblock = commandline_block;
+		for (;;)
+		{
+		  uint32_t flags = be2le(journal_block_tag->t_flags);
+		  ++curblock;
+		  while(is_indirect_block_in_journal(curblock))
+		    ++curblock;
+		  int refered_block = be2le(journal_block_tag->t_blocknr);
+		  std::cout << "  " << curblock << ((flags & JFS_FLAG_ESCAPE) ? "(escaped)" : "") << " = " <<
+		      refered_block << ((flags & JFS_FLAG_DELETED) ? "(deleted)" : "") << '\n';
+		  if ((flags & JFS_FLAG_LAST_TAG))
+		    break;
+		  if (!(flags & JFS_FLAG_SAME_UUID))
+		    journal_block_tag = reinterpret_cast<journal_block_tag_t*>((unsigned char*)journal_block_tag + 16);
+		  ++journal_block_tag;
+		}
+		break;
+	      }
+	      case JFS_COMMIT_BLOCK:
+	      {
+		std::cout << *header << '\n';
+		break;
+	      }
+	      case JFS_SUPERBLOCK_V1:
+	      case JFS_SUPERBLOCK_V2:
+	      {
+		std::cout << *reinterpret_cast<journal_superblock_t*>(block) << '\n';
+		break;
+	      }
+	      case JFS_REVOKE_BLOCK:
+	      {
+		std::cout << *reinterpret_cast<journal_revoke_header_t*>(block) << '\n';
+		break;
+	      }
+	    }
+	  }
+	  else if ((real_block = is_inode_block(commandline_block)))
+	  {
+	    std::cout << " It contains inode table block " << real_block << ".\n";
+	    if (commandline_print)
+	    {
+	      int inodenr = block_to_inode(real_block);
+	      for (Inode const* inode = reinterpret_cast<Inode const*>(block); reinterpret_cast<unsigned char const*>(inode) < block + block_size_;
+		  inode = reinterpret_cast<Inode const*>(reinterpret_cast<unsigned char const*>(inode) + inode_size_), ++inodenr)
+	      {
+		std::cout << "\n--------------Inode " << inodenr << "-----------------------\n";
+		print_inode_to(std::cout, *inode);
+	      }
+	    }
+	  }
+	  else
+	    std::cout << '\n';
+	}
+	else
+	{
+	  std::cout << " is Allocated.";
+	  if (is_inode(commandline_block))
+	  {
+	    int inode = block_to_inode(commandline_block);
+	    std::cout << " It's inside the inode table of group " << commandline_group <<
+		" (inodes [" << inode << " - " << (inode + block_size_ / inode_size_) << ">).";
+	  }
+	  std::cout << '\n';
+	}
+      }
+      else
+      {
+	std::cout << "Block " << commandline_block << " is Unallocated.\n";
+	// If this assertion fails, then it is possible that this DATA block looks like an inode,
+	// most likely because the data itself is an ext3 filesystem. For example an ext3 image.
+	// If that is possible, then just comment this assertion out.
+	//ASSERT(!is_inode(commandline_block));	// All inode blocks are allocated.
+	ASSERT(!journal);			// All journal blocks are allocated.
+      }
+      if (is_indirect_block(block))
+      {
+	std::cout << "Block " << commandline_block << " appears to be an (double/tripple) indirect block.\n";
+	if (commandline_print)
+	{
+	  std::cout << "It contains the following block numbers:\n";
+	  __le32* block_numbers = reinterpret_cast<__le32*>(block);
+	  for (int i = 0; i < block_size_ >> 2; ++i)
+	  {
+	    std::cout << ' ' << std::setw(9) << std::setfill(' ') << block_numbers[i];
+	    if ((i + 1) % 10 == 0)
+	      std::cout << '\n';
+	  }
+	  std::cout << '\n';
+	}
+      }
+    }
+    else
+    {
+      std::cout << "\nBlock " << commandline_block << " is a directory. The block is " <<
+	  (allocated ? journal ? "a Journal block" : "Allocated" : "Unallocated") << "\n\n";
+      if (commandline_ls)
+	print_restrictions();
+      if (isdir == isdir_start)
+      {
+	ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(block);
+	InodePointer inode = get_inode(dir_entry->inode);
+	if (!is_directory(inode) || (inode->block()[0] && inode->block()[0] != (__le32)commandline_block))
+	{
+	  print_directory(block, commandline_block);
+	  std::cout << "WARNING: inode " << dir_entry->inode << " was reallocated!\n";
+	}
+	else if (!inode->block()[0])
+	{
+	  print_directory(block, commandline_block);
+	  if (allocated)	// Is this at all possible?
+	    std::cout << "WARNING: inode " << dir_entry->inode << " doesn't contain any blocks. This directory was deleted.\n";
+	}
+	else
+	{
+#ifdef CPPGRAPH
+	  // Tell cppgraph that we call print_directory_action from here.
+	  iterate_over_all_blocks_of__with__print_directory_action();
 #endif
+	  // Run over all blocks.
+	  bool reused_or_corrupted_indirect_block1 = iterate_over_all_blocks_of(inode, dir_entry->inode, print_directory_action);
+	  if (reused_or_corrupted_indirect_block1)
+	  {
+	    std::cout << "Note: Block " << commandline_block << " is a directory start, it's \".\" entry has inode " << dir_entry->inode <<
+		" which is indeed a directory, but this inode has reused or corrupted (double/triple) indirect blocks so that not all"
+		" directory blocks could be printed!\n";
+	  }
+	}
+      }
+      else
+	print_directory(block, commandline_block);
+    }
+    delete [] block;
+  }
+}
 
-extern void custom(void);
+// Create the directory that restored files are written to, if it doesn't exist yet.
+void init_outputdir(void)
+{
+  struct stat statbuf;
+  if (stat(outputdir.c_str(), &statbuf) == -1)
+  {
+    if (errno != ENOENT)
+    {
+      int error = errno;
+      std::cout << std::flush;
+      std::cerr << progname << ": stat: " << outputdir << ": " << strerror(error) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    else if (mkdir(outputdir.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+      int error = errno;
+      std::cout << std::flush;
+      std::cerr << progname << ": failed to create output directory " << outputdir << ": " << strerror(error) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::cout << "Writing output to directory " << outputdir << std::endl;
+  }
+  else if (!S_ISDIR(statbuf.st_mode))
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": " << outputdir << " exists but is not a directory!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
 
 void run_program(void)
 {
@@ -179,7 +452,9 @@ void run_program(void)
   // Print group summary, if needed.
   if (!commandline_journal && commandline_inode_to_block == -1)
   {
-    std::cout << "Number of groups: " << groups_ << '\n';
+    // A query of --serve only prints the number of groups if it prints the groups.
+    if (!serving_query || !commandline_action)
+      std::cout << "Number of groups: " << groups_ << '\n';
     if (commandline_group == -1)
     {
       if (!commandline_action)
@@ -206,282 +481,43 @@ void run_program(void)
   {
     if (commandline_inode_to_block != -1)
       commandline_group = inode_to_group(super_block, commandline_inode_to_block);
-    if (!commandline_group)
+    // The server already loaded the metadata of all groups.
+    bool print_progress = !commandline_group && !serving_query;
+    if (print_progress)
       std::cout << "Loading group metadata.." << std::flush;
     for (int group = 0; group < groups_; ++group)
     {
       if (commandline_group != -1 && group != commandline_group)
 	continue;
-      if (!commandline_group)
-	std::cout << '.' << std::flush;
+      if (print_progress)
+	std::cout << '.';
       load_meta_data(group);
     }
-    if (!commandline_group)
+    if (print_progress)
       std::cout << " done\n";
   }
 
   // Needed here?
   init_journal();
 
-  // Handle --inode
-  if (commandline_inode != -1)
+  // Handle --serve
+  if (!commandline_serve.empty())
   {
-    InodePointer inode(get_inode(commandline_inode));
-    if (commandline_print)
-    {
-      std::cout << "\nHex dump of inode " << commandline_inode << ":\n";
-      dump_hex_to(std::cout, (unsigned char const*)&(*inode), inode_size_);
-      std::cout << '\n';
-    }
-    unsigned int bit = commandline_inode - 1 - commandline_group * inodes_per_group_;
-    ASSERT(bit < 8U * block_size_);
-    bitmap_ptr bmp = get_bitmap_mask(bit);
-    bool allocated = (inode_bitmap[commandline_group][bmp.index] & bmp.mask);
-    if (allocated)
-      std::cout << "Inode is Allocated\n";
-    else
-      std::cout << "Inode is Unallocated\n";
-    if (commandline_print)
-    {
-      std::cout << "Group: " << commandline_group << '\n';
-      print_inode_to(std::cout, *inode);
-    }
-    if (is_directory(inode))
-      print_directory_inode(commandline_inode);
+    run_server(commandline_serve);
+    return;
   }
+
+  StatsPhase stats_phase("actions");
+
+  // Handle --inode
+  if (commandline_inode != -1)
+    handle_commandline_inode();
   // Handle --block
   if (commandline_block != -1 || (commandline_journal_block != -1 && commandline_journal))
-  {
-    if (commandline_journal && commandline_block != -1)
-    {
-      print_block_descriptors(commandline_block);
-    }
-    else
-    {
-      if (commandline_journal_block != -1 && commandline_journal)
-      {
-	// Translate block number.
-	commandline_block = journal_block_to_real_block(commandline_journal_block);
-	commandline_group = block_to_group(super_block, commandline_block);
-      }
-      unsigned char* block = new unsigned char[block_size_];    
-      if (EXTERNAL_BLOCK && commandline_block == 0)
-      {
-	assert(block_size_ == sizeof(someones_block));
-	std::memcpy(block, someones_block, block_size_);
-	DirectoryBlockStats stats;
-	int blocknr = commandline_block;
-	commandline_block = -1;
-	inode_count_ = someones_inode_count;
-	is_directory_type isdir = is_directory(block, blocknr, stats, false);
-	std::cout << "is_directory returned " << isdir << " for someones_block." << std::endl;
-	exit(EXIT_SUCCESS);
-      }
-      else
-      {
-	device.seekg(block_to_offset(commandline_block));
-	ASSERT(device.good());
-	device.read(reinterpret_cast<char*>(block), block_size_);
-	ASSERT(device.good());
-      }
-      if (commandline_print)
-      {
-	std::cout << "Hex dump of block " << commandline_block << ":\n";
-	print_block_to(std::cout, block);
-	std::cout << '\n';
-      }
-      std::cout << "Group: " << commandline_group << '\n';
-      unsigned int bit = commandline_block - first_data_block(super_block) - commandline_group * blocks_per_group(super_block);
-      ASSERT(bit < 8U * block_size_);
-      bitmap_ptr bmp = get_bitmap_mask(bit);
-      DirectoryBlockStats stats;
-      is_directory_type isdir = is_directory(block, commandline_block, stats, false);
-      if (block_bitmap[commandline_group] == NULL)
-	load_meta_data(commandline_group);
-      bool allocated = (block_bitmap[commandline_group][bmp.index] & bmp.mask);
-      bool journal = is_journal(commandline_block);
-      if (isdir == isdir_no)
-      {
-	if (allocated)
-	{
-	  std::cout << "Block " << commandline_block;
-	  if (journal)
-	  {
-	    std::cout << " belongs to the journal.";
-	    int real_block;
-	    journal_header_t* header = reinterpret_cast<journal_header_t*>(block);
-	    if (be2le(header->h_magic) == JFS_MAGIC_NUMBER)
-	    {
-	      std::cout << "\n\n";
-	      switch (be2le(header->h_blocktype))
-	      {
-		case JFS_DESCRIPTOR_BLOCK:
-		{
-		  std::cout << *header << '\n';
-		  journal_block_tag_t* journal_block_tag = reinterpret_cast<journal_block_tag_t*>(block + sizeof(journal_header_t));
-		  int curblock = commandline_block;
-		  for (;;)
-		  {
-		    uint32_t flags = be2le(journal_block_tag->t_flags);
-		    ++curblock;
-		    while(is_indirect_block_in_journal(curblock))
-		      ++curblock;
-		    int refered_block = be2le(journal_block_tag->t_blocknr);
-		    std::cout << "  " << curblock << ((flags & JFS_FLAG_ESCAPE) ? "(escaped)" : "") << " = " <<
-			refered_block << ((flags & JFS_FLAG_DELETED) ? "(deleted)" : "") << '\n';
-		    if ((flags & JFS_FLAG_LAST_TAG))
-		      break;
-		    if (!(flags & JFS_FLAG_SAME_UUID))
-		      journal_block_tag = reinterpret_cast<journal_block_tag_t*>((unsigned char*)journal_block_tag + 16);
-		    ++journal_block_tag;
-		  }
-		  break;
-		}
-		case JFS_COMMIT_BLOCK:
-		{
-		  std::cout << *header << '\n';
-		  break;
-		}
-		case JFS_SUPERBLOCK_V1:
-		case JFS_SUPERBLOCK_V2:
-		{
-		  std::cout << *reinterpret_cast<journal_superblock_t*>(block) << '\n';
-		  break;
-		}
-		case JFS_REVOKE_BLOCK:
-		{
-		  std::cout << *reinterpret_cast<journal_revoke_header_t*>(block) << '\n';
-		  break;
-		}
-	      }
-	    }
-	    else if ((real_block = is_inode_block(commandline_block)))
-	    {
-	      std::cout << " It contains inode table block " << real_block << ".\n";
-	      if (commandline_print)
-	      {
-		int inodenr = block_to_inode(real_block);
-	        for (Inode const* inode = reinterpret_cast<Inode const*>(block); reinterpret_cast<unsigned char const*>(inode) < block + block_size_;
-		    inode = reinterpret_cast<Inode const*>(reinterpret_cast<unsigned char const*>(inode) + inode_size_), ++inodenr)
-		{
-		  std::cout << "\n--------------Inode " << inodenr << "-----------------------\n";
-		  print_inode_to(std::cout, *inode);
-	        }
-	      }
-	    }
-	    else
-	      std::cout << '\n';
-	  }
-	  else
-	  {
-	    std::cout << " is Allocated.";
-	    if (is_inode(commandline_block))
-	    {
-	      int inode = block_to_inode(commandline_block);
-	      std::cout << " It's inside the inode table of group " << commandline_group <<
-		  " (inodes [" << inode << " - " << (inode + block_size_ / inode_size_) << ">).";
-	    }
-	    std::cout << '\n';
-	  }
-	}
-	else
-	{
-	  std::cout << "Block " << commandline_block << " is Unallocated.\n";
-	  // If this assertion fails, then it is possible that this DATA block looks like an inode,
-	  // most likely because the data itself is an ext3 filesystem. For example an ext3 image.
-	  // If that is possible, then just comment this assertion out.
-	  //ASSERT(!is_inode(commandline_block));	// All inode blocks are allocated.
-	  ASSERT(!journal);			// All journal blocks are allocated.
-	}
-	if (is_indirect_block(block))
-	{
-	  std::cout << "Block " << commandline_block << " appears to be an (double/tripple) indirect block.\n";
-	  if (commandline_print)
-	  {
-	    std::cout << "It contains the following block numbers:\n";
-	    __le32* block_numbers = reinterpret_cast<__le32*>(block);
-	    for (int i = 0; i < block_size_ >> 2; ++i)
-	    {
-	      std::cout << ' ' << std::setw(9) << std::setfill(' ') << block_numbers[i];
-	      if ((i + 1) % 10 == 0)
-	        std::cout << '\n';
-	    }
-	    std::cout << '\n';
-	  }
-	}
-      }
-      else
-      {
-	std::cout << "\nBlock " << commandline_block << " is a directory. The block is " <<
-	    (allocated ? journal ? "a Journal block" : "Allocated" : "Unallocated") << "\n\n";
-	if (commandline_ls)
-	  print_restrictions();
-	if (isdir == isdir_start)
-	{
-	  ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(block);
-	  InodePointer inode = get_inode(dir_entry->inode);
-	  if (!is_directory(inode) || (inode->block()[0] && inode->block()[0] != (__le32)commandline_block))
-	  {
-	    print_directory(block, commandline_block);
-	    std::cout << "WARNING: inode " << dir_entry->inode << " was reallocated!\n";
-	  }
-	  else if (!inode->block()[0])
-	  {
-	    print_directory(block, commandline_block);
-	    if (allocated)	// Is this at all possible?
-	      std::cout << "WARNING: inode " << dir_entry->inode << " doesn't contain any blocks. This directory was deleted.\n";
-	  }
-	  else
-	  {
-#ifdef CPPGRAPH
-            // Tell cppgraph that we call print_directory_action from here.
-            iterate_over_all_blocks_of__with__print_directory_action();
-#endif
-	    // Run over all blocks.
-	    bool reused_or_corrupted_indirect_block1 = iterate_over_all_blocks_of(inode, dir_entry->inode, print_directory_action);
-	    if (reused_or_corrupted_indirect_block1)
-	    {
-	      std::cout << "Note: Block " << commandline_block << " is a directory start, it's \".\" entry has inode " << dir_entry->inode <<
-		  " which is indeed a directory, but this inode has reused or corrupted (double/triple) indirect blocks so that not all"
-		  " directory blocks could be printed!\n";
-	    }
-	  }
-	}
-	else
-	  print_directory(block, commandline_block);
-      }
-      delete [] block;
-    }
-  }
+    handle_commandline_block();
   // Make sure the output directory exists.
   if (!commandline_restore_file.empty() || commandline_restore_all || !commandline_restore_inode.empty())
-  {
-    struct stat statbuf;
-    if (stat(outputdir.c_str(), &statbuf) == -1)
-    {
-      if (errno != ENOENT)
-      {
-	int error = errno;
-	std::cout << std::flush;
-	std::cerr << progname << ": stat: " << outputdir << ": " << strerror(error) << std::endl;
-	exit(EXIT_FAILURE);
-      }
-      else if (mkdir(outputdir.c_str(), 0755) == -1 && errno != EEXIST)
-      {
-        int error = errno;
-	std::cout << std::flush;
-	std::cerr << progname << ": failed to create output directory " << outputdir << ": " << strerror(error) << std::endl;
-	exit(EXIT_FAILURE);
-      }
-      std::cout << "Writing output to directory " << outputdir << std::endl;
-    }
-    else if (!S_ISDIR(statbuf.st_mode))
-    {
-      std::cout << std::flush;
-      std::cerr << progname << ": " << outputdir << " exists but is not a directory!" << std::endl;
-      exit(EXIT_FAILURE);
-    }
-  }
+    init_outputdir();
   // Handle --dump-names
   if (commandline_restore_all || commandline_dump_names)
     dump_names();
@@ -534,61 +570,49 @@ void run_program(void)
       hist_init(commandline_after, commandline_before);
     else if (commandline_histogram == hist_group)
       hist_init(0, groups_);
-    // Run over all (requested) groups.
-    for (int group = 0, ibase = 0; group < groups_; ++group, ibase += inodes_per_group_)
+    init_timestamp_index();
+    uint8_t flags_mask = 0, flags_value = 0;
+    if (commandline_deleted)
     {
-      if (commandline_group != -1 && group != commandline_group)
-	continue;
-      // Run over all inodes.
-      for (int bit = 0, inode_number = ibase + 1; bit < inodes_per_group_; ++bit, ++inode_number)
+      flags_mask |= catalog_deleted;
+      flags_value |= catalog_deleted;
+    }
+    if (commandline_directory)
+    {
+      flags_mask |= catalog_directory;
+      flags_value |= catalog_directory;
+    }
+    if (commandline_allocated || commandline_unallocated)
+    {
+      flags_mask |= catalog_allocated;
+      if (commandline_allocated)
+        flags_value |= catalog_allocated;
+      // If both are given then no inode matches: make flags_value contain a bit that isn't in flags_mask.
+      if (commandline_allocated && commandline_unallocated)
+        flags_value |= catalog_zeroed;
+    }
+    // The group histogram counts the inodes with a valid dtime.
+    TimestampColumn const& column(timestamp_column(commandline_histogram == hist_group ? hist_dtime : commandline_histogram));
+    // Only the entries with a time in [commandline_after, commandline_before) can be counted.
+    uint32_t const* begin = column.times;
+    uint32_t const* end = column.times + column.count;
+    if (commandline_after > 0)
+      begin = std::lower_bound(begin, end, (uint64_t)commandline_after);
+    if (commandline_before)
+      end = std::lower_bound(begin, end, (uint64_t)std::max(commandline_before, (time_t)0));
+    if (!flags_mask && commandline_group == -1 && commandline_histogram != hist_group)
+      hist_add_sorted(begin, end);
+    else
+    {
+      for (uint32_t const* time = begin; time < end; ++time)
       {
-	InodePointer inode(get_inode(inode_number));
-	if (commandline_deleted && !inode->is_deleted())
+        size_t i = time - column.times;
+	if ((column.flags[i] & flags_mask) != flags_value)
 	  continue;
-	if ((commandline_histogram == hist_dtime || commandline_histogram == hist_group) && !inode->has_valid_dtime())
-          continue;
-	if (commandline_directory && !is_directory(inode))
+	int group = (column.inodes[i] - 1) / inodes_per_group_;
+	if (commandline_group != -1 && group != commandline_group)
 	  continue;
-	if (commandline_allocated || commandline_unallocated)
-	{
-	  bitmap_ptr bmp = get_bitmap_mask(bit);
-	  bool allocated = (inode_bitmap[group][bmp.index] & bmp.mask);
-	  if (commandline_allocated && !allocated)
-	    continue;
-	  if (commandline_unallocated && allocated)
-	    continue;
-	}
-	time_t xtime = 0;
-	if (commandline_histogram == hist_dtime)
-	  xtime = inode->dtime();
-	else if (commandline_histogram == hist_atime)
-	{
-	  xtime = inode->atime();
-	  if (xtime == 0)
-	    continue;
-        }
-	else if (commandline_histogram == hist_ctime)
-	{
-	  xtime = inode->ctime();
-	  if (xtime == 0)
-	    continue;
-	}
-	else if (commandline_histogram == hist_mtime)
-	{
-	  xtime = inode->mtime();
-	  if (xtime == 0)
-	    continue;
-        }
-	if (xtime && commandline_after <= xtime && xtime < commandline_before)
-	  hist_add(xtime);
-	if (commandline_histogram == hist_group)
-	{
-	  if (commandline_after && commandline_after > (time_t)inode->dtime())
-	    continue;
-	  if (commandline_before && (time_t)inode->dtime() >= commandline_before)
-	    continue;
-	  hist_add(group);
-        }
+	hist_add(commandline_histogram == hist_group ? group : *time);
       }
     }
     hist_print();
@@ -601,9 +625,14 @@ void run_program(void)
     ASSERT(len <= (size_t)block_size_);
     char* pattern = new char [len];
     strncpy(pattern, start ? commandline_search_start.data() : commandline_search.data(), len);
-    static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+    // Every block is read at most once, so the blocks are read in chunks, bypassing the block cache.
+    int const chunk_blocks = std::max(1, scan_chunk_size / block_size_);
+    std::vector<unsigned char> chunk_buf(chunk_blocks * block_size_);
     if (commandline_allocated && commandline_unallocated)
+    {
       commandline_allocated = commandline_unallocated = false;
+      forget_parsed_directory_blocks();
+    }
     if (commandline_allocated)
       std::cout << "Allocated blocks ";
     else if (commandline_unallocated)
@@ -612,6 +641,7 @@ void run_program(void)
       std::cout << "Blocks ";
     std::cout << (start ? "starting with" : "containing") << " \"" << std::string(pattern, len) << "\":" << std::flush;
     ASSERT((inodes_per_group_ * inode_size_) % block_size_ == 0);
+    Progress progress(start ? "--search-start" : "--search", block_count(super_block) - first_data_block(super_block), block_size_);
     for (int group = 0; group < groups_; ++group)
     {
       int first_block = group_to_block(super_block, group);  
@@ -620,48 +650,35 @@ void run_program(void)
       int inode_table = group_descriptor_table[group].bg_inode_table;
       first_block = inode_table + inodes_per_group_ * inode_size_ / block_size_;
       unsigned int bit = first_block - first_data_block(super_block) - group * blocks_per_group(super_block);
-      for (int block = first_block; block < last_block; ++block, ++bit)
+      for (int chunk = first_block; chunk < last_block; chunk += chunk_blocks)
       {
-	bitmap_ptr bmp = get_bitmap_mask(bit);
-	bool allocated = (block_bitmap[group][bmp.index] & bmp.mask);
-	if (commandline_allocated && !allocated)
-	  continue;
-	if (commandline_unallocated && allocated)
-	  continue;
-	bool found = false;
-        get_block(block, block_buf);
-        if (start)
-	{
-#if 1
-	  if (std::memcmp(block_buf, pattern, len) == 0)
-	    found = true;
-#else
-          if (std::isdigit(block_buf[0]) && std::isdigit(block_buf[1]) && std::isdigit(block_buf[2]) && block_buf[3] == ' ' && std::isdigit(block_buf[4]) &&
-	      std::isdigit(block_buf[5]) && block_buf[9] == 0 && block_buf[10] == 0 && block_buf[11] == 0 && block_buf[12] == 0 &&
-	      block_buf[13] == 0 && block_buf[14] == 0 && block_buf[15] == 0 && block_buf[16] == 0)
-	    std::cout << block << " : " << block_buf << '\n';
-#endif
-	}
-        else
+	int count = std::min(chunk_blocks, last_block - chunk);
+	bool chunk_read = false;
+	for (int block = chunk; block < chunk + count; ++block, ++bit)
 	{
-	  for (unsigned char* ptr = block_buf; ptr < block_buf + block_size_ - len; ++ptr)
+	  progress.update(block - first_data_block(super_block));
+	  bitmap_ptr bmp = get_bitmap_mask(bit);
+	  bool allocated = (block_bitmap[group][bmp.index] & bmp.mask);
+	  if (commandline_allocated && !allocated)
+	    continue;
+	  if (commandline_unallocated && allocated)
+	    continue;
+	  if (!chunk_read)
 	  {
-	    if (*ptr == *pattern &&
-	        (len == 1 || (ptr[1] == pattern[1] &&
-		(len == 2 || (ptr[2] == pattern[2] && std::memcmp(ptr, pattern, len) == 0)))))
-	    {
-	      found = true;
-	      break;
-	    }
+	    get_blocks(chunk, count, &chunk_buf[0]);
+	    chunk_read = true;
+	  }
+	  bool found = search_block(&chunk_buf[(block - chunk) * block_size_], pattern, len, start);
+	  if (found)
+	  {
+	    if (output_format != output_text)
+	      output_record(OutputRecord(start ? "search_start" : "search").block(block).state(allocated ? "allocated" : "unallocated"));
+	    else if (!commandline_allocated && allocated)
+	      std::cout << ' ' << block << " (allocated)";
+	    else
+	      std::cout << ' ' << block;
 	  }
 	}
-	if (found)
-	{
-	  if (!commandline_allocated && allocated)
-	    std::cout << ' ' << block << " (allocated)" << std::flush;
-          else
-	    std::cout << ' ' << block << std::flush;
-        }
       }
     }
     delete [] pattern;
@@ -671,8 +688,10 @@ void run_program(void)
   if (commandline_search_inode != -1)
   {
     std::cout << "Inodes refering to block " << commandline_search_inode << ':' << std::flush;
+    Progress progress("--search-inode", inode_count_, 0);
     for (uint32_t inode = 1; inode <= inode_count_; ++inode)
     {
+      progress.update(inode - 1);
       InodePointer ino = get_inode(inode);
       if (is_symlink(ino))
         continue;		// Does not refer to any block, and indirect blocks to run over.
@@ -691,7 +710,12 @@ void run_program(void)
         std::cout << "Inodes refering to block " << commandline_search_inode << " (cont):" << std::flush;
       }
       if (data.found_block)
-        std::cout << ' ' << inode << std::flush;
+      {
+        if (output_format != output_text)
+	  output_record(OutputRecord("search_inode").inode(inode).block(commandline_search_inode));
+	else
+	  std::cout << ' ' << inode;
+      }
     }
     std::cout << '\n';
   }
@@ -699,19 +723,23 @@ void run_program(void)
   if (commandline_search_zeroed_inodes)
   {
     std::cout << "Allocated inodes filled with zeroes:" << std::flush;
-    for (uint32_t inode = 1; inode <= inode_count_; ++inode)
+    init_inode_catalog();
+    size_t begin = 0, end = inode_count_;
+    if (commandline_group != -1)
     {
-      if (commandline_group != -1)
+      begin = (size_t)commandline_group * inodes_per_group_;
+      end = begin + inodes_per_group_;
+    }
+    std::vector<uint8_t> selected(end - begin, 1);
+    catalog_select_flags(begin, end, catalog_allocated | catalog_zeroed, catalog_allocated | catalog_zeroed, &selected[0]);
+    for (size_t i = begin; i < end; ++i)
+      if (selected[i - begin])
       {
-	int group = (inode - 1) / inodes_per_group_;
-	if (group != commandline_group)
-	  continue;
+        if (output_format != output_text)
+	  output_record(OutputRecord("search_zeroed_inode").inode(i + 1).state("allocated"));
+	else
+	  std::cout << ' ' << i + 1;
       }
-      InodePointer ino = get_inode(inode);
-      static char zeroes[128] = {0, };
-      if (is_allocated(inode) && std::memcmp(&ino, zeroes, sizeof(zeroes)) == 0)
-        std::cout << ' ' << inode << std::flush;
-    }
     std::cout << '\n';
   }
   // Handle --inode-to-block
@@ -730,6 +758,15 @@ void run_program(void)
   // Handle --show-journal-inodes
   if (commandline_show_journal_inodes != -1)
     show_journal_inodes(commandline_show_journal_inodes);
+  // Handle --export-block-corpus
+  if (!commandline_export_block_corpus.empty())
+    export_block_corpus(commandline_export_block_corpus);
+  // Handle --microbench
+  if (!commandline_microbench.empty())
+    run_microbenchmarks(commandline_microbench);
+  // Handle --batch
+  if (!commandline_batch.empty())
+    run_batch(commandline_batch);
 
   // Print some useful information if no useful information was printed yet.
   if (!commandline_action && !commandline_journal)
@@ -741,49 +778,27 @@ void run_program(void)
     std::cout << "                           Show deletion-time histogram (zoom in afterwards).\n";
     std::cout << "    --help                 Show all possible command line options.\n";
   }
-
-  // Clean up.
-  if (commandline_action)
-  {
-    delete [] inodes_buf;
-    for (int group = 0; group < groups_; ++group)
-    {
-      if (block_bitmap[group])
-      {
-	delete [] inode_bitmap[group];
-	delete [] block_bitmap[group];
-#if !USE_MMAP
-	delete [] all_inodes[group];
-#endif
-      }
-#if USE_MMAP
-      if (all_inodes[group])
-	inode_unmap(group);
-#endif
-    }
-    delete [] inode_bitmap;
-    delete [] block_bitmap;
-    delete [] all_inodes;
-#if USE_MMAP
-    ASSERT(nr_mmaps == 0);
-    delete [] all_mmaps;
-    delete [] refs_to_mmap;
-#endif
-    delete [] group_descriptor_table;
-  }
 }
 
 int main(int argc, char* argv[])
 {
   Debug(debug::init());
 
-#ifdef USE_SVN
-  std::cout << "Running " << svn_revision << '\n';
-#else
-  std::cout << "Running ext3grep version " VERSION "\n";
-#endif
+  // Handle --client before anything else: it doesn't use a device.
+  std::string client_socket;
+  std::vector<std::string> client_arguments;
+  if (client_commandline(argc, argv, client_socket, client_arguments))
+  {
+    progname = argv[0];
+    return run_client(client_socket, client_arguments);
+  }
 
   decode_commandline_options(argc, argv);
+  init_diagnostics(commandline_max_warnings);
+  if (!commandline_stats.empty())
+    init_stats(commandline_stats);
+  if (!commandline_trace.empty())
+    init_trace(commandline_trace);
 
   // Sanity checks on the user.
 
@@ -795,70 +810,8 @@ int main(int argc, char* argv[])
       std::cerr << progname << ": Too many non-options. Use --help for a usage message." << std::endl;
     exit(EXIT_FAILURE);
   }
-  struct stat statbuf;
-  if (stat(*argv, &statbuf) == -1)
-  {
-    int error = errno;
-    std::cout << std::flush;
-    std::cerr << progname << ": stat \"" << *argv << "\": " << strerror(error) << std::endl;
-    exit(EXIT_FAILURE);
-  }
-  if (S_ISDIR(statbuf.st_mode))
-  {
-    std::cerr << progname << ": \"" << *argv << "\" is a directory. You need to use the raw ext3 filesystem device (or a copy thereof)." << std::endl;
-    exit(EXIT_FAILURE);
-  }
-  if (!S_ISBLK(statbuf.st_mode) && statbuf.st_size < SUPER_BLOCK_OFFSET + 1024)
-  {
-    std::cerr << progname << ": \"" << *argv << "\" is not an ext3 fs; it's WAY too small (" << statbuf.st_size << " bytes)." << std::endl;
-    exit(EXIT_FAILURE);
-  }
-
-  // Open the device.
-  device.open(*argv);
-  if (!device.good())
-  {
-    int error = errno;
-    std::cout << std::flush;
-    std::cerr << progname << ": failed to read-only open device \"" << *argv << "\": " << strerror(error) << std::endl;
-    exit(EXIT_FAILURE);
-  }
-#if USE_MMAP
-  device_fd = open(*argv, O_RDONLY);
-  if (device_fd == -1)
-  {
-    int error = errno;
-    std::cout << std::flush;
-    std::cerr << progname << ": failed to open device \"" << *argv << "\" for reading: " << strerror(error) << std::endl;
-    exit(EXIT_FAILURE);
-  }
-#endif
-
-  // Read the first superblock.
-
-  // The size of a super block is 1024 bytes.
-  assert(sizeof(ext3_super_block) == 1024);
-  device.seekg(SUPER_BLOCK_OFFSET);
-  if (!device.good())
-  {
-    int error = errno;
-    std::cout << std::flush;
-    std::cerr << progname << ": failed to seek to position " << SUPER_BLOCK_OFFSET << " of \"" << *argv << "\": " << strerror(error) << std::endl;
-    exit(EXIT_FAILURE);
-  }
-  // super_block is initialized here.
-  device.read(reinterpret_cast<char*>(&super_block), sizeof(ext3_super_block));
-  if (!device.good())
-  {
-    int error = errno;
-    std::cout << std::flush;
-    std::cerr << progname << ": failed to read first superblock from \"" << *argv << "\": " << strerror(error) << std::endl;
-    exit(EXIT_FAILURE);
-  }
-
-  // Initialize global constants.
-  device_name = *argv;
-  init_consts();
+  FilesystemSession session(*argv);
+  init_block_cache(commandline_block_cache);
 
   try
   {
@@ -877,8 +830,8 @@ int main(int argc, char* argv[])
     exit(EXIT_FAILURE);
   }
 
-  device.close();
-#if USE_MMAP
-  close(device_fd);
+#ifdef CWDEBUG
+  BlockCacheStatistics block_cache_stats = block_cache_statistics();
+  Dout(dc::notice, "Block cache: " << block_cache_stats.hits << " hits, " << block_cache_stats.misses << " misses.");
 #endif
 }
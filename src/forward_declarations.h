@@ -34,13 +34,15 @@
 // Forward declarations.
 struct Parent;
 class DirectoryBlockStats;
+class BlockPrefetcher;
 void decode_commandline_options(int& argc, char**& argv);
+void reset_commandline_options(void);
+void run_program(void);
 void dump_hex_to(std::ostream& os, unsigned char const* buf, size_t size, size_t addr_offset = 0);
 void print_block_to(std::ostream& os, unsigned char* block);
 void iterate_over_directory(unsigned char* block, int blocknr,
-    bool (*action)(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void*), Parent* parent, void* data);
-void iterate_over_directory_action(int blocknr, void* data);
-void iterate_over_existing_directory_action(int blocknr, int, void* data);
+    bool (*action)(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void*), Parent* parent, void* data,
+    BlockPrefetcher* prefetcher = NULL);
 void iterate_over_journal(
     bool (*action_tag)(uint32_t block, uint32_t sequence, journal_block_tag_t*, void* data),
     bool (*action_revoke)(uint32_t block, uint32_t sequence, journal_revoke_header_t*, void* data),
@@ -57,12 +59,17 @@ bool is_indirect_block_in_journal(int blocknr);
 bool is_symlink(Inode const& inode);
 void hist_init(size_t min, size_t max);
 void hist_add(size_t val);
+void hist_add_sorted(uint32_t const* begin, uint32_t const* end);
 void hist_print(void);
 int dir_inode_to_block(uint32_t inode);
 int journal_block_to_real_block(int blocknr);
+void init_journal_block_map(void);
 void init_journal(void);
 int journal_block_contains_inodes(int blocknr);
 void handle_commandline_journal_transaction(void);
+void handle_commandline_inode(void);
+void handle_commandline_block(void);
+void init_outputdir(void);
 void print_block_descriptors(uint32_t block);
 void print_directory_inode(int inode);
 void dump_names(void);
@@ -23,17 +23,51 @@
 
 #ifndef USE_PCH
 #include "sys.h"
+#include <unistd.h>
 #include "debug.h"
 #endif
 
 #include "globals.h"
 #include "conversion.h"
+#include "block_cache.h"
+#include "dir_block_store.h"
+#include "stats.h"
 
+// This function is thread-safe: it uses pread(2) on device_fd instead of 'device',
+// and the block cache has its own locking.
+// Directory blocks found in stage 1 are read from the directory block store, if it is open;
+// dir_block_store_open only opens it when it was written for the current state of the file system.
 unsigned char* get_block(int block, unsigned char* block_buf)
 {
-  device.seekg(block_to_offset(block));
-  ASSERT(device.good());
-  device.read((char*)block_buf, block_size_);
-  ASSERT(device.good());
+  uint64_t start = stats_get_block_start();
+  stats_add(stats_get_block_calls);
+  if (block_cache_get(block, block_buf))
+  {
+    stats_add(stats_block_cache_hits);
+    stats_get_block_done(start);
+    return block_buf;
+  }
+  if (dir_block_store_get(block, block_buf))
+    stats_add(stats_dir_block_store_hits);
+  else
+  {
+    ssize_t len = pread(device_fd, block_buf, block_size_, block_to_offset(block));
+    ASSERT(len == block_size_);
+    stats_add(stats_blocks_read);
+    stats_add(stats_bytes_read, block_size_);
+  }
+  block_cache_put(block, block_buf);
+  stats_get_block_done(start);
   return block_buf;
 }
+
+// Read count consecutive blocks, starting at block, with a single pread(2).
+// This bypasses the block cache; it is used for streaming reads that would only pollute it.
+unsigned char* get_blocks(int block, int count, unsigned char* buf)
+{
+  ssize_t len = pread(device_fd, buf, (size_t)count * block_size_, block_to_offset(block));
+  ASSERT(len == (ssize_t)count * block_size_);
+  stats_add(stats_blocks_read, count);
+  stats_add(stats_bytes_read, (uint64_t)count * block_size_);
+  return buf;
+}
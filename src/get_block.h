@@ -25,5 +25,9 @@
 #define GET_BLOCK_H
 
 unsigned char* get_block(int block, unsigned char* block_buf);
+unsigned char* get_blocks(int block, int count, unsigned char* buf);
+
+// The number of bytes that sequential scans read at once with get_blocks.
+int const scan_chunk_size = 1024 * 1024;
 
 #endif // GET_BLOCK_H
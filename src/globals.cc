@@ -54,8 +54,8 @@ Inode journal_inode;
 // Globally used variables.
 char const* progname;
 std::ifstream device;
-#if USE_MMAP
 int device_fd;
+#if USE_MMAP
 long page_size_;
 void** all_mmaps;
 int* refs_to_mmap;
@@ -67,7 +67,7 @@ bitmap_t** block_bitmap;
 bitmap_t** inode_bitmap;
 char* inodes_buf;
 ext3_group_desc* group_descriptor_table;
-int no_filtering = 0;
+__thread int no_filtering = 0;
 std::string device_name;
 bool feature_incompat_filetype = false;
 uint32_t wrapped_journal_sequence = 0;
@@ -58,8 +58,8 @@ extern Inode journal_inode;
 // Globally used variables.
 extern char const* progname;
 extern std::ifstream device;
-#if USE_MMAP
 extern int device_fd;
+#if USE_MMAP
 extern long page_size_;
 extern void** all_mmaps;
 extern int* refs_to_mmap;
@@ -71,7 +71,7 @@ extern bitmap_t** block_bitmap;
 extern bitmap_t** inode_bitmap;
 extern char* inodes_buf;
 extern ext3_group_desc* group_descriptor_table;
-extern int no_filtering;
+extern __thread int no_filtering;
 extern std::string device_name;
 extern bool feature_incompat_filetype;
 extern uint32_t wrapped_journal_sequence;
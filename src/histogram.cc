@@ -25,10 +25,13 @@
 #include "sys.h"
 #include <sys/types.h>
 #include <iomanip>
+#include <algorithm>
+#include <stdint.h>
 #include "debug.h"
 #endif
 
 #include "commandline.h"
+#include "output.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -63,6 +66,23 @@ void hist_add(size_t val)
   S_maxcount = std::max(S_maxcount, histo[(val - S_min) / S_bs]);
 }
 
+// Add all values in the sorted range [begin, end) that lie within [S_min, S_max).
+// This counts each bucket with a binary search, so the cost doesn't depend on the number of values.
+void hist_add_sorted(uint32_t const* begin, uint32_t const* end)
+{
+  begin = std::lower_bound(begin, end, S_min);
+  for (int i = 0; i < histsize; ++i)
+  {
+    size_t bucket_end = std::min(S_min + (i + 1) * S_bs, S_max);
+    uint32_t const* next = std::lower_bound(begin, end, bucket_end);
+    histo[i] += next - begin;
+    S_maxcount = std::max(S_maxcount, histo[i]);
+    begin = next;
+    if (bucket_end == S_max)
+      break;
+  }
+}
+
 void hist_print(void)
 {
   if (S_maxcount == 0)
@@ -73,6 +93,20 @@ void hist_print(void)
   static char const line[] = "===============================================================================================================================================================END!";
   int i = 0;
   size_t total_count = 0;
+  if (output_format != output_text)
+  {
+    // One record per bucket, with the start of the bucket in 'time' or 'group'.
+    for (size_t val = S_min; val < S_max; val += S_bs, ++i)
+    {
+      OutputRecord record("histogram");
+      if (commandline_histogram == hist_group)
+	record.group(val);
+      else
+	record.time(val);
+      output_record(record.count(histo[i]));
+    }
+    return;
+  }
   for (size_t val = S_min;; val += S_bs, ++i)
   {
     if (commandline_histogram == hist_atime ||
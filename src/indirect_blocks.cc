@@ -54,6 +54,7 @@
 #include "forward_declarations.h"
 #include "endian_conversion.h"
 #include "superblock.h"
+#include "session.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -73,15 +74,15 @@ void iterate_over_all_blocks_of__with__find_block_action(void) { find_block_acti
 
 void print_directory_action(int blocknr, int, void*)
 {
-  static bool using_static_buffer = false;
-  ASSERT(!using_static_buffer);
-  static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  static __thread bool using_block_buf = false;
+  ASSERT(!using_block_buf);
+  unsigned char* block_buf = scratch_block(scratch_print_directory);
   unsigned char* block = get_block(blocknr, block_buf);
-  using_static_buffer = true;
+  using_block_buf = true;
   ext3_dir_entry_2* dir_entry = reinterpret_cast<ext3_dir_entry_2*>(block);
   if (dir_entry->rec_len < block_size_)	// The directory could be entirely empty (unused).
     print_directory(block, blocknr);
-  using_static_buffer = false;
+  using_block_buf = false;
 }
 
 #ifdef CPPGRAPH
@@ -39,6 +39,11 @@
 #include "get_block.h"
 #include "journal.h"
 #include "dir_inode_to_block.h"
+#include "stats.h"
+#include "trace.h"
+#include "diagnostics.h"
+#include "session.h"
+#include "parallel.h"
 
 all_directories_type all_directories;
 inode_to_directory_type inode_to_directory;
@@ -216,7 +221,7 @@ bool extended_directory_action(ext3_dir_entry_2 const& dir_entry, Inode const& i
 	std::cout << "Cannot find a directory block for inode " << dir_entry.inode << ".\n";
       return true;
     }
-    static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+    unsigned char* block_buf = scratch_block(scratch_extended_directory);
     get_block(blocknr2, block_buf);
     ext3_dir_entry_2 const* dir_entry2 = reinterpret_cast<ext3_dir_entry_2 const*>(block_buf);
     ASSERT(dir_entry2->inode == dir_entry.inode);
@@ -260,7 +265,7 @@ bool find_inode_number_of_extended_directory_block(int blocknr, unsigned char* b
     {
       if (inode_from_journal)
 	std::cout << "Extended directory at " << blocknr << " has entries that appear to be directories, but their parent directory inode is not consistent.\n";
-      else
+      else if (diag_report(diag_extended_directory, (uint64_t)blocknr << 2))
       {
 	std::cout << "WARNING: extended directory at " << blocknr << " has entries that appear to be directories, "
 	    "but their parent directory inode is not consistent! I can't make this decision for you. "
@@ -292,9 +297,9 @@ bool find_inode_number_of_extended_directory_block(int blocknr, unsigned char* b
 	// it occurs, the journal is simply more reliable.
 	inode_number = inode_from_journal;
 	// However...
-	if (linked)
+	if (linked && diag_report(diag_extended_directory, (uint64_t)blocknr << 2 | 1))
 	  std::cout << "WARNING: We really only expect that to happen for unlinked directory entries. Have a look at block " << blocknr << '\n';
-	if (inode_to_count.begin()->second > 1)
+	if (inode_to_count.begin()->second > 1 && diag_report(diag_extended_directory, (uint64_t)blocknr << 2 | 2))
 	  std::cout << "WARNING: It's suspiciously weird that there are more than one such \"directories\". Have a look at block " << blocknr << '\n';
       }
       else
@@ -348,7 +353,7 @@ bool find_inode_number_of_extended_directory_block(int blocknr, unsigned char* b
 	{
 	  inode_number = directory_iter->second.inode_number();
 	  std::cout << "Extended directory at " << blocknr << " belongs to inode " << inode_number << '\n';
-	  if (inode_from_journal && inode_from_journal != inode_number)
+	  if (inode_from_journal && inode_from_journal != inode_number && diag_report(diag_extended_directory, (uint64_t)blocknr << 2 | 3))
 	    std::cout << "WARNING: according to the journal it should have been inode " << inode_from_journal << "!?\n";
 	}
       }
@@ -365,6 +370,8 @@ void init_directories(void)
   initialized = true;
 
   DoutEntering(dc::notice, "init_directories()");
+  StatsPhase stats_phase("stage2");
+  TraceSpan trace_span("init_directories");
 
   std::string device_name_basename = device_name.substr(device_name.find_last_of('/') + 1);
   std::string cache_stage2 = device_name_basename + ".ext3grep.stage2";
@@ -449,16 +456,20 @@ void init_directories(void)
     iterate_over_directory__with__init_directories_action();
 #endif
 
+    // Read the first blocks of subdirectories ahead, with the same threads for all of stage 2.
+    BlockPrefetcher prefetcher(true);
+
     // Run over all directory blocks and add all start blocks to all_directories, updating inode_to_directory.
     int last_extended_block_index = root_extended_blocks_size;
     for(int blocknr = root_blocknr;; blocknr = root_extended_blocks[--last_extended_block_index])
     {
+      TraceSpan trace_span("stage2 root block", "block", blocknr);
       // Get the contents of this block of the root directory.
       get_block(blocknr, block_buf);
       // Iterate over all directory blocks.
       int depth_store = commandline_depth;
       commandline_depth = 10000;
-      iterate_over_directory(block_buf, root_blocknr, init_directories_action, &parent, NULL);
+      iterate_over_directory(block_buf, root_blocknr, init_directories_action, &parent, NULL, &prefetcher);
       commandline_depth = depth_store;
       if (last_extended_block_index == 0)
         break;
@@ -484,6 +495,7 @@ void init_directories(void)
 	  for (int j = 0; j < size; ++j)
 	  {
 	    int blocknr = bv[j];
+	    TraceSpan trace_span("stage2 extended block", "block", blocknr);
 	    get_block(blocknr, block_buf);
 
 	    // Add extended directory as DirectoryBlock to the corresponding Directory.
@@ -507,7 +519,7 @@ void init_directories(void)
 	    // Iterate over all directory blocks that we can reach.
 	    int depth_store = commandline_depth;
 	    commandline_depth = 10000;
-	    iterate_over_directory(block_buf, blocknr, init_directories_action, &parent, NULL);
+	    iterate_over_directory(block_buf, blocknr, init_directories_action, &parent, NULL, &prefetcher);
 	    commandline_depth = depth_store;
 	  }
 	  delete [] block_buf;
@@ -542,13 +554,16 @@ void init_directories(void)
       inode_to_directory_type::iterator directory_iter = inode_to_directory.find(inode_number);
       if (directory_iter == inode_to_directory.end())	// Not added already?
       {
-        if (bv.size() == 1)
-	  std::cout << "WARNING: Can't link block";
-        else
-	  std::cout << "WARNING: Can't link blocks";
-	for (size_t j = 0; j < bv.size(); ++j)
-	  std::cout << ' ' << bv[j];
-	std::cout << " to inode " << inode_number << " because that inode cannot be found in the inode_to_directory map. Linking it to lost+found instead!\n";
+	if (diag_report(diag_extended_directory, diag_no_key))
+	{
+	  if (bv.size() == 1)
+	    std::cout << "WARNING: Can't link block";
+	  else
+	    std::cout << "WARNING: Can't link blocks";
+	  for (size_t j = 0; j < bv.size(); ++j)
+	    std::cout << ' ' << bv[j];
+	  std::cout << " to inode " << inode_number << " because that inode cannot be found in the inode_to_directory map. Linking it to lost+found instead!\n";
+	}
 	// FIXME: namespace polution. These should be put in lost+found/inode_number or something.
 	for (size_t j = 0; j < bv.size(); ++j)
 	{
@@ -619,9 +634,8 @@ void init_directories(void)
         break;
       }
     }
-    ASSERT(!dir_inode_to_block_cache);
-    dir_inode_to_block_cache = new blocknr_vector_type [inode_count_ + 1];
-    std::memset(dir_inode_to_block_cache, 0, sizeof(blocknr_vector_type) * (inode_count_ + 1));
+    ASSERT(!dir_inode_to_block_cache_initialized);
+    dir_inode_to_block_cache_initialized = true;
     std::stringstream buf;
     int count = 0;
     while (cache >> inode)
@@ -31,10 +31,13 @@
 #endif
 
 #include "directories.h"
+#include "scratch_memory.h"
 
-typedef std::map<std::string, Directory> all_directories_type;
+typedef std::map<std::string, Directory, std::less<std::string>,
+    scratch_allocator<std::pair<std::string const, Directory> > > all_directories_type;
 extern all_directories_type all_directories;
-typedef std::map<uint32_t, all_directories_type::iterator> inode_to_directory_type;
+typedef std::map<uint32_t, all_directories_type::iterator, std::less<uint32_t>,
+    scratch_allocator<std::pair<uint32_t const, all_directories_type::iterator> > > inode_to_directory_type;
 extern inode_to_directory_type inode_to_directory;
 void init_directories(void);
 
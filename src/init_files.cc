@@ -33,6 +33,8 @@
 #include "globals.h"
 #include "forward_declarations.h"
 #include "journal.h"
+#include "stats.h"
+#include "trace.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -72,6 +74,8 @@ void init_files(void)
   initialized = true;
 
   DoutEntering(dc::notice, "init_files()");
+  StatsPhase stats_phase("init_files");
+  TraceSpan trace_span("init_files");
 
   init_directories();
 
@@ -91,6 +95,7 @@ void init_files(void)
   // Run over all directories.
   for (all_directories_type::iterator directory_iter = all_directories.begin(); directory_iter != all_directories.end(); ++directory_iter)
   {
+    TraceSpan trace_span("init_files directory", "path", directory_iter->first);
     Directory& directory(directory_iter->second);
 
     // Find all non-journal blocks and fill journal_data_map.
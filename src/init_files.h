@@ -29,7 +29,9 @@
 #include <string>
 #endif
 
-typedef std::map<std::string, int> path_to_inode_map_type;
+#include "scratch_memory.h"
+
+typedef std::map<std::string, int, std::less<std::string>, scratch_allocator<std::pair<std::string const, int> > > path_to_inode_map_type;
 extern path_to_inode_map_type path_to_inode_map;
 
 #endif // INIT_FILES_H
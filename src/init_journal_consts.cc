@@ -29,6 +29,7 @@
 #include "globals.h"
 #include "endian_conversion.h"
 #include "inode.h"
+#include "forward_declarations.h"
 
 void init_journal_consts(void)
 {
@@ -40,4 +41,5 @@ void init_journal_consts(void)
   journal_sequence_ = be2le(journal_super_block.s_sequence);
   journal_start_ = be2le(journal_super_block.s_start);
   journal_inode = *get_inode(super_block.s_journal_inum);
+  init_journal_block_map();
 }
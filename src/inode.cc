@@ -33,6 +33,7 @@
 #include "globals.h"
 #include "conversion.h"
 #include "inode.h"
+#include "stats.h"
 
 #if USE_MMAP
 void inode_unmap(int group)
@@ -43,6 +44,7 @@ void inode_unmap(int group)
 
     ASSERT(refs_to_mmap[group] == 0 && nr_mmaps > 0);
     --nr_mmaps;
+    stats_add(stats_inode_unmaps);
     munmap(all_mmaps[group], inodes_per_group_ * inode_size_ + ((char*)all_inodes[group] - (char*)all_mmaps[group]));
     all_inodes[group] = NULL;
   }
@@ -98,8 +100,25 @@ void inode_mmap(int group)
   all_inodes[group] = reinterpret_cast<Inode const*>((char*)all_mmaps[group] + (offset - page_aligned_offset));
   ASSERT(refs_to_mmap[group] == 0);
   ++nr_mmaps;
+  stats_add(stats_inode_mmaps);
 }
 #endif
 
+bool load_all_inode_tables(void)
+{
+#if USE_MMAP
+  if (groups_ > max_mmaps)
+    return false;
+#endif
+  for (int group = 0; group < groups_; ++group)
+  {
+    load_meta_data(group);
+#if USE_MMAP
+    inode_mmap(group);
+#endif
+  }
+  return true;
+}
+
 Inode InodePointer::S_fake_inode;	// This will be filled with zeroes.
 
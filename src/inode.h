@@ -37,6 +37,11 @@ void inode_mmap(int group);
 void inode_unmap(int group);
 #endif
 
+// Load the bitmaps and inode tables of all groups, so that get_inode and is_allocated can be
+// called from several threads at once. Returns false if the inode tables don't all fit in the
+// address space; get_inode may then only be called from one thread.
+bool load_all_inode_tables(void);
+
 class InodePointer {
   private:
     Inode const* M_inode;
@@ -52,7 +57,7 @@ class InodePointer {
     {
 #if USE_MMAP
       if (M_group != -1)
-        refs_to_mmap[M_group]++;
+        __sync_fetch_and_add(&refs_to_mmap[M_group], 1);
 #endif
     }
 
@@ -64,7 +69,7 @@ class InodePointer {
     {
 #if USE_MMAP
       if (M_group != -1)
-        refs_to_mmap[M_group]--;
+        __sync_fetch_and_sub(&refs_to_mmap[M_group], 1);
 #endif
     }
 
@@ -73,12 +78,12 @@ class InodePointer {
       M_inode = inode_reference.M_inode;
 #if USE_MMAP
       if (M_group != -1)
-	refs_to_mmap[M_group]--;
+	__sync_fetch_and_sub(&refs_to_mmap[M_group], 1);
 #endif
       M_group = inode_reference.M_group;
 #if USE_MMAP
       if (M_group != -1)
-	refs_to_mmap[M_group]++;
+	__sync_fetch_and_add(&refs_to_mmap[M_group], 1);
 #endif
       return *this;
     }
@@ -93,7 +98,7 @@ class InodePointer {
     {
       ASSERT(M_group != -1);
 #if USE_MMAP
-      refs_to_mmap[M_group]++;
+      __sync_fetch_and_add(&refs_to_mmap[M_group], 1);
 #endif
     }
 };
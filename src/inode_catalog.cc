@@ -0,0 +1,122 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file inode_catalog.cc Implementation of the columnar inode catalog.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstring>
+#include <algorithm>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "get_block.h"
+#include "scratch_memory.h"
+#include "parallel.h"
+#include "is_blockdetection.h"
+#include "inode_catalog.h"
+#include "stats.h"
+
+InodeCatalog inode_catalog;
+
+namespace {
+
+// Fill the entries of all inodes of one group. Called in parallel; every group writes to its own part of the arrays.
+void scan_group(size_t group, void*)
+{
+  bitmap_t bitmap[EXT3_MAX_BLOCK_SIZE / sizeof(bitmap_t)];
+  get_block(group_descriptor_table[group].bg_inode_bitmap, reinterpret_cast<unsigned char*>(bitmap));
+  int const inodes_per_block = block_size_ / inode_size_;
+  int const table_blocks = (inodes_per_group_ + inodes_per_block - 1) / inodes_per_block;
+  int const chunk_blocks = std::min(table_blocks, std::max(1, scan_chunk_size / block_size_));
+  unsigned char* buf = new unsigned char [chunk_blocks * block_size_];
+  static char const zeroes[sizeof(Inode)] = { 0, };
+  size_t index = group * inodes_per_group_;
+  int bit = 0;
+  for (int block = 0; block < table_blocks; block += chunk_blocks)
+  {
+    int count = std::min(chunk_blocks, table_blocks - block);
+    get_blocks(group_descriptor_table[group].bg_inode_table + block, count, buf);
+    for (int i = 0; i < count * inodes_per_block && bit < inodes_per_group_; ++i, ++bit, ++index)
+    {
+      Inode const& inode(*reinterpret_cast<Inode const*>(buf + i * inode_size_));
+      inode_catalog.mode[index] = inode.mode();
+      inode_catalog.links_count[index] = inode.links_count();
+      inode_catalog.size[index] = inode.size();
+      inode_catalog.atime[index] = inode.atime();
+      inode_catalog.ctime[index] = inode.ctime();
+      inode_catalog.mtime[index] = inode.mtime();
+      inode_catalog.dtime[index] = inode.dtime();
+      inode_catalog.first_block[index] = inode.block()[0];
+      bitmap_ptr bmp = get_bitmap_mask(bit);
+      uint8_t flags = 0;
+      if ((bitmap[bmp.index] & bmp.mask))
+	flags |= catalog_allocated;
+      if (std::memcmp(&inode, zeroes, sizeof(zeroes)) == 0)
+	flags |= catalog_zeroed;
+      if (inode.is_deleted())
+	flags |= catalog_deleted;
+      if (inode.has_valid_dtime())
+	flags |= catalog_valid_dtime;
+      if (is_directory(inode))
+	flags |= catalog_directory;
+      inode_catalog.flags[index] = flags;
+    }
+  }
+  delete [] buf;
+}
+
+} // namespace
+
+void init_inode_catalog(void)
+{
+  if (inode_catalog.count)	// Already built?
+    return;
+  DoutEntering(dc::notice, "init_inode_catalog()");
+  StatsPhase stats_phase("inode_catalog");
+  size_t count = (size_t)groups_ * inodes_per_group_;
+  inode_catalog.mode = static_cast<uint16_t*>(scratch_alloc(count * sizeof(uint16_t)));
+  inode_catalog.links_count = static_cast<uint16_t*>(scratch_alloc(count * sizeof(uint16_t)));
+  inode_catalog.size = static_cast<off_t*>(scratch_alloc(count * sizeof(off_t)));
+  inode_catalog.atime = static_cast<uint32_t*>(scratch_alloc(count * sizeof(uint32_t)));
+  inode_catalog.ctime = static_cast<uint32_t*>(scratch_alloc(count * sizeof(uint32_t)));
+  inode_catalog.mtime = static_cast<uint32_t*>(scratch_alloc(count * sizeof(uint32_t)));
+  inode_catalog.dtime = static_cast<uint32_t*>(scratch_alloc(count * sizeof(uint32_t)));
+  inode_catalog.first_block = static_cast<uint32_t*>(scratch_alloc(count * sizeof(uint32_t)));
+  inode_catalog.flags = static_cast<uint8_t*>(scratch_alloc(count * sizeof(uint8_t)));
+  for_each_parallel(groups_, scan_group, NULL);
+  inode_catalog.count = count;
+}
+
+void catalog_select_flags(size_t begin, size_t end, uint8_t mask, uint8_t value, uint8_t* selected)
+{
+  uint8_t const* flags = inode_catalog.flags + begin;
+  for (size_t i = 0; i < end - begin; ++i)
+    selected[i] &= (flags[i] & mask) == value;
+}
+
+void catalog_select_directories(size_t begin, size_t end, uint8_t* selected)
+{
+  uint16_t const* mode = inode_catalog.mode + begin;
+  for (size_t i = 0; i < end - begin; ++i)
+    selected[i] &= (mode[i] & 0xf000) == 0x4000;
+}
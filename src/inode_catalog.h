@@ -0,0 +1,71 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file inode_catalog.h Declaration of the columnar inode catalog.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INODE_CATALOG_H
+#define INODE_CATALOG_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <stdint.h>
+#include <sys/types.h>
+#endif
+
+// Bits of InodeCatalog::flags.
+enum {
+  catalog_allocated = 1,		// The inode is marked as in use in the inode bitmap.
+  catalog_zeroed = 2,			// The inode (the first 128 bytes) only contains zeroes.
+  catalog_deleted = 4,			// Inode::is_deleted() returned true.
+  catalog_valid_dtime = 8,		// Inode::has_valid_dtime() returned true.
+  catalog_directory = 16		// The inode is a directory.
+};
+
+// The fields of all inodes that are needed by commands that run over every inode,
+// stored as one array per field. The entry of inode number i is at index i - 1.
+struct InodeCatalog {
+  size_t count;				// The number of entries in each array (groups_ * inodes_per_group_).
+  uint16_t* mode;
+  uint16_t* links_count;
+  off_t* size;
+  uint32_t* atime;
+  uint32_t* ctime;
+  uint32_t* mtime;
+  uint32_t* dtime;
+  uint32_t* first_block;		// block()[0].
+  uint8_t* flags;
+};
+
+extern InodeCatalog inode_catalog;
+
+// Fill inode_catalog by reading the inode tables and inode bitmaps of all groups in parallel.
+// Does nothing when the catalog was already built.
+void init_inode_catalog(void);
+
+// The functions below evaluate a predicate for the inodes with index [begin, end) and clear
+// selected[index - begin] for every inode that does not match. They do not branch per inode.
+
+// Keep the inodes for which (flags & mask) == value.
+void catalog_select_flags(size_t begin, size_t end, uint8_t mask, uint8_t value, uint8_t* selected);
+// Keep the directories.
+void catalog_select_directories(size_t begin, size_t end, uint8_t* selected);
+
+#endif // INODE_CATALOG_H
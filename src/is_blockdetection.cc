@@ -24,6 +24,7 @@
 #ifndef USE_PCH
 #include "sys.h"
 #include <sstream>
+#include <pthread.h>
 #include "debug.h"
 #endif
 
@@ -35,12 +36,17 @@
 #include "commandline.h"
 #include "accept.h"
 #include "forward_declarations.h"
+#include "stats.h"
+#include "diagnostics.h"
 
 //-----------------------------------------------------------------------------
 //
 // Block type detection: is_*
 //
 
+// Directory blocks are parsed by several threads at once when stage 2 compares blocks.
+static pthread_mutex_t accepted_filenames_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 bool is_inode(int block)
 {
   int group = block_to_group(super_block, block);
@@ -70,18 +76,6 @@ int inode_to_block(ext3_super_block const& super_block, int inode)
   return group_descriptor_table[group].bg_inode_table + (size_t)(inode - 1 - group * inodes_per_group_) * inode_size_ / block_size_;
 }
 
-struct DelayedWarning {
-  std::ostringstream* delayed_warning;
-
-  DelayedWarning() : delayed_warning(NULL) { }
-  ~DelayedWarning() { if (delayed_warning) delete delayed_warning; }
-
-  void init(void) { if (!delayed_warning) delayed_warning = new std::ostringstream; }
-  operator bool(void) const { return delayed_warning; }
-  std::string str(void) const { ASSERT(delayed_warning); return delayed_warning->str(); }
-  std::ostream& stream(void) { init(); return *delayed_warning; }
-};
-
 // Print string, escaping non ASCII characters.
 void print_buf_to(std::ostream& os, char const* buf, int len)
 {
@@ -119,8 +113,8 @@ void print_buf_to(std::ostream& os, char const* buf, int len)
   }
 }
 
-// Return true if this block looks like it contains a directory.
-is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlockStats& stats, bool start_block, bool certainly_linked, int offset)
+// Return true if the part of this block from offset onwards looks like directory entries.
+static is_directory_type is_directory_at(unsigned char* block, int blocknr, DirectoryBlockStats& stats, bool start_block, bool certainly_linked, int offset)
 {
   ASSERT(!start_block || offset == 0);
   // Must be aligned to 4 bytes.
@@ -155,11 +149,13 @@ is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlock
   // The inode is not overwritten when a directory is deleted (except
   // for the first inode of an extended directory block).
   // So even for deleted directories we can check the inode range.
-  DelayedWarning delayed_warning;
+  // The warning about a zero inode is only printed once the rest of the block is accepted.
+  bool zero_inode_warning = false;
+  bool non_ascii = false;
+  int const entry_offset = offset;
   if (dir_entry->inode == 0 && dir_entry->name_len > 0)
   {
     // If the inode is zero and the filename makes no sense, reject the directory.
-    bool non_ascii = false;
     for (int c = 0; c < dir_entry->name_len; ++c)
     {
       filename_char_type result = is_filename_char(dir_entry->name[c]);
@@ -173,14 +169,7 @@ is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlock
     // the directory though.
     if (certainly_linked && (offset != 0 || start_block) &&
         (blocknr != 4745500 && blocknr != 6546132 && blocknr != 6549681 && blocknr != 6550057 && blocknr != 6582345 && blocknr != 6582333 && blocknr != 6583272))
-    {
-      delayed_warning.stream() << "WARNING: zero inode (name: ";
-      if (non_ascii)
-        delayed_warning.stream() << "*contains non-ASCII characters* ";
-      delayed_warning.stream() << "\"";
-      print_buf_to(delayed_warning.stream(), dir_entry->name, dir_entry->name_len);
-      delayed_warning.stream() << "\"; block: " << blocknr << "; offset 0x" << std::hex << offset << std::dec << ")\n";
-    }
+      zero_inode_warning = true;
   }
   if (dir_entry->inode > inode_count_)
     return isdir_no;	// Inode out of range.
@@ -202,7 +191,7 @@ is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlock
   // The record length must point to the end of the block or chain to it.
   offset += dir_entry->rec_len;
   // NOT USED; int previous_number_of_entries = stats.number_of_entries();
-  if (offset != block_size_ && is_directory(block, blocknr, stats, false, certainly_linked, offset) == isdir_no)
+  if (offset != block_size_ && is_directory_at(block, blocknr, stats, false, certainly_linked, offset) == isdir_no)
     return isdir_no;
   // The file name may only exist of certain characters.
   bool illegal = false;
@@ -251,10 +240,15 @@ is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlock
     ok = false;
   }
 #endif
-  if (ok && delayed_warning)
+  if (ok && zero_inode_warning && diag_report(diag_zero_inode, (uint64_t)blocknr << 16 | entry_offset))
   {
     std::cout << std::flush;
-    std::cerr << delayed_warning.str();
+    std::cerr << "WARNING: zero inode (name: ";
+    if (non_ascii)
+      std::cerr << "*contains non-ASCII characters* ";
+    std::cerr << "\"";
+    print_buf_to(std::cerr, dir_entry->name, dir_entry->name_len);
+    std::cerr << "\"; block: " << blocknr << "; offset 0x" << std::hex << entry_offset << std::dec << ")\n";
     std::cerr << std::flush;
   }
   if (!ok && !illegal)
@@ -262,6 +256,7 @@ is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlock
     std::ostringstream escaped_name;
     print_buf_to(escaped_name, dir_entry->name, dir_entry->name_len);
     Accept const accept(escaped_name.str(), false);
+    pthread_mutex_lock(&accepted_filenames_mutex);
     std::set<Accept>::iterator accept_iter = accepted_filenames.find(accept);
     if (accept_iter != accepted_filenames.end())
       ok = accept_iter->accepted();
@@ -269,22 +264,34 @@ is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlock
     {
       // Add this entry to avoid us printing this again.
       accepted_filenames.insert(accept);
-      std::cout << std::flush;
-      if (certainly_linked)
-	std::cerr << "\nWARNING: Rejecting possible directory (block " << blocknr << ") because an entry contains legal but unlikely characters.\n";
-      else // Aparently we're looking for deleted entries.
-	std::cerr << "\nWARNING: Rejecting a dir_entry (block " << blocknr << ") because it contains legal but unlikely characters.\n";
-      std::cerr     << "         Use --ls --block " << blocknr << " to examine this possible directory block.\n";
-      std::cerr     << "         If it looks like a directory to you, and '" << escaped_name.str() << "'\n";
-      std::cerr     << "         looks like a filename that might belong in that directory, then add\n";
-      std::cerr     << "         --accept='" << escaped_name.str() << "' as commandline parameter AND remove both stage* files!" << std::endl;
+      if (diag_report(diag_unlikely_characters, diag_no_key))
+      {
+	std::cout << std::flush;
+	if (certainly_linked)
+	  std::cerr << "\nWARNING: Rejecting possible directory (block " << blocknr << ") because an entry contains legal but unlikely characters.\n";
+	else // Aparently we're looking for deleted entries.
+	  std::cerr << "\nWARNING: Rejecting a dir_entry (block " << blocknr << ") because it contains legal but unlikely characters.\n";
+	std::cerr     << "         Use --ls --block " << blocknr << " to examine this possible directory block.\n";
+	std::cerr     << "         If it looks like a directory to you, and '" << escaped_name.str() << "'\n";
+	std::cerr     << "         looks like a filename that might belong in that directory, then add\n";
+	std::cerr     << "         --accept='" << escaped_name.str() << "' as commandline parameter AND remove both stage* files!" << std::endl;
+      }
     }
+    pthread_mutex_unlock(&accepted_filenames_mutex);
   }
   if (ok)
     stats.increment_number_of_entries();
   return ok ? (is_start ? isdir_start : isdir_extended) : isdir_no;
 }
 
+// Return true if this block looks like it contains a directory.
+is_directory_type is_directory(unsigned char* block, int blocknr, DirectoryBlockStats& stats, bool start_block, bool certainly_linked, int offset)
+{
+  is_directory_type result = is_directory_at(block, blocknr, stats, start_block, certainly_linked, offset);
+  stats_add(result == isdir_no ? stats_is_directory_no : (result == isdir_start ? stats_is_directory_start : stats_is_directory_extended));
+  return result;
+}
+
 // Returns true if the block is inside an inode table,
 // or part of the journal, containing inodes.
 int is_inode_block(int block)
@@ -24,7 +24,11 @@
 #ifndef USE_PCH
 #include "sys.h"
 #include <stdint.h>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include "ext3.h"
 #include "debug.h"
 #endif
@@ -37,6 +41,11 @@
 #include "indirect_blocks.h"
 #include "get_block.h"
 #include "commandline.h"
+#include "parallel.h"
+#include "stats.h"
+#include "trace.h"
+#include "output.h"
+#include "session.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -76,6 +85,7 @@ class DescriptorTag : public Descriptor {
         Descriptor(block, sequence), M_blocknr(be2le(block_tag->t_blocknr)), M_flags(be2le(block_tag->t_flags)) { }
     virtual descriptor_type_nt descriptor_type(void) const { return dt_tag; }
     virtual void print_blocks(void) const;
+    virtual void output_blocks(char const* state) const;
     virtual void add_block_descriptors(void) { add_block_descriptor(M_blocknr, this); add_block_in_journal_descriptor(this); }
     uint32_t block(void) const { return M_blocknr; }
 };
@@ -103,6 +113,11 @@ void DescriptorTag::print_blocks(void) const
   }
 }
 
+void DescriptorTag::output_blocks(char const* state) const
+{
+  output_record(OutputRecord("journal_tag").sequence(sequence()).journal_block(Descriptor::block()).block(M_blocknr).state(state));
+}
+
 class DescriptorRevoke : public Descriptor {
   private:
     std::vector<uint32_t> M_blocks;
@@ -110,6 +125,7 @@ class DescriptorRevoke : public Descriptor {
     DescriptorRevoke(uint32_t block, uint32_t sequence, journal_revoke_header_t* revoke_header);
     virtual descriptor_type_nt descriptor_type(void) const { return dt_revoke; }
     virtual void print_blocks(void) const;
+    virtual void output_blocks(char const* state) const;
     virtual void add_block_descriptors(void);
 };
 
@@ -138,11 +154,19 @@ void DescriptorRevoke::print_blocks(void) const
     std::cout << ' ' << *iter;
 }
 
+void DescriptorRevoke::output_blocks(char const* state) const
+{
+  for (std::vector<uint32_t>::const_iterator iter = M_blocks.begin(); iter != M_blocks.end(); ++iter)
+    output_record(OutputRecord("journal_revoke").sequence(sequence()).journal_block(block()).block(*iter).state(state));
+}
+
 class DescriptorCommit : public Descriptor {
   public:
     DescriptorCommit(uint32_t block, uint32_t sequence) : Descriptor(block, sequence) { }
     virtual descriptor_type_nt descriptor_type(void) const { return dt_commit; }
     virtual void print_blocks(void) const { }
+    virtual void output_blocks(char const* state) const
+        { output_record(OutputRecord("journal_commit").sequence(sequence()).journal_block(block()).state(state)); }
     virtual void add_block_descriptors(void) { add_block_in_journal_descriptor(this); };
 };
 
@@ -180,6 +204,12 @@ bool Transaction::contains_tag_for_block(int block)
 
 void Transaction::print_descriptors(void) const
 {
+  if (output_format != output_text)
+  {
+    for (std::vector<Descriptor*>::const_iterator iter = M_descriptor.begin(); iter != M_descriptor.end(); ++iter)
+      (*iter)->output_blocks(M_committed ? "committed" : "uncommitted");
+    return;
+  }
   descriptor_type_nt dt = dt_unknown;
   for (std::vector<Descriptor*>::const_iterator iter = M_descriptor.begin(); iter != M_descriptor.end(); ++iter)
   {
@@ -250,70 +280,127 @@ uint32_t find_largest_journal_sequence_number(int block)
   return (*iter->second.rbegin())->sequence();
 }
 
-bool action_tag_count(uint32_t, uint32_t sequence, journal_block_tag_t*, void*)
-{
-  min_sequence = std::min(sequence, min_sequence);
-  max_sequence = std::max(sequence, max_sequence);
-  ++number_of_descriptors;
-  return false;
-}
+struct AllDescriptorsPred {
+  bool operator()(Descriptor* d1, Descriptor* d2) const { return d1->sequence() < d2->sequence(); }
+};
+
+static int smallest_block_nr;
+static int largest_block_nr;
+static bitmap_t* journal_block_bitmap = NULL;
+static int min_journal_block;
+static int max_journal_block;		// One more than largest block belonging to the journal.
+static bitmap_t* is_indirect_block_in_journal_bitmap = NULL;
+
+// Reads blocks of the journal in large sequential chunks.
+class JournalReader {
+  private:
+    unsigned char* M_buf;
+    int M_first;		// The first block in M_buf.
+    int M_count;		// The number of blocks in M_buf.
+  public:
+    JournalReader(void) : M_buf(NULL), M_first(0), M_count(0) { }
+    ~JournalReader() { delete [] M_buf; }
+
+    // Return a pointer to the contents of blocknr, which is valid until the next call.
+    unsigned char const* get_block(int blocknr);
+};
 
-bool action_revoke_count(uint32_t, uint32_t sequence, journal_revoke_header_t*, void*)
+// The number of bytes that JournalReader reads at once.
+static int const journal_chunk_size = 1024 * 1024;
+
+unsigned char const* JournalReader::get_block(int blocknr)
 {
-  min_sequence = std::min(sequence, min_sequence);
-  max_sequence = std::max(sequence, max_sequence);
-  ++number_of_descriptors;
-  return false;
+  if (blocknr < M_first || blocknr >= M_first + M_count)
+  {
+    if (!M_buf)
+      M_buf = new unsigned char [journal_chunk_size];
+    M_first = blocknr;
+    M_count = std::max(1, std::min(journal_chunk_size / block_size_, std::min(max_journal_block, block_count(super_block)) - blocknr));
+    get_blocks(M_first, M_count, M_buf);
+  }
+  return M_buf + (blocknr - M_first) * block_size_;
 }
 
-bool action_commit_count(uint32_t, uint32_t sequence, void*)
+static JournalReader journal_reader;
+
+// One version of an inode table block in the journal. The inodes themselves are
+// not copied; they are read from the journal block when they are looked up.
+struct JournalInodeBlockVersion {
+  uint32_t first_inode;		// The inode number of the first inode in the block.
+  uint32_t sequence;		// The sequence number of the transaction.
+  uint32_t journal_block;	// The block in the journal that contains the copy.
+};
+
+struct JournalInodeBlockVersionPred {
+  bool operator()(JournalInodeBlockVersion const& v1, JournalInodeBlockVersion const& v2) const { return v1.first_inode < v2.first_inode; }
+};
+
+// All versions of all inode table blocks in the journal, sorted by first inode number
+// and then by descending sequence number.
+static std::vector<JournalInodeBlockVersion> journal_inode_index;
+
+// The time stamps in a copy of an inode table block in the journal,
+// and copies of the directory inodes in it that aren't deleted.
+struct JournalInodeBlock {
+  __le32 lasttime;
+  std::vector<std::pair<int, Inode> > directories;	// Index in the block and copy of the inode.
+};
+
+typedef std::map<Descriptor*, JournalInodeBlock> journal_inode_blocks_type;
+
+static void add_descriptor(Descriptor* descriptor)
 {
-  min_sequence = std::min(sequence, min_sequence);
-  max_sequence = std::max(sequence, max_sequence);
+  min_sequence = std::min(descriptor->sequence(), min_sequence);
+  max_sequence = std::max(descriptor->sequence(), max_sequence);
   ++number_of_descriptors;
-  return false;
+  stats_add(stats_journal_descriptors);
+  all_descriptors.push_back(descriptor);
 }
 
-void count_descriptors(void)
+// Scan the inode table block that tag refers to while it is still in the journal_reader buffer.
+static void scan_journal_inode_block(DescriptorTag* tag, JournalInodeBlock& inode_block)
 {
-  number_of_descriptors = 0;
-  min_sequence = 0xffffffff;
-  max_sequence = 0;
-  iterate_over_journal(action_tag_count, action_revoke_count, action_commit_count, NULL);
+  Inode const* inode = reinterpret_cast<Inode const*>(journal_reader.get_block(tag->Descriptor::block()));
+  __le32 lasttime = 0;
+  for (unsigned int i = 0; i < block_size_ / sizeof(Inode); i += inode_size_ / sizeof(Inode))
+  {
+    if (inode[i].atime() > lasttime || lasttime == 0)
+      lasttime = inode[i].atime(); 
+    if (inode[i].ctime() > lasttime)
+      lasttime = inode[i].ctime();
+    if (inode[i].mtime() > lasttime)
+      lasttime = inode[i].mtime();
+    if (inode[i].dtime() > lasttime)
+      lasttime = inode[i].dtime();
+    if (is_directory(inode[i]) && !inode[i].is_deleted())
+      inode_block.directories.push_back(std::pair<int, Inode>(i / (inode_size_ / sizeof(Inode)), inode[i]));
+  }
+  inode_block.lasttime = lasttime;
 }
 
 bool action_tag_fill(uint32_t block, uint32_t sequence, journal_block_tag_t* block_tag, void* data)
 {
-  uint32_t& descriptor_count = *reinterpret_cast<uint32_t*>(data);
-  all_descriptors[descriptor_count++] = new DescriptorTag(block, sequence, block_tag);
+  journal_inode_blocks_type& inode_blocks = *reinterpret_cast<journal_inode_blocks_type*>(data);
+  DescriptorTag* descriptor = new DescriptorTag(block, sequence, block_tag);
+  add_descriptor(descriptor);
+  uint32_t block_nr = descriptor->block();
+  if (is_block_number(block_nr) && is_inode(block_nr))
+    scan_journal_inode_block(descriptor, inode_blocks[descriptor]);
   return false;
 }
 
-bool action_revoke_fill(uint32_t block, uint32_t sequence, journal_revoke_header_t* revoke_header, void* data)
+bool action_revoke_fill(uint32_t block, uint32_t sequence, journal_revoke_header_t* revoke_header, void*)
 {
-  uint32_t& descriptor_count = *reinterpret_cast<uint32_t*>(data);
-  all_descriptors[descriptor_count++] = new DescriptorRevoke(block, sequence, revoke_header);
+  add_descriptor(new DescriptorRevoke(block, sequence, revoke_header));
   return false;
 }
 
-bool action_commit_fill(uint32_t block, uint32_t sequence, void* data)
+bool action_commit_fill(uint32_t block, uint32_t sequence, void*)
 {
-  uint32_t& descriptor_count = *reinterpret_cast<uint32_t*>(data);
-  all_descriptors[descriptor_count++] = new DescriptorCommit(block, sequence);
+  add_descriptor(new DescriptorCommit(block, sequence));
   return false;
 }
 
-struct AllDescriptorsPred {
-  bool operator()(Descriptor* d1, Descriptor* d2) const { return d1->sequence() < d2->sequence(); }
-};
-
-static int smallest_block_nr;
-static int largest_block_nr;
-static bitmap_t* journal_block_bitmap = NULL;
-static int min_journal_block;
-static int max_journal_block;		// One more than largest block belonging to the journal.
-static bitmap_t* is_indirect_block_in_journal_bitmap = NULL;
-
 void find_blocknr_range_action(int blocknr, int, void*)
 {
   if (blocknr > largest_block_nr)
@@ -346,23 +433,48 @@ void indirect_journal_block_action(int blocknr, int, void*)
 void iterate_over_all_blocks_of__with__indirect_journal_block_action(void) { indirect_journal_block_action(0, 0, NULL); }
 #endif
 
+// A copy of a non-deleted directory inode in the journal.
+struct JournalDirectoryInode {
+  Inode const* inode;			// Points into JournalInodeBlock::directories.
+  int inode_number;
+  uint32_t journal_block;		// The block in the journal that contains the copy.
+  std::vector<int> blocks;		// The blocks of the directory, filled by directory_inode_action.
+  bool reused_or_corrupted_indirect_block;
+};
+
+// Called from several threads at once, but each with its own JournalDirectoryInode.
 void directory_inode_action(int blocknr, int, void* data)
 {
-  int inode_number = *reinterpret_cast<int*>(data);
-  block_to_dir_inode_map_type::iterator iter = block_to_dir_inode_map.find(blocknr);
-  if (iter == block_to_dir_inode_map.end())
-    block_to_dir_inode_map.insert(block_to_dir_inode_map_type::value_type(blocknr, inode_number));
-  else
-    iter->second = inode_number;	// We're called with ascending sequence numbers. Therefore, keep the last.
+  JournalDirectoryInode& directory_inode(*reinterpret_cast<JournalDirectoryInode*>(data));
+  directory_inode.blocks.push_back(blocknr);
 }
 
 #ifdef CPPGRAPH
 void iterate_over_all_blocks_of__with__directory_inode_action(void) { directory_inode_action(0, 0, NULL); }
 #endif
 
+static void expand_journal_directory_inode(size_t index, void* data)
+{
+  JournalDirectoryInode& directory_inode((*reinterpret_cast<std::vector<JournalDirectoryInode>*>(data))[index]);
+#ifdef CPPGRAPH
+  // Tell cppgraph that we call directory_inode_action from here.
+  iterate_over_all_blocks_of__with__directory_inode_action();
+#endif
+  // Run over all blocks of the directory inode.
+  directory_inode.reused_or_corrupted_indirect_block =
+      iterate_over_all_blocks_of(*directory_inode.inode, directory_inode.inode_number, directory_inode_action, &directory_inode);
+}
+
 void init_journal(void)
 {
+  static bool initialized = false;
+  if (initialized)
+    return;
+  initialized = true;
+
   DoutEntering(dc::notice, "init_journal()");
+  StatsPhase stats_phase("journal");
+  TraceSpan trace_span("init_journal");
 
   // Determine which blocks belong to the journal.
   ASSERT(is_allocated(super_block.s_journal_inum));	// Maybe this is the way to detect external journals?
@@ -404,11 +516,12 @@ void init_journal(void)
   // Initialize the Descriptors.
   std::cout << "Loading journal descriptors..." << std::flush;
   wrapped_journal_sequence = 0;
-  count_descriptors();
+  number_of_descriptors = 0;
+  min_sequence = 0xffffffff;
+  max_sequence = 0;
   all_descriptors.clear();
-  all_descriptors.resize(number_of_descriptors);
-  uint32_t descriptor_count = 0;
-  iterate_over_journal(action_tag_fill, action_revoke_fill, action_commit_fill, &descriptor_count);
+  journal_inode_blocks_type inode_blocks;
+  iterate_over_journal(action_tag_fill, action_revoke_fill, action_commit_fill, &inode_blocks);
   ASSERT(all_descriptors.size() == number_of_descriptors);
   ASSERT(number_of_descriptors == 0 || all_descriptors[number_of_descriptors - 1]->descriptor_type() != dt_unknown);
   // Sort the descriptors in ascending sequence number.
@@ -440,10 +553,9 @@ void init_journal(void)
 	break;
     }
   }
-  static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
-  Inode const* inode = reinterpret_cast<Inode const*>(block_buf);
   // Run over all descriptors, in increasing sequence number.
   time_t oldtime = 0;
+  std::vector<JournalDirectoryInode> directory_inodes;
   for (std::vector<Descriptor*>::iterator iter = all_descriptors.begin(); iter != all_descriptors.end(); ++iter)
   {
     // Skip non-tags.
@@ -462,42 +574,18 @@ void init_journal(void)
     }
     if (is_inode(block_nr))
     {
-      int inode_number = block_to_inode(block_nr);
-      // Run over all inodes in the journal block.
-      get_block(tag->Descriptor::block(), block_buf);
-      __le32 lasttime = 0;
-      for (unsigned int i = 0; i < block_size_ / sizeof(Inode); i += inode_size_ / sizeof(Inode), ++inode_number)
+      // The inode block was already scanned by action_tag_fill.
+      JournalInodeBlock& inode_block(inode_blocks[tag]);
+      int first_inode = block_to_inode(block_nr);
+      for (std::vector<std::pair<int, Inode> >::iterator directory = inode_block.directories.begin();
+          directory != inode_block.directories.end(); ++directory)
       {
-        // REMOVE THIS:
-	// print the inode number:
-	//std::cout << "INODE IN JOURNAL: " << inode_number << std::endl;
-	if (inode[i].atime() > lasttime || lasttime == 0)
-	  lasttime = inode[i].atime(); 
-	if (inode[i].ctime() > lasttime)
-	  lasttime = inode[i].ctime();
-	if (inode[i].mtime() > lasttime)
-	  lasttime = inode[i].mtime();
-	if (inode[i].dtime() > lasttime)
-	  lasttime = inode[i].dtime();
-
-        // Skip non-directories.
-	if (!is_directory(inode[i]))
-	  continue;
-        // Skip deleted inodes.
-        if (inode[i].is_deleted())
-	  continue;
-#ifdef CPPGRAPH
-        // Tell cppgraph that we call directory_inode_action from here.
-        iterate_over_all_blocks_of__with__directory_inode_action();
-#endif
-	// Run over all blocks of the directory inode.
-	bool reused_or_corrupted_indirect_block7 = iterate_over_all_blocks_of(inode[i], inode_number, directory_inode_action, &inode_number);
-	if (reused_or_corrupted_indirect_block7)
-	{
-	  std::cout << "Note: Block " << tag->Descriptor::block() << " in the journal contains a copy of inode " << inode_number <<
-	      " which is a directory, but this directory has reused or corrupted (double/triple) indirect blocks.\n";
-	}
+	directory_inodes.push_back(JournalDirectoryInode());
+	directory_inodes.back().inode = &directory->second;
+	directory_inodes.back().inode_number = first_inode + directory->first;
+	directory_inodes.back().journal_block = tag->Descriptor::block();
       }
+      __le32 lasttime = inode_block.lasttime;
       // Normally a lasttime != 0 should do. But I ran into a case where the supposedly inode block
       // didn't contain inodes at all, but block numbers?! Therefore, check that lasttime > inode_count_,
       // which will be the case in 99.999% of the cases for a real time_t.
@@ -505,6 +593,34 @@ void init_journal(void)
 	oldtime = __le32_to_cpu(lasttime);
     }
   }
+  // Reading the (double/triple) indirect blocks of the directories is done in parallel.
+  for_each_parallel(directory_inodes.size(), expand_journal_directory_inode, &directory_inodes);
+  // Merge the results in increasing sequence number, so that the last one wins.
+  for (std::vector<JournalDirectoryInode>::iterator iter = directory_inodes.begin(); iter != directory_inodes.end(); ++iter)
+  {
+    if (iter->reused_or_corrupted_indirect_block)
+    {
+      std::cout << "Note: Block " << iter->journal_block << " in the journal contains a copy of inode " << iter->inode_number <<
+	  " which is a directory, but this directory has reused or corrupted (double/triple) indirect blocks.\n";
+    }
+    for (std::vector<int>::iterator block_iter = iter->blocks.begin(); block_iter != iter->blocks.end(); ++block_iter)
+      block_to_dir_inode_map[*block_iter] = iter->inode_number;
+  }
+  // Index all versions of all inodes in the journal, for get_inodes_from_journal.
+  journal_inode_index.clear();
+  for (std::vector<Descriptor*>::reverse_iterator iter = all_descriptors.rbegin(); iter != all_descriptors.rend(); ++iter)
+  {
+    journal_inode_blocks_type::iterator inode_block_iter = inode_blocks.find(*iter);
+    if (inode_block_iter == inode_blocks.end())
+      continue;
+    JournalInodeBlockVersion version;
+    version.first_inode = block_to_inode(static_cast<DescriptorTag*>(*iter)->block());
+    version.sequence = (*iter)->sequence();
+    version.journal_block = (*iter)->Descriptor::block();
+    journal_inode_index.push_back(version);
+  }
+  // A stable sort keeps the versions of each block in descending sequence number.
+  std::stable_sort(journal_inode_index.begin(), journal_inode_index.end(), JournalInodeBlockVersionPred());
   std::cout << " done\n";
   std::cout << "The oldest inode block that is still in the journal, appears to be from " << oldtime << " = " << std::ctime(&oldtime);
   if (wrapped_journal_sequence)
@@ -560,40 +676,82 @@ int journal_block_contains_inodes(int blocknr)
   return is_inode(descriptor_tag.block()) ? descriptor_tag.block() : 0;
 }
 
-// This is the only function that accepts "journal block numbers",
-// as opposed to "file system block numbers".
-int journal_block_to_real_block(int blocknr)
+// A range of consecutive journal blocks that are also consecutive in the file system.
+// Journals are almost always contiguous, so usually there is just one of these.
+struct JournalExtent {
+  int logical;		// The journal block number of the first block.
+  int physical;		// The file system block number of the first block.
+  int length;		// The number of blocks.
+};
+
+static std::vector<JournalExtent> journal_extents;
+
+static void add_journal_block(int blocknr, int real_blocknr)
 {
-  static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
-  ASSERT(blocknr >= 0 && blocknr < journal_maxlen_);
-  if (blocknr < 12)
-    return journal_inode.block()[blocknr];
-  blocknr -= 12;
-  int const vpb = block_size_ / sizeof(__le32);	// Values Per Block.
-  if (blocknr < vpb)
+  if (!journal_extents.empty())
   {
-    get_block(journal_inode.block()[EXT3_IND_BLOCK], block_buf);
-    __le32* indirect_block = reinterpret_cast<__le32*>(block_buf);
-    return indirect_block[blocknr];
+    JournalExtent& last(journal_extents.back());
+    if (last.physical + last.length == real_blocknr)
+    {
+      ++last.length;
+      return;
+    }
   }
-  blocknr -= vpb;
-  if (blocknr < vpb * vpb)
+  JournalExtent extent;
+  extent.logical = blocknr;
+  extent.physical = real_blocknr;
+  extent.length = 1;
+  journal_extents.push_back(extent);
+}
+
+static void add_indirect_journal_blocks(int indirect_blocknr, int level, int& blocknr)
+{
+  unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  get_block(indirect_blocknr, block_buf);
+  __le32* indirect_block = reinterpret_cast<__le32*>(block_buf);
+  int const vpb = block_size_ / sizeof(__le32);	// Values Per Block.
+  for (int i = 0; i < vpb && blocknr < journal_maxlen_; ++i)
   {
-    get_block(journal_inode.block()[EXT3_DIND_BLOCK], block_buf);
-    __le32* double_indirect_block = reinterpret_cast<__le32*>(block_buf);
-    get_block(double_indirect_block[blocknr / vpb], block_buf);
-    __le32* indirect_block = reinterpret_cast<__le32*>(block_buf);
-    return indirect_block[blocknr % vpb];
+    if (level == 1)
+      add_journal_block(blocknr++, indirect_block[i]);
+    else
+      add_indirect_journal_blocks(indirect_block[i], level - 1, blocknr);
   }
-  blocknr -= vpb * vpb;
-  ASSERT(blocknr < vpb * vpb * vpb);
-  get_block(journal_inode.block()[EXT3_TIND_BLOCK], block_buf);
-  __le32* tripple_indirect_block = reinterpret_cast<__le32*>(block_buf);
-  get_block(tripple_indirect_block[blocknr / (vpb * vpb)], block_buf);
-  __le32* double_indirect_block = reinterpret_cast<__le32*>(block_buf);
-  get_block(double_indirect_block[(blocknr / vpb) % vpb], block_buf);
-  __le32* indirect_block = reinterpret_cast<__le32*>(block_buf);
-  return indirect_block[blocknr % vpb];
+}
+
+// Read the (double and tripple) indirect blocks of the journal inode once,
+// so that journal_block_to_real_block doesn't have to.
+void init_journal_block_map(void)
+{
+  journal_extents.clear();
+  int blocknr = 0;
+  for (; blocknr < EXT3_NDIR_BLOCKS && blocknr < journal_maxlen_; ++blocknr)
+    add_journal_block(blocknr, journal_inode.block()[blocknr]);
+  if (blocknr < journal_maxlen_)
+    add_indirect_journal_blocks(journal_inode.block()[EXT3_IND_BLOCK], 1, blocknr);
+  if (blocknr < journal_maxlen_)
+    add_indirect_journal_blocks(journal_inode.block()[EXT3_DIND_BLOCK], 2, blocknr);
+  if (blocknr < journal_maxlen_)
+    add_indirect_journal_blocks(journal_inode.block()[EXT3_TIND_BLOCK], 3, blocknr);
+  Dout(dc::notice, "The journal consists of " << journal_extents.size() << " extent(s).");
+}
+
+static bool journal_extent_less(int blocknr, JournalExtent const& extent)
+{
+  return blocknr < extent.logical;
+}
+
+// This is the only function that accepts "journal block numbers",
+// as opposed to "file system block numbers".
+int journal_block_to_real_block(int blocknr)
+{
+  ASSERT(blocknr >= 0 && blocknr < journal_maxlen_);
+  ASSERT(!journal_extents.empty());
+  // Find the last extent that starts at or before blocknr.
+  std::vector<JournalExtent>::const_iterator iter =
+      std::upper_bound(journal_extents.begin(), journal_extents.end(), blocknr, journal_extent_less);
+  --iter;
+  return iter->physical + (blocknr - iter->logical);
 }
 
 void iterate_over_journal(
@@ -603,12 +761,14 @@ void iterate_over_journal(
     void* data)
 {
   uint32_t jbn = be2le(journal_super_block.s_first);
-  static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  unsigned char* block_buf = scratch_block(scratch_iterate_over_journal);
   while(jbn < (uint32_t)journal_maxlen_)
   {
     // bn is the real block number inside the journal.
     uint32_t bn = journal_block_to_real_block(jbn);
-    unsigned char* block = get_block(bn, block_buf);
+    // Copy the block, because the actions may use journal_reader too.
+    unsigned char* block = block_buf;
+    std::memcpy(block, journal_reader.get_block(bn), block_size_);
     journal_header_t* descriptor = reinterpret_cast<journal_header_t*>(block);
     if (be2le(descriptor->h_magic) == JFS_MAGIC_NUMBER)
     {
@@ -741,23 +901,17 @@ void handle_commandline_journal_transaction(void)
 
 void get_inodes_from_journal(int inode, std::vector<std::pair<int, Inode> >& inodes)
 {
-  uint32_t block = inode_to_block(super_block, inode);
-  int offset = (inode - block_to_inode(block)) * inode_size_;
-  block_to_descriptors_map_type::iterator descriptors_iter = block_to_descriptors_map.find(block);
-  if (descriptors_iter != block_to_descriptors_map.end())
+  // The inode tables start at the first inode of a group, and a group has a whole number of inode table blocks.
+  int const inodes_per_block = block_size_ / inode_size_;
+  int index = (inode - 1) % inodes_per_block;
+  JournalInodeBlockVersion key;
+  key.first_inode = inode - index;
+  std::pair<std::vector<JournalInodeBlockVersion>::iterator, std::vector<JournalInodeBlockVersion>::iterator> range =
+      std::equal_range(journal_inode_index.begin(), journal_inode_index.end(), key, JournalInodeBlockVersionPred());
+  unsigned char* block_buf = scratch_block(scratch_journal_inodes);
+  for (std::vector<JournalInodeBlockVersion>::iterator iter = range.first; iter != range.second; ++iter)
   {
-    std::vector<Descriptor*>& descriptors(descriptors_iter->second);
-    for (std::vector<Descriptor*>::reverse_iterator descriptor_iter = descriptors.rbegin(); descriptor_iter != descriptors.rend(); ++descriptor_iter)
-    {
-      Descriptor& descriptor(**descriptor_iter);
-      if (descriptor.descriptor_type() != dt_tag)
-        continue;
-      DescriptorTag& tag(static_cast<DescriptorTag&>(descriptor));
-      ASSERT(tag.block() == block);
-      static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
-      get_block(descriptor.block(), block_buf);
-      Inode const* inode_ptr = reinterpret_cast<Inode const*>(block_buf + offset);
-      inodes.push_back(std::pair<int, Inode>(descriptor.sequence(), *inode_ptr));
-    }
+    get_block(iter->journal_block, block_buf);
+    inodes.push_back(std::pair<int, Inode>(iter->sequence, *reinterpret_cast<Inode const*>(block_buf + index * inode_size_)));
   }
 }
@@ -47,6 +47,7 @@ class Descriptor {
     uint32_t sequence(void) const { return M_sequence; }
     virtual descriptor_type_nt descriptor_type(void) const = 0;
     virtual void print_blocks(void) const = 0;
+    virtual void output_blocks(char const* state) const = 0;	// Like print_blocks, for --format.
     virtual void add_block_descriptors(void) = 0;
   protected:
     virtual ~Descriptor() { }
@@ -0,0 +1,215 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file microbench.cc Implementation of --microbench.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <stdint.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "superblock.h"
+#include "bitmap.h"
+#include "load_meta_data.h"
+#include "is_blockdetection.h"
+#include "forward_declarations.h"
+#include "indirect_blocks.h"
+#include "blocknr_vector_type.h"
+#include "utils.h"
+#include "block_corpus.h"
+#include "microbench.h"
+
+namespace {
+
+int const repetitions = 15;
+
+// The string that mkext3image writes into some of the files of its images.
+char const search_pattern[] = "ext3grep-bench-needle";
+
+// A kernel runs once over all blocks of class 'cls' of the corpus and returns the
+// number of blocks (or entries) that it found, which must be the same for every run.
+typedef size_t (*kernel_type)(BlockCorpus& corpus, int cls);
+
+size_t is_directory_kernel(BlockCorpus& corpus, int cls)
+{
+  size_t found = 0;
+  for (size_t i = 0; i < corpus.blocknr[cls].size(); ++i)
+  {
+    DirectoryBlockStats stats;
+    if (is_directory(corpus.block(cls, i), corpus.blocknr[cls][i], stats, false) != isdir_no)
+      ++found;
+  }
+  return found;
+}
+
+bool count_dir_entry_action(ext3_dir_entry_2 const&, Inode const&, bool, bool, bool, bool, bool, bool, Parent*, void* data)
+{
+  ++*static_cast<size_t*>(data);
+  return false;
+}
+
+size_t iterate_over_directory_kernel(BlockCorpus& corpus, int cls)
+{
+  size_t found = 0;
+  for (size_t i = 0; i < corpus.blocknr[cls].size(); ++i)
+    iterate_over_directory(corpus.block(cls, i), corpus.blocknr[cls][i], count_dir_entry_action, NULL, &found);
+  return found;
+}
+
+size_t is_indirect_block_kernel(BlockCorpus& corpus, int cls)
+{
+  size_t found = 0;
+  for (size_t i = 0; i < corpus.blocknr[cls].size(); ++i)
+    if (is_indirect_block(corpus.block(cls, i)))
+      ++found;
+  return found;
+}
+
+size_t search_kernel(BlockCorpus& corpus, int cls)
+{
+  size_t found = 0;
+  for (size_t i = 0; i < corpus.blocknr[cls].size(); ++i)
+    if (search_block(corpus.block(cls, i), search_pattern, sizeof(search_pattern) - 1, false))
+      ++found;
+  return found;
+}
+
+// The loop over the block bitmap of --search, over all blocks of the file system.
+size_t block_bitmap_kernel(BlockCorpus&, int)
+{
+  size_t found = 0;
+  for (int group = 0; group < groups_; ++group)
+  {
+    int first_block = first_data_block(super_block) + group * blocks_per_group(super_block);
+    int last_block = std::min(first_block + blocks_per_group(super_block), block_count(super_block));
+    unsigned int bit = 0;
+    for (int block = first_block; block < last_block; ++block, ++bit)
+    {
+      bitmap_ptr bmp = get_bitmap_mask(bit);
+      if ((block_bitmap[group][bmp.index] & bmp.mask))
+	++found;
+    }
+  }
+  return found;
+}
+
+// Add the block numbers of all classes to 64 vectors, read them back and remove them again.
+size_t blocknr_vector_kernel(BlockCorpus& corpus, int)
+{
+  static int const number_of_vectors = 64;
+  blocknr_vector_type vectors[number_of_vectors];
+  std::memset(vectors, 0, sizeof(vectors));
+  for (int cls = 0; cls < corpus_classes; ++cls)
+    for (std::vector<uint32_t>::iterator iter = corpus.blocknr[cls].begin(); iter != corpus.blocknr[cls].end(); ++iter)
+      vectors[*iter % number_of_vectors].push_back(*iter);
+  size_t found = 0;
+  for (int v = 0; v < number_of_vectors; ++v)
+  {
+    if (vectors[v].empty())
+      continue;
+    uint32_t const size = vectors[v].size();
+    for (uint32_t j = 0; j < size; ++j)
+      found += (vectors[v][j] % number_of_vectors == (uint32_t)v);
+  }
+  for (int cls = 0; cls < corpus_classes; ++cls)
+    for (std::vector<uint32_t>::iterator iter = corpus.blocknr[cls].begin(); iter != corpus.blocknr[cls].end(); ++iter)
+    {
+      blocknr_vector_type& bv(vectors[*iter % number_of_vectors]);
+      if (bv.is_vector())
+        bv.remove(*iter);
+      else
+        bv.erase();
+    }
+  return found;
+}
+
+double now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Run kernel once to warm up the caches, and then 'repetitions' times, and print
+// the median, minimum and standard deviation of the time per block as one JSON object.
+void run_kernel(char const* name, char const* class_name, size_t blocks, kernel_type kernel, BlockCorpus& corpus, int cls)
+{
+  if (blocks == 0)
+    return;
+  size_t found = kernel(corpus, cls);
+  std::vector<double> ns_per_block(repetitions);
+  for (int r = 0; r < repetitions; ++r)
+  {
+    double start = now_ns();
+    size_t found2 = kernel(corpus, cls);
+    ns_per_block[r] = (now_ns() - start) / blocks;
+    ASSERT(found2 == found);
+  }
+  std::sort(ns_per_block.begin(), ns_per_block.end());
+  double median = ns_per_block[repetitions / 2];
+  double mean = 0;
+  for (int r = 0; r < repetitions; ++r)
+    mean += ns_per_block[r];
+  mean /= repetitions;
+  double variance = 0;
+  for (int r = 0; r < repetitions; ++r)
+    variance += (ns_per_block[r] - mean) * (ns_per_block[r] - mean);
+  double stddev = std::sqrt(variance / (repetitions - 1));
+  std::streamsize old_precision = std::cout.precision(6);
+  std::cout << "{\"kernel\":\"" << name << "\",\"class\":\"" << class_name << "\",\"blocks\":" << blocks <<
+      ",\"found\":" << found << ",\"repetitions\":" << repetitions <<
+      ",\"ns_per_block\":" << median << ",\"ns_per_block_min\":" << ns_per_block[0] <<
+      ",\"ns_per_block_stddev\":" << stddev << ",\"blocks_per_second\":" << (median > 0 ? 1e9 / median : 0) << "}" << std::endl;
+  std::cout.precision(old_precision);
+}
+
+} // namespace
+
+void run_microbenchmarks(std::string const& corpus_filename)
+{
+  DoutEntering(dc::notice, "run_microbenchmarks(\"" << corpus_filename << "\")");
+  BlockCorpus corpus;
+  load_block_corpus(corpus_filename, corpus);
+  for (int group = 0; group < groups_; ++group)
+    if (!block_bitmap[group])
+      load_meta_data(group);
+  size_t all_blocks = 0;
+  for (int cls = 0; cls < corpus_classes; ++cls)
+  {
+    size_t blocks = corpus.blocknr[cls].size();
+    all_blocks += blocks;
+    run_kernel("is_directory", corpus_class_name[cls], blocks, is_directory_kernel, corpus, cls);
+    run_kernel("is_indirect_block", corpus_class_name[cls], blocks, is_indirect_block_kernel, corpus, cls);
+    run_kernel("search", corpus_class_name[cls], blocks, search_kernel, corpus, cls);
+  }
+  run_kernel("iterate_over_directory", corpus_class_name[corpus_directory], corpus.blocknr[corpus_directory].size(),
+      iterate_over_directory_kernel, corpus, corpus_directory);
+  run_kernel("block_bitmap", "all", block_count(super_block) - first_data_block(super_block), block_bitmap_kernel, corpus, 0);
+  run_kernel("blocknr_vector", "all", all_blocks, blocknr_vector_kernel, corpus, 0);
+}
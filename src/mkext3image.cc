@@ -0,0 +1,1101 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file mkext3image.cc Generator of synthetic ext3 images, used by "make bench".
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <getopt.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "ext3.h"
+#endif
+
+#include "endian_conversion.h"
+
+// This program writes an ext3 image from scratch, without using mke2fs, so that
+// benchmarks can be run on reproducible file systems of any size. The image gets
+// a directory tree with files, after which part of the files and directories are
+// deleted the way ext3 does it: the directory entry is merged into the previous
+// one, the block pointers, size and links count of the inode are zeroed and dtime
+// is set. Every deletion is preceded by a journal transaction that contains the
+// inode table and directory blocks as they were before the deletion, and followed
+// by one with the blocks after the deletion, so that ext3grep can find back the
+// deleted files. The same options and --seed always produce the same image.
+
+namespace {
+
+char const* progname;
+
+// Command line options.
+uint64_t commandline_size = 256 << 20;
+int commandline_block_size = 4096;
+int commandline_inode_size = 256;
+uint64_t commandline_inode_ratio = 16384;
+uint64_t commandline_journal_size = 0;		// Zero means: like mke2fs.
+int commandline_depth = 3;
+int commandline_dirs_per_dir = 4;
+int commandline_files_per_dir = 16;
+uint64_t commandline_file_size = 64 << 10;
+int commandline_fragmentation = 0;
+int commandline_delete_files = 10;
+int commandline_delete_dirs = 2;
+int commandline_transactions = 16;
+uint64_t commandline_seed = 1;
+uint32_t commandline_time = 1220000000;
+
+// The string that is written into the first block of every 1000th file, for --search.
+char const needle[] = "ext3grep-bench-needle";
+
+void fatal(std::string const& msg)
+{
+  std::cout << std::flush;
+  std::cerr << progname << ": " << msg << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+void write_error(void)
+{
+  fatal(std::string("write failed: ") + strerror(errno));
+}
+
+// xorshift64*: a small, fast generator that produces the same numbers on every platform.
+class Random {
+  private:
+    uint64_t M_state;
+
+  public:
+    Random(uint64_t seed) : M_state(seed * 0x9e3779b97f4a7c15ULL + 1) { }
+
+    uint64_t next(void)
+    {
+      M_state ^= M_state >> 12;
+      M_state ^= M_state << 25;
+      M_state ^= M_state >> 27;
+      return M_state * 2685821657736338717ULL;
+    }
+    uint64_t below(uint64_t n) { return next() % n; }
+    bool percent(int p) { return below(100) < (uint64_t)p; }
+};
+
+Random random_generator(1);
+
+// Geometry of the file system.
+int fd;
+uint32_t block_size;
+uint32_t blocks_count;
+uint32_t first_data_block;
+uint32_t blocks_per_group;
+uint32_t inodes_per_group;
+uint32_t inodes_count;
+uint32_t groups;
+uint32_t gdt_blocks;
+uint32_t inode_table_blocks;
+uint32_t pointers_per_block;
+
+// The metadata, kept in memory until the end.
+ext3_super_block super_block;
+std::vector<ext3_group_desc> group_descriptors;
+std::vector<unsigned char> block_bitmaps;	// block_size bytes per group.
+std::vector<unsigned char> inode_bitmaps;	// block_size bytes per group.
+std::vector<unsigned char> inode_table;		// All inodes, inode number i at (i - 1) * commandline_inode_size.
+std::map<uint32_t, std::vector<unsigned char> > directory_blocks;
+std::vector<uint32_t> group_goal;		// Where to start looking for a free block in each group.
+uint32_t free_blocks;
+uint32_t reserved_blocks;
+
+bool has_super(uint32_t group)
+{
+  if (group <= 1)
+    return true;
+  for (uint32_t base = 3; base <= 7; base += 2)
+  {
+    uint32_t power = base;
+    while (power < group)
+      power *= base;
+    if (power == group)
+      return true;
+  }
+  return false;
+}
+
+uint32_t group_first_block(uint32_t group)
+{
+  return first_data_block + group * blocks_per_group;
+}
+
+// The number of blocks used by the super block, group descriptors, bitmaps and inode table of a group.
+uint32_t group_overhead(uint32_t group)
+{
+  return (has_super(group) ? 1 + gdt_blocks : 0) + 2 + inode_table_blocks;
+}
+
+bool block_in_use(uint32_t block)
+{
+  uint32_t group = (block - first_data_block) / blocks_per_group;
+  uint32_t bit = (block - first_data_block) % blocks_per_group;
+  return block_bitmaps[group * block_size + bit / 8] & (1 << (bit % 8));
+}
+
+void mark_block(uint32_t block, bool used)
+{
+  uint32_t group = (block - first_data_block) / blocks_per_group;
+  uint32_t bit = (block - first_data_block) % blocks_per_group;
+  unsigned char& byte(block_bitmaps[group * block_size + bit / 8]);
+  if (used)
+    byte |= 1 << (bit % 8);
+  else
+    byte &= ~(1 << (bit % 8));
+}
+
+void mark_inode(uint32_t inode, bool used)
+{
+  uint32_t group = (inode - 1) / inodes_per_group;
+  uint32_t bit = (inode - 1) % inodes_per_group;
+  unsigned char& byte(inode_bitmaps[group * block_size + bit / 8]);
+  if (used)
+    byte |= 1 << (bit % 8);
+  else
+    byte &= ~(1 << (bit % 8));
+}
+
+ext3_inode& get_inode(uint32_t inode)
+{
+  return *reinterpret_cast<ext3_inode*>(&inode_table[(size_t)(inode - 1) * commandline_inode_size]);
+}
+
+// The block of the inode table that contains inode.
+uint32_t inode_table_block(uint32_t inode)
+{
+  uint32_t group = (inode - 1) / inodes_per_group;
+  uint32_t index = (inode - 1) % inodes_per_group;
+  return group_descriptors[group].bg_inode_table + index * commandline_inode_size / block_size;
+}
+
+unsigned char const* inode_table_block_data(uint32_t inode)
+{
+  uint32_t index = (inode - 1) / (block_size / commandline_inode_size);
+  return &inode_table[(size_t)index * block_size];
+}
+
+// Collects writes to consecutive blocks, so that file data is written with few system calls.
+class BlockWriter {
+  private:
+    std::vector<unsigned char> M_buf;
+    uint32_t M_first;			// The block of M_buf[0].
+    uint32_t M_count;			// The number of blocks in M_buf.
+
+  public:
+    BlockWriter(void) : M_first(0), M_count(0) { }
+
+    void flush(void)
+    {
+      if (M_count && pwrite(fd, &M_buf[0], (size_t)M_count * block_size, (off_t)M_first * block_size) != (ssize_t)((size_t)M_count * block_size))
+	write_error();
+      M_count = 0;
+    }
+
+    void write(uint32_t block, void const* data)
+    {
+      size_t const max_blocks = (1 << 20) / block_size;
+      if (M_count && (block != M_first + M_count || M_count == max_blocks))
+        flush();
+      if (M_buf.empty())
+        M_buf.resize(max_blocks * block_size);
+      if (M_count == 0)
+        M_first = block;
+      std::memcpy(&M_buf[(size_t)M_count * block_size], data, block_size);
+      ++M_count;
+    }
+};
+
+BlockWriter block_writer;
+
+void write_block(uint32_t block, void const* data)
+{
+  block_writer.write(block, data);
+}
+
+// Allocate the first free block at or after goal and advance goal.
+// With --fragmentation, goal first jumps ahead now and then, leaving holes that later files will use.
+uint32_t allocate_block(uint32_t& goal)
+{
+  if (free_blocks == 0)
+    fatal("the file system is full.");
+  if (commandline_fragmentation && random_generator.percent(commandline_fragmentation))
+    goal += 1 + random_generator.below(64);
+  if (goal < first_data_block || goal >= blocks_count)
+    goal = first_data_block;
+  while (block_in_use(goal))
+    if (++goal == blocks_count)
+      goal = first_data_block;
+  mark_block(goal, true);
+  --free_blocks;
+  return goal++;
+}
+
+// Allocate an indirect block of the given level and everything below it.
+uint32_t map_indirect(int level, uint32_t& remaining, uint32_t& goal, std::vector<uint32_t>& data, std::vector<uint32_t>& meta)
+{
+  uint32_t block = allocate_block(goal);
+  meta.push_back(block);
+  std::vector<uint32_t> pointers(pointers_per_block, 0);
+  for (uint32_t i = 0; i < pointers_per_block && remaining; ++i)
+  {
+    if (level == 1)
+    {
+      pointers[i] = allocate_block(goal);
+      data.push_back(pointers[i]);
+      --remaining;
+    }
+    else
+      pointers[i] = map_indirect(level - 1, remaining, goal, data, meta);
+  }
+  write_block(block, &pointers[0]);
+  return block;
+}
+
+// Allocate count data blocks, and the indirect blocks needed to find them, in the order that ext3 does.
+// Fill i_block, and append the data blocks to data and the indirect blocks to meta.
+void map_blocks(uint32_t* i_block, uint32_t count, uint32_t& goal, std::vector<uint32_t>& data, std::vector<uint32_t>& meta)
+{
+  uint32_t remaining = count;
+  for (int i = 0; i < EXT3_NDIR_BLOCKS && remaining; ++i, --remaining)
+  {
+    i_block[i] = allocate_block(goal);
+    data.push_back(i_block[i]);
+  }
+  for (int level = 1; level <= 3 && remaining; ++level)
+    i_block[EXT3_NDIR_BLOCKS + level - 1] = map_indirect(level, remaining, goal, data, meta);
+  if (remaining)
+    fatal("file too large for the block size.");
+}
+
+struct Node {
+  uint32_t inode;
+  size_t parent;			// Index into nodes.
+  std::string name;
+  bool is_directory;
+  bool deleted;
+  std::vector<size_t> children;		// Indices into nodes.
+  std::vector<uint32_t> blocks;		// The data blocks.
+  std::vector<uint32_t> meta;		// The indirect blocks.
+};
+
+std::vector<Node> nodes;
+std::vector<uint32_t> group_next_inode;	// The next unused inode number in each group, or 0 when the group is full.
+uint32_t free_inodes;
+uint32_t next_directory_group;
+uint32_t number_of_files;
+uint32_t number_of_needles;
+
+// Allocate an inode in group, or in the first group after it that has a free inode.
+uint32_t allocate_inode(uint32_t group)
+{
+  for (uint32_t i = 0; i < groups; ++i, group = (group + 1) % groups)
+  {
+    uint32_t inode = group_next_inode[group];
+    if (inode == 0)
+      continue;
+    group_next_inode[group] = (inode % inodes_per_group == 0) ? 0 : inode + 1;
+    mark_inode(inode, true);
+    --free_inodes;
+    return inode;
+  }
+  return 0;
+}
+
+uint32_t group_of_inode(uint32_t inode)
+{
+  return (inode - 1) / inodes_per_group;
+}
+
+void init_inode(uint32_t inode, uint16_t mode, uint16_t links_count)
+{
+  ext3_inode& ino(get_inode(inode));
+  ino.i_mode = mode;
+  ino.i_links_count = links_count;
+  ino.i_mtime = commandline_time - random_generator.below(365 * 24 * 3600);
+  ino.i_ctime = ino.i_mtime;
+  ino.i_atime = std::min(commandline_time, (uint32_t)(ino.i_mtime + random_generator.below(30 * 24 * 3600)));
+}
+
+void set_size(uint32_t inode, uint64_t size, size_t blocks)
+{
+  ext3_inode& ino(get_inode(inode));
+  ino.i_size = size & 0xffffffff;
+  ino.i_size_high = size >> 32;
+  ino.i_blocks = blocks * (block_size / 512);
+}
+
+// Append a directory entry to the blocks in buf (each block_size bytes).
+// 'last' points to the rec_len of the previous entry, or is NULL.
+void add_directory_entry(std::vector<unsigned char>& buf, size_t& offset, uint16_t*& last, uint32_t inode, std::string const& name, int file_type)
+{
+  uint16_t len = EXT3_DIR_REC_LEN(name.length());
+  if (buf.empty() || offset % block_size + len > block_size)
+  {
+    // Let the last entry of the current block extend to the end of the block, and start a new block.
+    if (last)
+      *last += block_size - offset % block_size;
+    offset = buf.size();
+    buf.resize(buf.size() + block_size);
+  }
+  ext3_dir_entry_2* entry = reinterpret_cast<ext3_dir_entry_2*>(&buf[offset]);
+  entry->inode = inode;
+  entry->rec_len = len;
+  entry->name_len = name.length();
+  entry->file_type = file_type;
+  std::memcpy(entry->name, name.data(), name.length());
+  last = &entry->rec_len;
+  offset += len;
+}
+
+// Write the directory blocks of the directory nodes[index], now that all its children exist.
+void create_directory_blocks(size_t index)
+{
+  Node& node(nodes[index]);
+  std::vector<unsigned char> buf;
+  size_t offset = 0;
+  uint16_t* last = NULL;
+  add_directory_entry(buf, offset, last, node.inode, ".", EXT3_FT_DIR);
+  add_directory_entry(buf, offset, last, nodes[node.parent].inode, "..", EXT3_FT_DIR);
+  for (std::vector<size_t>::iterator iter = node.children.begin(); iter != node.children.end(); ++iter)
+    add_directory_entry(buf, offset, last, nodes[*iter].inode, nodes[*iter].name, nodes[*iter].is_directory ? EXT3_FT_DIR : EXT3_FT_REG_FILE);
+  if (offset % block_size)
+    *last += block_size - offset % block_size;
+  size_t count = buf.size() / block_size;
+  ext3_inode& ino(get_inode(node.inode));
+  uint32_t& goal(group_goal[group_of_inode(node.inode)]);
+  map_blocks(ino.i_block, count, goal, node.blocks, node.meta);
+  for (size_t i = 0; i < count; ++i)
+    directory_blocks[node.blocks[i]].assign(buf.begin() + i * block_size, buf.begin() + (i + 1) * block_size);
+  set_size(node.inode, (uint64_t)count * block_size, count + node.meta.size());
+}
+
+// Fill a data block of a file with text that is different for every block.
+void fill_data_block(unsigned char* buf, uint32_t inode, uint32_t block_index, uint32_t length)
+{
+  char line[64];
+  uint32_t pos = 0;
+  if (block_index == 0 && inode % 1000 == 0)
+  {
+    int len = snprintf(line, sizeof(line), "%s\n", needle);
+    std::memcpy(buf, line, std::min((uint32_t)len, length));
+    pos = std::min((uint32_t)len, length);
+    ++number_of_needles;
+  }
+  while (pos < length)
+  {
+    int len = snprintf(line, sizeof(line), "inode %u block %u offset %u\n", inode, block_index, pos);
+    uint32_t n = std::min((uint32_t)len, length - pos);
+    std::memcpy(buf + pos, line, n);
+    pos += n;
+  }
+  std::memset(buf + length, 0, block_size - length);
+}
+
+bool create_file(size_t parent, std::string const& name)
+{
+  uint64_t size = random_generator.below(2 * commandline_file_size + 1);
+  uint64_t count = (size + block_size - 1) / block_size;
+  // Stay out of the reserved blocks, and leave room for indirect blocks and directories.
+  if (free_blocks < reserved_blocks + count + count / pointers_per_block + 16)
+    return false;
+  uint32_t inode = allocate_inode(group_of_inode(nodes[parent].inode));
+  if (!inode)
+    return false;
+  nodes.push_back(Node());
+  Node& node(nodes.back());
+  node.inode = inode;
+  node.parent = parent;
+  node.name = name;
+  node.is_directory = false;
+  node.deleted = false;
+  nodes[parent].children.push_back(nodes.size() - 1);
+  init_inode(inode, 0100644, 1);
+  ext3_inode& ino(get_inode(inode));
+  map_blocks(ino.i_block, count, group_goal[group_of_inode(inode)], node.blocks, node.meta);
+  set_size(inode, size, node.blocks.size() + node.meta.size());
+  std::vector<unsigned char> buf(block_size);
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    uint32_t length = (i == count - 1 && size % block_size) ? size % block_size : block_size;
+    fill_data_block(&buf[0], inode, i, length);
+    write_block(node.blocks[i], &buf[0]);
+  }
+  ++number_of_files;
+  return true;
+}
+
+// Add a directory node with an allocated inode, but without directory blocks yet.
+size_t add_directory(size_t parent, std::string const& name, uint32_t group)
+{
+  uint32_t inode = allocate_inode(group);
+  if (!inode)
+    return 0;
+  nodes.push_back(Node());
+  size_t index = nodes.size() - 1;
+  nodes[index].inode = inode;
+  nodes[index].parent = parent;
+  nodes[index].name = name;
+  nodes[index].is_directory = true;
+  nodes[index].deleted = false;
+  nodes[parent].children.push_back(index);
+  ++get_inode(nodes[parent].inode).i_links_count;
+  init_inode(inode, 040755, 2);
+  return index;
+}
+
+bool create_directory(size_t parent, std::string const& name, int depth);
+
+// Create the files and (if depth > 0) the subdirectories of the directory nodes[index].
+// Returns false when the file system is full.
+bool populate_directory(size_t index, int depth)
+{
+  bool full = false;
+  for (int i = 0; i < commandline_files_per_dir && !full; ++i)
+  {
+    char file_name[32];
+    snprintf(file_name, sizeof(file_name), "file%04d.txt", i);
+    full = !create_file(index, file_name);
+  }
+  for (int i = 0; depth > 0 && i < commandline_dirs_per_dir && !full; ++i)
+  {
+    char dir_name[32];
+    snprintf(dir_name, sizeof(dir_name), "dir%03d", i);
+    full = !create_directory(index, dir_name, depth - 1);
+  }
+  create_directory_blocks(index);
+  return !full;
+}
+
+// Create a directory with its files and subdirectories.
+bool create_directory(size_t parent, std::string const& name, int depth)
+{
+  if (free_blocks < reserved_blocks + 16)
+    return false;
+  // Spread directories over the groups, like the Orlov allocator does.
+  next_directory_group = (next_directory_group + 1) % groups;
+  size_t index = add_directory(parent, name, next_directory_group);
+  return index && populate_directory(index, depth);
+}
+
+// The journal.
+uint32_t const journal_inode = 8;
+std::vector<uint32_t> journal_blocks;	// The file system block of every block of the journal.
+uint32_t journal_position = 1;		// The next block of the journal to write.
+uint32_t journal_sequence = 1;		// The sequence number of the next transaction.
+
+typedef std::map<uint32_t, unsigned char const*> transaction_type;	// File system block -> contents.
+
+// Byte swapping is its own inverse.
+inline uint32_t cpu_to_be32(uint32_t x) { return __be32_to_cpu(x); }
+
+void journal_write(unsigned char const* data)
+{
+  write_block(journal_blocks[journal_position], data);
+  if (++journal_position == journal_blocks.size())
+    journal_position = 1;
+}
+
+// Write a transaction with the given blocks, followed by a commit block.
+void journal_transaction(transaction_type const& transaction)
+{
+  std::vector<unsigned char> descriptor(block_size);
+  std::vector<unsigned char> escaped(block_size);
+  transaction_type::const_iterator iter = transaction.begin();
+  while (iter != transaction.end())
+  {
+    // Fill a descriptor block with as many tags as fit, and write it followed by the blocks.
+    std::memset(&descriptor[0], 0, block_size);
+    journal_header_t* header = reinterpret_cast<journal_header_t*>(&descriptor[0]);
+    header->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
+    header->h_blocktype = cpu_to_be32(JFS_DESCRIPTOR_BLOCK);
+    header->h_sequence = cpu_to_be32(journal_sequence);
+    size_t offset = sizeof(journal_header_t);
+    journal_block_tag_t* tag = NULL;
+    transaction_type::const_iterator begin = iter;
+    for (; iter != transaction.end(); ++iter)
+    {
+      size_t size = sizeof(journal_block_tag_t) + (tag ? 0 : 16);
+      if (offset + size > block_size)
+        break;
+      tag = reinterpret_cast<journal_block_tag_t*>(&descriptor[offset]);
+      tag->t_blocknr = cpu_to_be32(iter->first);
+      uint32_t flags = (iter == begin) ? 0 : JFS_FLAG_SAME_UUID;
+      if (cpu_to_be32(*reinterpret_cast<uint32_t const*>(iter->second)) == JFS_MAGIC_NUMBER)
+        flags |= JFS_FLAG_ESCAPE;
+      tag->t_flags = cpu_to_be32(flags);
+      if (iter == begin)
+        std::memcpy(&descriptor[offset + sizeof(journal_block_tag_t)], super_block.s_uuid, 16);
+      offset += size;
+    }
+    tag->t_flags = cpu_to_be32(cpu_to_be32(tag->t_flags) | JFS_FLAG_LAST_TAG);
+    journal_write(&descriptor[0]);
+    for (transaction_type::const_iterator block = begin; block != iter; ++block)
+    {
+      if (cpu_to_be32(*reinterpret_cast<uint32_t const*>(block->second)) == JFS_MAGIC_NUMBER)
+      {
+        // Blocks that start with the magic number are stored with the first four bytes zeroed.
+        std::memcpy(&escaped[0], block->second, block_size);
+	std::memset(&escaped[0], 0, sizeof(uint32_t));
+	journal_write(&escaped[0]);
+      }
+      else
+        journal_write(block->second);
+    }
+  }
+  std::memset(&descriptor[0], 0, block_size);
+  journal_header_t* header = reinterpret_cast<journal_header_t*>(&descriptor[0]);
+  header->h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
+  header->h_blocktype = cpu_to_be32(JFS_COMMIT_BLOCK);
+  header->h_sequence = cpu_to_be32(journal_sequence);
+  journal_write(&descriptor[0]);
+  ++journal_sequence;
+}
+
+// Remove the entry of inode from directory dir, like ext3 does: the entry is merged with
+// the previous entry, or its inode number is cleared if it's the first entry of a block.
+void remove_directory_entry(Node const& dir, uint32_t inode)
+{
+  for (size_t i = 0; i < dir.blocks.size(); ++i)
+  {
+    std::vector<unsigned char>& buf(directory_blocks[dir.blocks[i]]);
+    ext3_dir_entry_2* prev = NULL;
+    for (uint32_t offset = 0; offset < block_size;)
+    {
+      ext3_dir_entry_2* entry = reinterpret_cast<ext3_dir_entry_2*>(&buf[offset]);
+      if (entry->inode == inode)
+      {
+        if (prev)
+	  prev->rec_len += entry->rec_len;
+	else
+	  entry->inode = 0;
+	return;
+      }
+      prev = entry;
+      offset += entry->rec_len;
+    }
+  }
+}
+
+// Delete nodes[index], and everything below it if it's a directory, like 'rm -rf' does.
+void delete_node(size_t index, uint32_t dtime)
+{
+  Node& node(nodes[index]);
+  for (size_t i = 0; i < node.children.size(); ++i)
+    if (!nodes[node.children[i]].deleted)
+      delete_node(node.children[i], dtime);
+  Node& parent(nodes[node.parent]);
+  remove_directory_entry(parent, node.inode);
+  ext3_inode& parent_inode(get_inode(parent.inode));
+  if (node.is_directory)
+    --parent_inode.i_links_count;
+  parent_inode.i_mtime = parent_inode.i_ctime = dtime;
+  ext3_inode& ino(get_inode(node.inode));
+  for (size_t i = 0; i < node.blocks.size(); ++i)
+    mark_block(node.blocks[i], false);
+  for (size_t i = 0; i < node.meta.size(); ++i)
+    mark_block(node.meta[i], false);
+  free_blocks += node.blocks.size() + node.meta.size();
+  ino.i_links_count = 0;
+  ino.i_dtime = dtime;
+  ino.i_ctime = dtime;
+  set_size(node.inode, 0, 0);
+  std::memset(ino.i_block, 0, sizeof(ino.i_block));
+  mark_inode(node.inode, false);
+  ++free_inodes;
+  node.deleted = true;
+}
+
+// Add the inode table blocks, directory blocks and bitmaps that delete_node(index) changes to transaction.
+void collect_changed_blocks(size_t index, transaction_type& transaction)
+{
+  Node const& node(nodes[index]);
+  Node const& parent(nodes[node.parent]);
+  uint32_t inodes[2] = { node.inode, parent.inode };
+  for (int i = 0; i < 2; ++i)
+  {
+    uint32_t group = group_of_inode(inodes[i]);
+    transaction[inode_table_block(inodes[i])] = inode_table_block_data(inodes[i]);
+    transaction[group_descriptors[group].bg_inode_bitmap] = &inode_bitmaps[group * block_size];
+  }
+  for (size_t i = 0; i < parent.blocks.size(); ++i)
+    transaction[parent.blocks[i]] = &directory_blocks[parent.blocks[i]][0];
+  for (size_t i = 0; i < node.blocks.size(); ++i)
+  {
+    uint32_t group = (node.blocks[i] - first_data_block) / blocks_per_group;
+    transaction[group_descriptors[group].bg_block_bitmap] = &block_bitmaps[group * block_size];
+  }
+  for (size_t i = 0; i < node.children.size(); ++i)
+    if (!nodes[node.children[i]].deleted)
+      collect_changed_blocks(node.children[i], transaction);
+}
+
+uint32_t number_of_deleted_files;
+uint32_t number_of_deleted_directories;
+uint32_t last_dtime;
+
+// Delete random files and directories, in --transactions batches.
+void delete_nodes(void)
+{
+  // A node is doomed if it, or one of its parents, is picked for deletion.
+  // Parents always have a lower index than their children.
+  std::vector<bool> doomed(nodes.size(), false);
+  std::vector<size_t> picked;
+  for (size_t index = 2; index < nodes.size(); ++index)	// Skip the root directory and lost+found.
+  {
+    Node const& node(nodes[index]);
+    if (doomed[node.parent])
+      doomed[index] = true;
+    else if (random_generator.percent(node.is_directory ? commandline_delete_dirs : commandline_delete_files))
+    {
+      doomed[index] = true;
+      picked.push_back(index);
+    }
+    if (doomed[index])
+      ++(node.is_directory ? number_of_deleted_directories : number_of_deleted_files);
+  }
+  last_dtime = commandline_time;
+  size_t batches = std::min(picked.size(), (size_t)commandline_transactions);
+  for (size_t batch = 0; batch < batches; ++batch)
+  {
+    size_t begin = batch * picked.size() / batches;
+    size_t end = (batch + 1) * picked.size() / batches;
+    uint32_t dtime = commandline_time + 600 * (batch + 1);
+    // The last transaction that wrote these blocks before the deletion.
+    transaction_type transaction;
+    for (size_t i = begin; i < end; ++i)
+      collect_changed_blocks(picked[i], transaction);
+    journal_transaction(transaction);
+    for (size_t i = begin; i < end; ++i)
+      delete_node(picked[i], dtime);
+    // The deletion itself. The pointers in transaction point to the changed data now.
+    journal_transaction(transaction);
+    last_dtime = dtime;
+  }
+}
+
+void init_geometry(void)
+{
+  block_size = commandline_block_size;
+  uint64_t total = commandline_size / block_size;
+  if (total > 0xffffffffULL)
+    fatal("--size: too large for 32-bit block numbers.");
+  first_data_block = (block_size == 1024) ? 1 : 0;
+  blocks_per_group = 8 * block_size;
+  pointers_per_block = block_size / sizeof(uint32_t);
+  if (total < first_data_block + 1024)
+    fatal("--size: too small.");
+  groups = (total - first_data_block + blocks_per_group - 1) / blocks_per_group;
+  uint32_t inodes_per_block = block_size / commandline_inode_size;
+  uint64_t inodes = commandline_size / commandline_inode_ratio;
+  inodes_per_group = (inodes + groups - 1) / groups;
+  inodes_per_group = (inodes_per_group + inodes_per_block - 1) / inodes_per_block * inodes_per_block;
+  inodes_per_group = (inodes_per_group + 7) / 8 * 8;
+  inodes_per_group = std::max(inodes_per_group, std::max((uint32_t)16, inodes_per_block));
+  inodes_per_group = std::min(inodes_per_group, 8 * block_size);
+  inode_table_blocks = inodes_per_group / inodes_per_block;
+  gdt_blocks = (groups * sizeof(ext3_group_desc) + block_size - 1) / block_size;
+  // Drop a last group that is too small to be useful, like mke2fs does.
+  uint32_t last_group_size = (total - first_data_block) % blocks_per_group;
+  if (last_group_size && last_group_size < group_overhead(groups - 1) + 64)
+  {
+    if (groups == 1)
+      fatal("--size: too small.");
+    total -= last_group_size;
+    --groups;
+  }
+  blocks_count = total;
+  inodes_count = groups * inodes_per_group;
+  reserved_blocks = blocks_count / 20;
+
+  group_descriptors.resize(groups);
+  block_bitmaps.resize((size_t)groups * block_size);
+  inode_bitmaps.resize((size_t)groups * block_size);
+  inode_table.resize((size_t)inodes_count * commandline_inode_size);
+  group_goal.resize(groups);
+  group_next_inode.resize(groups);
+  uint32_t used = 0;
+  for (uint32_t group = 0; group < groups; ++group)
+  {
+    uint32_t first = group_first_block(group);
+    uint32_t block = first + (has_super(group) ? 1 + gdt_blocks : 0);
+    group_descriptors[group].bg_block_bitmap = block;
+    group_descriptors[group].bg_inode_bitmap = block + 1;
+    group_descriptors[group].bg_inode_table = block + 2;
+    group_goal[group] = block + 2 + inode_table_blocks;
+    for (uint32_t b = first; b < group_goal[group]; ++b)
+      mark_block(b, true);
+    used += group_goal[group] - first;
+    // The bits after the end of the file system, and after the last inode of the group, are set.
+    uint32_t group_blocks = std::min(blocks_per_group, blocks_count - first);
+    for (uint32_t bit = group_blocks; bit < 8 * block_size; ++bit)
+      block_bitmaps[group * block_size + bit / 8] |= 1 << (bit % 8);
+    for (uint32_t bit = inodes_per_group; bit < 8 * block_size; ++bit)
+      inode_bitmaps[group * block_size + bit / 8] |= 1 << (bit % 8);
+    group_next_inode[group] = group * inodes_per_group + 1;
+  }
+  free_blocks = blocks_count - first_data_block - used;
+  // Inodes 1 up till and including 10 are reserved.
+  for (uint32_t inode = 1; inode < EXT2_GOOD_OLD_FIRST_INO; ++inode)
+    mark_inode(inode, true);
+  group_next_inode[0] = EXT2_GOOD_OLD_FIRST_INO;
+  free_inodes = inodes_count - (EXT2_GOOD_OLD_FIRST_INO - 1);
+}
+
+void create_journal(void)
+{
+  uint32_t length = commandline_journal_size / block_size;
+  if (length == 0)
+  {
+    // The default of mke2fs.
+    length = blocks_count < 32768 ? 1024 : blocks_count < 256 * 1024 ? 4096 : blocks_count < 512 * 1024 ? 8192 : blocks_count < 1024 * 1024 ? 16384 : 32768;
+  }
+  if (length < JFS_MIN_JOURNAL_BLOCKS || length > free_blocks / 2)
+    fatal("invalid journal size.");
+  init_inode(journal_inode, 0100600, 1);
+  ext3_inode& ino(get_inode(journal_inode));
+  std::vector<uint32_t> meta;
+  // Like mke2fs, put the journal in the middle of the file system, contiguously.
+  int fragmentation = commandline_fragmentation;
+  commandline_fragmentation = 0;
+  map_blocks(ino.i_block, length, group_goal[groups / 2], journal_blocks, meta);
+  commandline_fragmentation = fragmentation;
+  set_size(journal_inode, (uint64_t)length * block_size, length + meta.size());
+}
+
+void write_journal_superblock(void)
+{
+  std::vector<unsigned char> buf(block_size);
+  journal_superblock_t* jsb = reinterpret_cast<journal_superblock_t*>(&buf[0]);
+  jsb->s_header.h_magic = cpu_to_be32(JFS_MAGIC_NUMBER);
+  jsb->s_header.h_blocktype = cpu_to_be32(JFS_SUPERBLOCK_V2);
+  jsb->s_blocksize = cpu_to_be32(block_size);
+  jsb->s_maxlen = cpu_to_be32(journal_blocks.size());
+  jsb->s_first = cpu_to_be32(1);
+  jsb->s_sequence = cpu_to_be32(journal_sequence);
+  jsb->s_start = 0;			// The file system was unmounted cleanly; there is nothing to replay.
+  std::memcpy(jsb->s_uuid, super_block.s_uuid, 16);
+  jsb->s_nr_users = cpu_to_be32(1);
+  std::memcpy(jsb->s_users, super_block.s_uuid, 16);
+  write_block(journal_blocks[0], &buf[0]);
+}
+
+// Write the super block, group descriptors, bitmaps, inode tables and directory blocks.
+void write_metadata(void)
+{
+  std::vector<uint32_t> used_dirs(groups, 0);
+  for (size_t index = 0; index < nodes.size(); ++index)
+    if (nodes[index].is_directory && !nodes[index].deleted)
+      ++used_dirs[group_of_inode(nodes[index].inode)];
+  for (uint32_t group = 0; group < groups; ++group)
+  {
+    uint32_t first = group_first_block(group);
+    uint32_t group_blocks = std::min(blocks_per_group, blocks_count - first);
+    uint32_t free_in_group = 0;
+    for (uint32_t bit = 0; bit < group_blocks; ++bit)
+      if (!(block_bitmaps[group * block_size + bit / 8] & (1 << (bit % 8))))
+        ++free_in_group;
+    group_descriptors[group].bg_free_blocks_count = free_in_group;
+    free_in_group = 0;
+    for (uint32_t bit = 0; bit < inodes_per_group; ++bit)
+      if (!(inode_bitmaps[group * block_size + bit / 8] & (1 << (bit % 8))))
+        ++free_in_group;
+    group_descriptors[group].bg_free_inodes_count = free_in_group;
+    group_descriptors[group].bg_used_dirs_count = used_dirs[group];
+  }
+
+  super_block.s_inodes_count = inodes_count;
+  super_block.s_blocks_count = blocks_count;
+  super_block.s_r_blocks_count = reserved_blocks;
+  super_block.s_free_blocks_count = free_blocks;
+  super_block.s_free_inodes_count = free_inodes;
+  super_block.s_first_data_block = first_data_block;
+  for (uint32_t size = 1024; size < block_size; size <<= 1)
+  {
+    ++super_block.s_log_block_size;
+    ++super_block.s_log_frag_size;
+  }
+  super_block.s_blocks_per_group = blocks_per_group;
+  super_block.s_frags_per_group = blocks_per_group;
+  super_block.s_inodes_per_group = inodes_per_group;
+  super_block.s_mtime = commandline_time;
+  super_block.s_wtime = last_dtime + 60;
+  super_block.s_mnt_count = 1;
+  super_block.s_max_mnt_count = -1;
+  super_block.s_magic = 0xef53;
+  super_block.s_state = EXT3_VALID_FS;
+  super_block.s_errors = 1;		// Continue.
+  super_block.s_lastcheck = commandline_time - 366 * 24 * 3600;
+  super_block.s_creator_os = EXT2_OS_LINUX;
+  super_block.s_rev_level = 1;		// Dynamic inode sizes.
+  super_block.s_first_ino = EXT2_GOOD_OLD_FIRST_INO;
+  super_block.s_inode_size = commandline_inode_size;
+  super_block.s_feature_compat = EXT3_FEATURE_COMPAT_HAS_JOURNAL;
+  super_block.s_feature_incompat = EXT3_FEATURE_INCOMPAT_FILETYPE;
+  super_block.s_feature_ro_compat = EXT3_FEATURE_RO_COMPAT_SPARSE_SUPER | EXT3_FEATURE_RO_COMPAT_LARGE_FILE;
+  std::strncpy(super_block.s_volume_name, "ext3grep-bench", sizeof(super_block.s_volume_name));
+  super_block.s_journal_inum = journal_inode;
+  super_block.s_mkfs_time = super_block.s_lastcheck;
+
+  std::vector<unsigned char> buf(block_size);
+  for (uint32_t group = 0; group < groups; ++group)
+  {
+    if (has_super(group))
+    {
+      // The super block is at byte 1024 of the file system, and at the start of the first block of the backup groups.
+      std::memset(&buf[0], 0, block_size);
+      super_block.s_block_group_nr = group;
+      size_t offset = (group == 0 && block_size > 1024) ? 1024 : 0;
+      std::memcpy(&buf[offset], &super_block, sizeof(super_block));
+      write_block(group_first_block(group), &buf[0]);
+      for (uint32_t i = 0; i < gdt_blocks; ++i)
+      {
+        std::memset(&buf[0], 0, block_size);
+	size_t per_block = block_size / sizeof(ext3_group_desc);
+	size_t count = std::min((size_t)groups - i * per_block, per_block);
+	std::memcpy(&buf[0], &group_descriptors[i * per_block], count * sizeof(ext3_group_desc));
+	write_block(group_first_block(group) + 1 + i, &buf[0]);
+      }
+    }
+    write_block(group_descriptors[group].bg_block_bitmap, &block_bitmaps[group * block_size]);
+    write_block(group_descriptors[group].bg_inode_bitmap, &inode_bitmaps[group * block_size]);
+    for (uint32_t i = 0; i < inode_table_blocks; ++i)
+      write_block(group_descriptors[group].bg_inode_table + i, &inode_table[((size_t)group * inode_table_blocks + i) * block_size]);
+  }
+  for (std::map<uint32_t, std::vector<unsigned char> >::iterator iter = directory_blocks.begin(); iter != directory_blocks.end(); ++iter)
+    write_block(iter->first, &iter->second[0]);
+  write_journal_superblock();
+  block_writer.flush();
+}
+
+uint64_t parse_size(char const* option, char const* arg)
+{
+  char* endptr;
+  unsigned long long size = strtoull(arg, &endptr, 10);
+  if (*endptr == 'K' || *endptr == 'k')
+    size <<= 10, ++endptr;
+  else if (*endptr == 'M' || *endptr == 'm')
+    size <<= 20, ++endptr;
+  else if (*endptr == 'G' || *endptr == 'g')
+    size <<= 30, ++endptr;
+  if (*endptr != '\0' || endptr == arg)
+    fatal(std::string(option) + ": " + arg + ": invalid size.");
+  return size;
+}
+
+int parse_int(char const* option, char const* arg, int min, int max)
+{
+  char* endptr;
+  long val = strtol(arg, &endptr, 10);
+  if (*endptr != '\0' || endptr == arg || val < min || val > max)
+    fatal(std::string(option) + ": " + arg + ": invalid value.");
+  return val;
+}
+
+void print_usage(std::ostream& os)
+{
+  os << "Usage: " << progname << " [options] image\n";
+  os << "Writes a synthetic ext3 file system with deleted files to 'image'.\n";
+  os << "Options:\n";
+  os << "  --size SIZE            The size of the image (default 256M).\n";
+  os << "  --block-size SIZE      1024, 2048 or 4096 (default 4096).\n";
+  os << "  --inode-size SIZE      128 or 256 (default 256).\n";
+  os << "  --inode-ratio SIZE     Bytes per inode (default 16K).\n";
+  os << "  --journal-size SIZE    The size of the journal (default like mke2fs).\n";
+  os << "  --depth N              Levels of directories below the root (default 3).\n";
+  os << "  --dirs-per-dir N       Subdirectories per directory (default 4).\n";
+  os << "  --files-per-dir N      Files per directory (default 16).\n";
+  os << "  --file-size SIZE       Average file size (default 64K).\n";
+  os << "  --fragmentation PCT    Chance that a block isn't placed after the\n";
+  os << "                         previous one (default 0).\n";
+  os << "  --delete-files PCT     Percentage of the files to delete (default 10).\n";
+  os << "  --delete-dirs PCT      Percentage of the directories to delete, with\n";
+  os << "                         everything in them (default 2).\n";
+  os << "  --transactions N       Number of deletion batches (default 16).\n";
+  os << "  --seed N               Seed of the random generator (default 1).\n";
+  os << "  --time T               Time of the deletions, in seconds since the\n";
+  os << "                         epoch (default 1220000000).\n";
+}
+
+enum opts {
+  opt_size, opt_block_size, opt_inode_size, opt_inode_ratio, opt_journal_size, opt_depth,
+  opt_dirs_per_dir, opt_files_per_dir, opt_file_size, opt_fragmentation, opt_delete_files,
+  opt_delete_dirs, opt_transactions, opt_seed, opt_time, opt_help
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  progname = argv[0];
+  static int long_option;
+  struct option longopts[] = {
+    {"size", 1, &long_option, opt_size},
+    {"block-size", 1, &long_option, opt_block_size},
+    {"inode-size", 1, &long_option, opt_inode_size},
+    {"inode-ratio", 1, &long_option, opt_inode_ratio},
+    {"journal-size", 1, &long_option, opt_journal_size},
+    {"depth", 1, &long_option, opt_depth},
+    {"dirs-per-dir", 1, &long_option, opt_dirs_per_dir},
+    {"files-per-dir", 1, &long_option, opt_files_per_dir},
+    {"file-size", 1, &long_option, opt_file_size},
+    {"fragmentation", 1, &long_option, opt_fragmentation},
+    {"delete-files", 1, &long_option, opt_delete_files},
+    {"delete-dirs", 1, &long_option, opt_delete_dirs},
+    {"transactions", 1, &long_option, opt_transactions},
+    {"seed", 1, &long_option, opt_seed},
+    {"time", 1, &long_option, opt_time},
+    {"help", 0, &long_option, opt_help},
+    {NULL, 0, NULL, 0}
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "", longopts, NULL)) != -1)
+  {
+    if (c != 0)
+    {
+      print_usage(std::cerr);
+      return EXIT_FAILURE;
+    }
+    switch (long_option)
+    {
+      case opt_size:
+        commandline_size = parse_size("--size", optarg);
+	break;
+      case opt_block_size:
+        commandline_block_size = parse_int("--block-size", optarg, 1024, 4096);
+	if (commandline_block_size != 1024 && commandline_block_size != 2048 && commandline_block_size != 4096)
+	  fatal("--block-size: must be 1024, 2048 or 4096.");
+	break;
+      case opt_inode_size:
+        commandline_inode_size = parse_int("--inode-size", optarg, 128, 256);
+	if (commandline_inode_size != 128 && commandline_inode_size != 256)
+	  fatal("--inode-size: must be 128 or 256.");
+	break;
+      case opt_inode_ratio:
+        commandline_inode_ratio = parse_size("--inode-ratio", optarg);
+	if (commandline_inode_ratio < 1024)
+	  fatal("--inode-ratio: must be at least 1K.");
+	break;
+      case opt_journal_size:
+        commandline_journal_size = parse_size("--journal-size", optarg);
+	break;
+      case opt_depth:
+        commandline_depth = parse_int("--depth", optarg, 0, 32);
+	break;
+      case opt_dirs_per_dir:
+        commandline_dirs_per_dir = parse_int("--dirs-per-dir", optarg, 0, 10000);
+	break;
+      case opt_files_per_dir:
+        commandline_files_per_dir = parse_int("--files-per-dir", optarg, 0, 100000);
+	break;
+      case opt_file_size:
+        commandline_file_size = parse_size("--file-size", optarg);
+	break;
+      case opt_fragmentation:
+        commandline_fragmentation = parse_int("--fragmentation", optarg, 0, 100);
+	break;
+      case opt_delete_files:
+        commandline_delete_files = parse_int("--delete-files", optarg, 0, 100);
+	break;
+      case opt_delete_dirs:
+        commandline_delete_dirs = parse_int("--delete-dirs", optarg, 0, 100);
+	break;
+      case opt_transactions:
+        commandline_transactions = parse_int("--transactions", optarg, 1, 1000000);
+	break;
+      case opt_seed:
+        commandline_seed = parse_size("--seed", optarg);
+	break;
+      case opt_time:
+        commandline_time = parse_size("--time", optarg);
+	break;
+      case opt_help:
+        print_usage(std::cout);
+	return EXIT_SUCCESS;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    print_usage(std::cerr);
+    return EXIT_FAILURE;
+  }
+  if (commandline_inode_size > commandline_block_size)
+    fatal("--inode-size: larger than the block size.");
+  random_generator = Random(commandline_seed);
+  fd = open(argv[optind], O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    fatal(std::string(argv[optind]) + ": " + strerror(errno));
+
+  init_geometry();
+  if (ftruncate(fd, (off_t)blocks_count * block_size) == -1)
+    write_error();
+  for (int i = 0; i < 16; ++i)
+    super_block.s_uuid[i] = random_generator.next();
+  create_journal();
+
+  // The root directory and lost+found.
+  nodes.push_back(Node());
+  nodes[0].inode = EXT3_ROOT_INO;
+  nodes[0].parent = 0;
+  nodes[0].is_directory = true;
+  nodes[0].deleted = false;
+  init_inode(EXT3_ROOT_INO, 040755, 2);
+  size_t lost_found = add_directory(0, "lost+found", 0);
+  if (!lost_found)
+    fatal("no inodes.");
+  create_directory_blocks(lost_found);
+  bool complete = populate_directory(0, commandline_depth);
+  if (!complete)
+    std::cerr << progname << ": the file system is full; not all files and directories were created." << std::endl;
+
+  delete_nodes();
+  write_metadata();
+  if (close(fd) == -1)
+    write_error();
+
+  std::cout << "blocks: " << blocks_count << '\n';
+  std::cout << "block_size: " << block_size << '\n';
+  std::cout << "groups: " << groups << '\n';
+  std::cout << "inodes: " << inodes_count << '\n';
+  std::cout << "journal_blocks: " << journal_blocks.size() << '\n';
+  std::cout << "journal_transactions: " << journal_sequence - 1 << '\n';
+  std::cout << "files: " << number_of_files << '\n';
+  std::cout << "directories: " << nodes.size() - number_of_files << '\n';
+  std::cout << "deleted_files: " << number_of_deleted_files << '\n';
+  std::cout << "deleted_directories: " << number_of_deleted_directories << '\n';
+  std::cout << "needle: " << needle << '\n';
+  std::cout << "needles: " << number_of_needles << '\n';
+  return EXIT_SUCCESS;
+}
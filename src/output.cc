@@ -0,0 +1,239 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file output.cc Buffered machine-readable output of the listing actions.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <unistd.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "utils.h"
+#include "output.h"
+
+// Records are appended to a large buffer that is written to stdout with write(2),
+// so that producing output doesn't slow down the loops that find it.
+
+output_format_type output_format = output_text;
+
+namespace {
+
+size_t const output_buffer_size = 1024 * 1024;
+
+pthread_mutex_t S_mutex = PTHREAD_MUTEX_INITIALIZER;	// Protects S_buffer.
+std::string S_buffer;
+
+// The names of the numeric fields, in the order of enum output_field.
+char const* const S_field_names[output_fields] = {
+  "inode", "block", "journal_block", "group", "time", "dtime", "sequence", "count"
+};
+
+void write_buffer(void)
+{
+  char const* ptr = S_buffer.data();
+  size_t len = S_buffer.size();
+  while (len > 0)
+  {
+    ssize_t written = ::write(1, ptr, len);
+    if (written == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      int error = errno;
+      std::cout << std::flush;
+      std::cerr << progname << ": --format: failed to write to stdout: " << strerror(error) << std::endl;
+      break;
+    }
+    ptr += written;
+    len -= written;
+  }
+  S_buffer.clear();
+}
+
+void append_number(uint64_t value)
+{
+  char buf[24];
+  char* ptr = buf + sizeof(buf);
+  do
+  {
+    *--ptr = '0' + value % 10;
+    value /= 10;
+  }
+  while (value);
+  S_buffer.append(ptr, buf + sizeof(buf) - ptr);
+}
+
+// Append a CSV field, quoted only when needed.
+void append_csv(std::string const& s)
+{
+  if (s.find_first_of(",\"\r\n") == std::string::npos)
+  {
+    S_buffer += s;
+    return;
+  }
+  S_buffer += '"';
+  for (std::string::const_iterator iter = s.begin(); iter != s.end(); ++iter)
+  {
+    if (*iter == '"')
+      S_buffer += '"';
+    S_buffer += *iter;
+  }
+  S_buffer += '"';
+}
+
+// Append a TSV field; tabs, newlines and backslashes are escaped with a backslash.
+void append_tsv(std::string const& s)
+{
+  for (std::string::const_iterator iter = s.begin(); iter != s.end(); ++iter)
+  {
+    switch (*iter)
+    {
+      case '\t':
+        S_buffer += "\\t";
+	break;
+      case '\n':
+        S_buffer += "\\n";
+	break;
+      case '\r':
+        S_buffer += "\\r";
+	break;
+      case '\\':
+        S_buffer += "\\\\";
+	break;
+      default:
+        S_buffer += *iter;
+    }
+  }
+}
+
+void append_header(void)
+{
+  char separator = (output_format == output_csv) ? ',' : '\t';
+  S_buffer += "action";
+  S_buffer += separator;
+  S_buffer += "path";
+  for (int field = 0; field < output_fields; ++field)
+  {
+    S_buffer += separator;
+    S_buffer += S_field_names[field];
+    if (field == field_dtime)
+    {
+      S_buffer += separator;
+      S_buffer += "state";
+    }
+  }
+  S_buffer += '\n';
+}
+
+} // namespace
+
+void output_record(OutputRecord const& record)
+{
+  pthread_mutex_lock(&S_mutex);
+  if (output_format == output_jsonl)
+  {
+    S_buffer += "{\"action\":\"";
+    S_buffer += record.M_action;
+    S_buffer += '"';
+    if (record.M_path)
+    {
+      S_buffer += ",\"path\":\"";
+      S_buffer += json_escape(*record.M_path);
+      S_buffer += '"';
+    }
+    for (int field = 0; field < output_fields; ++field)
+    {
+      if ((record.M_set & (1U << field)))
+      {
+	S_buffer += ",\"";
+	S_buffer += S_field_names[field];
+	S_buffer += "\":";
+	append_number(record.M_value[field]);
+      }
+      if (field == field_dtime && record.M_state)
+      {
+	S_buffer += ",\"state\":\"";
+	S_buffer += record.M_state;
+	S_buffer += '"';
+      }
+    }
+    S_buffer += "}\n";
+  }
+  else
+  {
+    char separator = (output_format == output_csv) ? ',' : '\t';
+    S_buffer += record.M_action;
+    S_buffer += separator;
+    if (record.M_path)
+    {
+      if (output_format == output_csv)
+	append_csv(*record.M_path);
+      else
+	append_tsv(*record.M_path);
+    }
+    for (int field = 0; field < output_fields; ++field)
+    {
+      S_buffer += separator;
+      if ((record.M_set & (1U << field)))
+	append_number(record.M_value[field]);
+      if (field == field_dtime)
+      {
+	S_buffer += separator;
+	if (record.M_state)
+	  S_buffer += record.M_state;
+      }
+    }
+    S_buffer += '\n';
+  }
+  if (S_buffer.size() >= output_buffer_size)
+    write_buffer();
+  pthread_mutex_unlock(&S_mutex);
+}
+
+void output_flush(void)
+{
+  pthread_mutex_lock(&S_mutex);
+  write_buffer();
+  pthread_mutex_unlock(&S_mutex);
+}
+
+void init_output(output_format_type format)
+{
+  output_format = format;
+  if (format == output_text)
+    return;
+  // Anything that is still written to std::cout is meant for humans; send it to stderr,
+  // but buffer it per line because stderr is normally unbuffered.
+  setvbuf(stderr, NULL, _IOLBF, BUFSIZ);
+  std::cout.rdbuf(std::cerr.rdbuf());
+  S_buffer.reserve(output_buffer_size + 4096);
+  if (format != output_jsonl)
+    append_header();
+  atexit(output_flush);
+}
@@ -0,0 +1,101 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file output.h Declaration of the machine-readable output of the listing actions.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#ifndef USE_PCH
+#include <string>
+#include <stdint.h>
+#endif
+
+// The type of commandline_format.
+enum output_format_type {
+  output_text,		// The normal, human readable output.
+  output_jsonl,		// One JSON object per line.
+  output_csv,		// Comma separated values, with a header line.
+  output_tsv		// Tab separated values, with a header line.
+};
+
+// The numeric fields of an OutputRecord.
+enum output_field {
+  field_inode,
+  field_block,
+  field_journal_block,
+  field_group,
+  field_time,
+  field_dtime,
+  field_sequence,
+  field_count,
+  output_fields
+};
+
+// One line of machine-readable output. Only the fields that are set are written
+// as JSON; CSV and TSV have a column for every field that is empty when not set.
+// The strings are not copied, so the record must be written before they go away,
+// normally in the same statement:
+//
+//   output_record(OutputRecord("search").block(block).state("allocated"));
+class OutputRecord {
+  private:
+    char const* M_action;		// The action that produced this record, for example "name" or "search".
+    std::string const* M_path;
+    char const* M_state;		// The allocation state, for example "allocated" or "deleted".
+    uint64_t M_value[output_fields];
+    unsigned int M_set;			// Bit 1 << field is set when M_value[field] is valid.
+
+    OutputRecord& set(output_field field, uint64_t value) { M_value[field] = value; M_set |= 1U << field; return *this; }
+
+  public:
+    explicit OutputRecord(char const* action) : M_action(action), M_path(NULL), M_state(NULL), M_set(0) { }
+
+    OutputRecord& path(std::string const& path) { M_path = &path; return *this; }
+    OutputRecord& state(char const* state) { M_state = state; return *this; }
+    OutputRecord& inode(uint32_t inode) { return set(field_inode, inode); }
+    OutputRecord& block(uint32_t block) { return set(field_block, block); }
+    OutputRecord& journal_block(uint32_t block) { return set(field_journal_block, block); }
+    OutputRecord& group(uint32_t group) { return set(field_group, group); }
+    OutputRecord& time(uint32_t time) { return set(field_time, time); }
+    OutputRecord& dtime(uint32_t dtime) { return set(field_dtime, dtime); }
+    OutputRecord& sequence(uint32_t sequence) { return set(field_sequence, sequence); }
+    OutputRecord& count(uint64_t count) { return set(field_count, count); }
+
+    friend void output_record(OutputRecord const& record);
+};
+
+// The selected output format (--format). Everything except output_text means
+// that the listing actions write OutputRecord's instead of their normal output.
+extern output_format_type output_format;
+
+// Append 'record' to the output buffer, which is written to stdout when it is full
+// and when the program exits. This function is thread-safe.
+void output_record(OutputRecord const& record);
+
+// Write the output buffer to stdout now.
+void output_flush(void);
+
+// Select the output format. For machine-readable formats this writes the header
+// (if any) and redirects std::cout to stderr, so that stdout only contains records.
+void init_output(output_format_type format);
+
+#endif // OUTPUT_H
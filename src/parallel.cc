@@ -0,0 +1,191 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file parallel.cc Implementation of helper functions for running work on multiple threads.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include "ext3.h"
+#include "debug.h"
+#endif
+
+#include "parallel.h"
+#include "commandline.h"
+#include "globals.h"
+#include "get_block.h"
+#include "trace.h"
+
+int number_of_threads(void)
+{
+  if (commandline_threads > 0)
+    return commandline_threads;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  return (cpus > 0) ? cpus : 1;
+}
+
+namespace {
+
+struct for_each_parallel_st {
+  void (*work)(size_t, void*);
+  void* data;
+  size_t count;
+  size_t next;			// The next index to hand out.
+  pthread_mutex_t mutex;	// Protects 'next'.
+};
+
+void for_each_parallel_loop(for_each_parallel_st* fdata)
+{
+  for(;;)
+  {
+    pthread_mutex_lock(&fdata->mutex);
+    size_t index = fdata->next;
+    if (index < fdata->count)
+      ++fdata->next;
+    pthread_mutex_unlock(&fdata->mutex);
+    if (index >= fdata->count)
+      break;
+    TraceSpan trace_span("for_each_parallel item", "index", index);
+    fdata->work(index, fdata->data);
+  }
+}
+
+void* for_each_parallel_thread(void* arg)
+{
+  Debug(debug::init_thread());
+  trace_thread_name("for_each_parallel");
+  for_each_parallel_loop(static_cast<for_each_parallel_st*>(arg));
+  return NULL;
+}
+
+} // namespace
+
+void for_each_parallel(size_t count, void (*work)(size_t, void*), void* data)
+{
+  size_t nthreads = number_of_threads();
+  if (nthreads > count)
+    nthreads = count;
+  if (nthreads <= 1)
+  {
+    for (size_t index = 0; index < count; ++index)
+    {
+      TraceSpan trace_span("for_each_parallel item", "index", index);
+      work(index, data);
+    }
+    return;
+  }
+  for_each_parallel_st fdata;
+  fdata.work = work;
+  fdata.data = data;
+  fdata.count = count;
+  fdata.next = 0;
+  pthread_mutex_init(&fdata.mutex, NULL);
+  // The calling thread is one of the workers.
+  std::vector<pthread_t> threads(nthreads - 1);
+  for (std::vector<pthread_t>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+  {
+    int error = pthread_create(&*iter, NULL, for_each_parallel_thread, &fdata);
+    if (error)
+    {
+      std::cout << std::flush;
+      std::cerr << progname << ": pthread_create: " << strerror(error) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  for_each_parallel_loop(&fdata);
+  for (std::vector<pthread_t>::iterator iter = threads.begin(); iter != threads.end(); ++iter)
+    pthread_join(*iter, NULL);
+  pthread_mutex_destroy(&fdata.mutex);
+}
+
+// The maximum number of blocks that are queued for prefetching.
+// When more blocks are queued, the oldest ones are dropped.
+static size_t const max_prefetch_queue = 4096;
+
+BlockPrefetcher::BlockPrefetcher(bool enable) : M_stop(false)
+{
+  pthread_mutex_init(&M_mutex, NULL);
+  pthread_cond_init(&M_cond, NULL);
+  int nthreads = enable ? number_of_threads() - 1 : 0;
+  for (int i = 0; i < nthreads; ++i)
+  {
+    pthread_t thread;
+    int error = pthread_create(&thread, NULL, thread_main, this);
+    if (error)
+    {
+      std::cout << std::flush;
+      std::cerr << progname << ": pthread_create: " << strerror(error) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    M_threads.push_back(thread);
+  }
+}
+
+BlockPrefetcher::~BlockPrefetcher()
+{
+  pthread_mutex_lock(&M_mutex);
+  M_stop = true;
+  pthread_cond_broadcast(&M_cond);
+  pthread_mutex_unlock(&M_mutex);
+  for (std::vector<pthread_t>::iterator iter = M_threads.begin(); iter != M_threads.end(); ++iter)
+    pthread_join(*iter, NULL);
+  pthread_cond_destroy(&M_cond);
+  pthread_mutex_destroy(&M_mutex);
+}
+
+void BlockPrefetcher::prefetch(int block)
+{
+  if (M_threads.empty())
+    return;
+  pthread_mutex_lock(&M_mutex);
+  if (M_queue.size() == max_prefetch_queue)
+    M_queue.pop_front();
+  M_queue.push_back(block);
+  pthread_cond_signal(&M_cond);
+  pthread_mutex_unlock(&M_mutex);
+}
+
+void* BlockPrefetcher::thread_main(void* arg)
+{
+  Debug(debug::init_thread());
+  trace_thread_name("prefetcher");
+  BlockPrefetcher* self = static_cast<BlockPrefetcher*>(arg);
+  unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  pthread_mutex_lock(&self->M_mutex);
+  for(;;)
+  {
+    while (self->M_queue.empty() && !self->M_stop)
+      pthread_cond_wait(&self->M_cond, &self->M_mutex);
+    if (self->M_stop)
+      break;
+    int block = self->M_queue.back();
+    self->M_queue.pop_back();
+    pthread_mutex_unlock(&self->M_mutex);
+    get_block(block, block_buf);
+    pthread_mutex_lock(&self->M_mutex);
+  }
+  pthread_mutex_unlock(&self->M_mutex);
+  return NULL;
+}
@@ -0,0 +1,63 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file parallel.h Declaration of helper functions for running work on multiple threads.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+#endif
+
+// Return the number of threads to use (--threads, or the number of online CPUs).
+int number_of_threads(void);
+
+// Call work(index, data) for every index in [0, count).
+// The calls are distributed over number_of_threads() threads, including the calling thread,
+// and this function returns when all calls returned. The order of the calls is undefined.
+void for_each_parallel(size_t count, void (*work)(size_t index, void* data), void* data);
+
+// Reads blocks with get_block on background threads, so that they are in
+// the page cache by the time that the calling thread needs them.
+class BlockPrefetcher {
+  private:
+    std::vector<pthread_t> M_threads;
+    std::deque<int> M_queue;		// Blocks to read; the last one is read first.
+    pthread_mutex_t M_mutex;		// Protects M_queue and M_stop.
+    pthread_cond_t M_cond;
+    bool M_stop;
+
+    static void* thread_main(void* arg);
+
+  public:
+    // Start number_of_threads() - 1 threads, if enable is true.
+    BlockPrefetcher(bool enable);
+    ~BlockPrefetcher();
+
+    bool active(void) const { return !M_threads.empty(); }
+    void prefetch(int block);
+};
+
+#endif // PARALLEL_H
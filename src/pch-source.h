@@ -4,12 +4,16 @@
 #include <stdint.h>
 #include <endian.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <unistd.h>
 #include <utime.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <regex.h>
@@ -18,11 +22,13 @@
 #include <cctype>
 #include <cerrno>
 #include <climits>
+#include <cmath>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iosfwd>
@@ -40,6 +46,7 @@
 #include <vector>
 #include <bitset>
 #include <algorithm>
+#include <pthread.h>
 #include "ext3.h"
 #include "debug.h"
 #ifdef CWDEBUG
@@ -35,6 +35,7 @@
 #include "forward_declarations.h"
 #include "commandline.h"
 #include "print_dir_entry_long_action.h"
+#include "output.h"
 
 //-----------------------------------------------------------------------------
 //
@@ -45,6 +46,17 @@ void DirEntry::print(void) const
 {
   if (filtered)
     return;
+  if (output_format != output_text)
+  {
+    // The same states as the D, R and Z column of the normal output.
+    char const* state = zero_inode ? "zero_inode" : deleted ? reallocated ? "reallocated" : "deleted" : "allocated";
+    OutputRecord record("entry");
+    record.path(M_name).inode(M_inode).block(M_directory_iterator->block()).state(state);
+    if (!zero_inode && deleted && !reallocated)
+      record.dtime(get_inode(M_inode)->dtime());
+    output_record(record);
+    return;
+  }
   std::cout << std::setfill(' ') << std::setw(4) << index.cur << ' ';
   if (index.next)
     std::cout << std::setfill(' ') << std::setw(4) << index.next << ' ';
@@ -92,7 +104,6 @@ void DirectoryBlock::print(void) const
 
 void print_directory(unsigned char* block, int blocknr)
 {
-  depth = 1;
   if (commandline_ls)
   {
     if (feature_incompat_filetype)
@@ -0,0 +1,67 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file progress.cc Implementation of class Progress.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <iostream>
+#include <iomanip>
+#include "debug.h"
+#endif
+
+#include "stats.h"
+#include "progress.h"
+
+// The number of nanoseconds between two reports.
+static uint64_t const progress_interval = 10000000000ULL;
+
+Progress::Progress(char const* what, uint64_t total, size_t item_size) :
+    M_what(what), M_total(total), M_item_size(item_size), M_start_ns(stats_now_ns()),
+    M_next_report_ns(M_start_ns + progress_interval), M_calls(0)
+{
+}
+
+void Progress::check(uint64_t done)
+{
+  M_calls = 0;
+  uint64_t now = stats_now_ns();
+  if (now < M_next_report_ns)
+    return;
+  M_next_report_ns = now + progress_interval;
+  double seconds = (now - M_start_ns) * 1e-9;
+  double items_per_second = done / seconds;
+  std::ios_base::fmtflags old_flags = std::cerr.flags();
+  std::streamsize old_precision = std::cerr.precision(1);
+  std::cerr << std::fixed << M_what << ": " << (M_total ? 100.0 * done / M_total : 100.0) << "% (" << done << " of " << M_total << (M_item_size ? " blocks" : "") << "), ";
+  std::cerr << (uint64_t)items_per_second << (M_item_size ? " blocks/s" : " per second");
+  if (M_item_size)
+    std::cerr << ", " << (items_per_second * M_item_size / 1048576) << " MB/s";
+  if (items_per_second > 0 && done < M_total)
+  {
+    unsigned long remaining = (unsigned long)((M_total - done) / items_per_second);
+    std::cerr << ", ETA " << remaining / 3600 << ':' << std::setfill('0') << std::setw(2) << remaining / 60 % 60 <<
+        ':' << std::setw(2) << remaining % 60 << std::setfill(' ');
+  }
+  std::cerr << '.' << std::endl;
+  std::cerr.precision(old_precision);
+  std::cerr.flags(old_flags);
+}
@@ -0,0 +1,56 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file progress.h Declaration of class Progress.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <stdint.h>
+#endif
+
+// Reports the progress of a long loop over blocks or inodes.
+// A line with the percentage done, the speed and the estimated time
+// remaining is written to std::cerr at most once per ten seconds, so
+// loops that finish within ten seconds don't print anything at all.
+// A Progress object may only be used by one thread.
+class Progress {
+  private:
+    char const* M_what;			// What is being done, for example "Stage 1".
+    uint64_t M_total;			// The total number of items.
+    size_t M_item_size;			// The size of one item in bytes, or zero if the items aren't blocks.
+    uint64_t M_start_ns;
+    uint64_t M_next_report_ns;
+    unsigned int M_calls;		// The number of calls to update() since the clock was read.
+
+    void check(uint64_t done);
+
+  public:
+    Progress(char const* what, uint64_t total, size_t item_size);
+
+    // Call this with the number of items done so far, for example after every item.
+    // The clock is only read once per 1024 calls.
+    void update(uint64_t done) { if (++M_calls >= 1024) check(done); }
+};
+
+#endif // PROGRESS_H
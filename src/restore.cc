@@ -44,6 +44,10 @@
 #include "FileMode.h"
 #include "indirect_blocks.h"
 #include "print_symlink.h"
+#include "trace.h"
+#include "session.h"
+
+std::string outputdir = default_outputdir;
 
 #ifdef CPPGRAPH
 void iterate_over_all_blocks_of__with__restore_file_action(void) { restore_file_action(0, 0, NULL); }
@@ -88,7 +92,7 @@ struct Data {
 void restore_file_action(int blocknr, int file_block_nr, void* ptr)
 {
   Data& data(*reinterpret_cast<Data*>(ptr));
-  static unsigned char block_buf[EXT3_MAX_BLOCK_SIZE];
+  unsigned char* block_buf = scratch_block(scratch_restore_file);
   int len;
 
   if (data.expected_file_block_nr != file_block_nr)
@@ -171,6 +175,7 @@ void restore_file(std::string const& outfile)
 
 void restore_inode(int inodenr, InodePointer real_inode, std::string const& outfile, int seqnr)
 {
+  TraceSpan trace_span("restore_inode", "path", outfile);
   std::string outputdir_outfile = outputdir + outfile;
   if (is_directory(*real_inode))
   {
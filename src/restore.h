@@ -31,9 +31,13 @@
 #include "inode.h"	// Needed for InodePointer
 
 // Real constants.
-std::string const outputdir = "RESTORED_FILES/";
+std::string const default_outputdir = "RESTORED_FILES/";
 int const latest = -1;
 
+// The directory that files are restored into: default_outputdir, or the one
+// in the working directory of the client when running a query for --serve.
+extern std::string outputdir;
+
 void restore_inode(int inodenr, InodePointer real_inode, std::string const& outfile, int seqnr = latest);
 
 enum get_undeleted_inode_type {
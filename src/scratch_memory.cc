@@ -0,0 +1,310 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file scratch_memory.cc Implementation of memory-limited, file backed allocation of large tables.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "debug.h"
+#endif
+
+#include "scratch_memory.h"
+#include "commandline.h"
+#include "globals.h"
+
+namespace {
+
+// Protects everything below; scratch memory can be allocated and freed by any thread.
+pthread_mutex_t S_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// The number of bytes of heap memory currently allocated by scratch_alloc.
+size_t S_heap_in_use;
+
+// All spilled memory is backed by a single scratch file, which only grows.
+int S_scratch_fd = -1;
+off_t S_scratch_size;
+
+// A memory region that is backed by the scratch file.
+struct spilled_region {
+  off_t offset;			// The offset of the region in the scratch file, or -1 if it was inherited (see scratch_memory_forked).
+  size_t size;			// The size of the region, a multiple of the page size.
+};
+
+// Memory regions that are backed by the scratch file, and the ranges of the
+// scratch file that are free again, by offset. These maps are never destructed,
+// so that global containers that use scratch memory can still be destructed after them.
+typedef std::map<void*, spilled_region> spilled_type;
+spilled_type& S_spilled(*new spilled_type);
+typedef std::map<off_t, size_t> free_ranges_type;
+free_ranges_type& S_free_ranges(*new free_ranges_type);
+
+// Small objects are allocated from chunks of chunk_size bytes.
+size_t const chunk_size = 16 * 1024 * 1024;
+size_t const node_alignment = 8;
+size_t const max_node_size = 256;
+
+// One free list per node size (in units of node_alignment).
+void* S_free_list[max_node_size / node_alignment + 1];
+// The chunk that small objects are currently allocated from.
+char* S_chunk_ptr;
+size_t S_chunk_left;
+
+void scratch_error(char const* what, std::string const& path, int error)
+{
+  std::cout << std::flush;
+  std::cerr << progname << ": " << what << " \"" << path << "\": " << strerror(error) << std::endl;
+  exit(EXIT_FAILURE);
+}
+
+void create_scratch_file(void)
+{
+  static bool announced = false;	// A forked child doesn't announce it again.
+  if (!announced)
+  {
+    std::cout << "Memory limit of " << commandline_memory_limit << " bytes reached; using a scratch file in \"" <<
+        commandline_scratch_dir << "\".\n";
+    announced = true;
+  }
+  std::string path = commandline_scratch_dir + "/ext3grep.scratch.XXXXXX";
+  std::vector<char> filename(path.begin(), path.end());
+  filename.push_back('\0');
+  S_scratch_fd = mkstemp(&filename[0]);
+  if (S_scratch_fd == -1)
+    scratch_error("failed to create scratch file", path, errno);
+  // We only need the file descriptor: the file disappears when the program exits.
+  unlink(&filename[0]);
+}
+
+// Return the offset of a free range of 'size' bytes in the scratch file, that reads as zeroes.
+off_t scratch_file_alloc(size_t size)
+{
+  // Use the first free range that is large enough.
+  for (free_ranges_type::iterator iter = S_free_ranges.begin(); iter != S_free_ranges.end(); ++iter)
+  {
+    if (iter->second < size)
+      continue;
+    off_t offset = iter->first;
+    size_t left = iter->second - size;
+    S_free_ranges.erase(iter);
+    if (left)
+      S_free_ranges[offset + size] = left;
+    return offset;
+  }
+  // Otherwise grow the file; the new part reads as zeroes.
+  off_t offset = S_scratch_size;
+  if (ftruncate(S_scratch_fd, offset + size) == -1)
+    scratch_error("failed to grow scratch file in", commandline_scratch_dir, errno);
+  S_scratch_size = offset + size;
+  return offset;
+}
+
+// Return the range of 'size' bytes at 'offset' to the free ranges of the scratch file.
+void scratch_file_free(off_t offset, size_t size)
+{
+  // Release the disk space; this also makes the range read as zeroes when it is used again.
+  if (fallocate(S_scratch_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, size) == -1)
+  {
+    // The file system doesn't support punching holes.
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, S_scratch_fd, offset);
+    if (ptr == MAP_FAILED)
+      scratch_error("failed to mmap scratch file in", commandline_scratch_dir, errno);
+    std::memset(ptr, 0, size);
+    munmap(ptr, size);
+  }
+  // Merge with the adjacent free ranges.
+  free_ranges_type::iterator next = S_free_ranges.lower_bound(offset);
+  if (next != S_free_ranges.end() && offset + (off_t)size == next->first)
+  {
+    size += next->second;
+    S_free_ranges.erase(next++);
+  }
+  if (next != S_free_ranges.begin())
+  {
+    free_ranges_type::iterator prev = next;
+    --prev;
+    if (prev->first + (off_t)prev->second == offset)
+    {
+      prev->second += size;
+      return;
+    }
+  }
+  S_free_ranges[offset] = size;
+}
+
+void* spill_alloc(size_t size)
+{
+  if (S_scratch_fd == -1)
+    create_scratch_file();
+  // Offsets passed to mmap must be a multiple of the page size.
+  size_t const page_size = sysconf(_SC_PAGESIZE);
+  size = (size + page_size - 1) & ~(page_size - 1);
+  off_t offset = scratch_file_alloc(size);
+  void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, S_scratch_fd, offset);
+  if (ptr == MAP_FAILED)
+    scratch_error("failed to mmap scratch file in", commandline_scratch_dir, errno);
+  spilled_region& region(S_spilled[ptr]);
+  region.offset = offset;
+  region.size = size;
+  return ptr;
+}
+
+inline size_t round_node_size(size_t size)
+{
+  return size ? ((size + node_alignment - 1) & ~(node_alignment - 1)) : node_alignment;
+}
+
+// The functions below must be called with S_mutex locked.
+
+void* alloc_locked(size_t size)
+{
+  if (commandline_memory_limit && S_heap_in_use + size > commandline_memory_limit)
+    return spill_alloc(size);	// Newly created files read as zeroes.
+  char* ptr = new char [size];
+  std::memset(ptr, 0, size);
+  S_heap_in_use += size;
+  return ptr;
+}
+
+void free_locked(void* ptr, size_t size)
+{
+  spilled_type::iterator iter = S_spilled.find(ptr);
+  if (iter != S_spilled.end())
+  {
+    munmap(ptr, iter->second.size);
+    if (iter->second.offset != -1)
+      scratch_file_free(iter->second.offset, iter->second.size);
+    S_spilled.erase(iter);
+    return;
+  }
+  delete [] static_cast<char*>(ptr);
+  S_heap_in_use -= size;
+}
+
+void* node_alloc_locked(size_t size)
+{
+  if (size > max_node_size)
+    return alloc_locked(size);
+  size = round_node_size(size);
+  void*& free_list(S_free_list[size / node_alignment]);
+  if (free_list)
+  {
+    void* ptr = free_list;
+    free_list = *static_cast<void**>(ptr);
+    return ptr;
+  }
+  if (S_chunk_left < size)
+  {
+    // The remainder of the previous chunk (less than max_node_size bytes) is lost.
+    S_chunk_ptr = static_cast<char*>(alloc_locked(chunk_size));
+    S_chunk_left = chunk_size;
+  }
+  void* ptr = S_chunk_ptr;
+  S_chunk_ptr += size;
+  S_chunk_left -= size;
+  return ptr;
+}
+
+void node_free_locked(void* ptr, size_t size)
+{
+  if (size > max_node_size)
+  {
+    free_locked(ptr, size);
+    return;
+  }
+  size = round_node_size(size);
+  *static_cast<void**>(ptr) = S_free_list[size / node_alignment];
+  S_free_list[size / node_alignment] = ptr;
+}
+
+} // namespace
+
+void* scratch_alloc(size_t size)
+{
+  pthread_mutex_lock(&S_mutex);
+  void* ptr = alloc_locked(size);
+  pthread_mutex_unlock(&S_mutex);
+  return ptr;
+}
+
+void scratch_free(void* ptr, size_t size)
+{
+  if (!ptr)
+    return;
+  pthread_mutex_lock(&S_mutex);
+  free_locked(ptr, size);
+  pthread_mutex_unlock(&S_mutex);
+}
+
+void* scratch_node_alloc(size_t size)
+{
+  if (!commandline_memory_limit)
+    return ::operator new(size);
+  pthread_mutex_lock(&S_mutex);
+  void* ptr = node_alloc_locked(size);
+  pthread_mutex_unlock(&S_mutex);
+  return ptr;
+}
+
+void scratch_node_free(void* ptr, size_t size)
+{
+  if (!commandline_memory_limit)
+  {
+    ::operator delete(ptr);
+    return;
+  }
+  pthread_mutex_lock(&S_mutex);
+  node_free_locked(ptr, size);
+  pthread_mutex_unlock(&S_mutex);
+}
+
+void scratch_memory_forked(void)
+{
+  pthread_mutex_lock(&S_mutex);
+  if (S_scratch_fd != -1)
+  {
+    // Replace the shared mappings by private ones with the same contents, at the same addresses.
+    for (spilled_type::iterator iter = S_spilled.begin(); iter != S_spilled.end(); ++iter)
+    {
+      if (iter->second.offset == -1)
+        continue;
+      if (mmap(iter->first, iter->second.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, S_scratch_fd, iter->second.offset) == MAP_FAILED)
+	scratch_error("failed to mmap scratch file in", commandline_scratch_dir, errno);
+      iter->second.offset = -1;
+    }
+    // Memory spilled by this process goes to a scratch file of its own.
+    close(S_scratch_fd);
+    S_scratch_fd = -1;
+    S_scratch_size = 0;
+    S_free_ranges.clear();
+  }
+  pthread_mutex_unlock(&S_mutex);
+}
@@ -0,0 +1,86 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file scratch_memory.h Declaration of the scratch memory allocation functions.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SCRATCH_MEMORY_H
+#define SCRATCH_MEMORY_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <new>
+#endif
+
+// Tables whose size scales with the size of the file system are allocated
+// with the functions below. Without --memory-limit this is just heap memory.
+// With --memory-limit, heap memory is used until the limit is reached, after
+// which new tables are backed by ranges of a single (unlinked) file in
+// --scratch-dir that are mmap-ed MAP_SHARED. The kernel then writes cold pages back to that file
+// and pages them in again when needed, instead of using swap or running out
+// of memory. All functions are thread-safe.
+
+// Allocate 'size' bytes of zeroed memory.
+void* scratch_alloc(size_t size);
+// Free memory returned by scratch_alloc. 'size' must be the size that was passed to scratch_alloc.
+void scratch_free(void* ptr, size_t size);
+
+// Allocate and free small objects (nodes of std::map and the like).
+void* scratch_node_alloc(size_t size);
+void scratch_node_free(void* ptr, size_t size);
+
+// Call this in a child process after fork(). The memory that the child inherited from the
+// scratch file becomes private to the child, and the child spills to a scratch file of its own,
+// so that it can't change or free the scratch memory of its parent.
+void scratch_memory_forked(void);
+
+// STL allocator that allocates with scratch_node_alloc.
+template<typename T>
+class scratch_allocator {
+  public:
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef T* pointer;
+    typedef T const* const_pointer;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef T value_type;
+    template<typename U> struct rebind { typedef scratch_allocator<U> other; };
+
+    scratch_allocator(void) { }
+    scratch_allocator(scratch_allocator const&) { }
+    template<typename U> scratch_allocator(scratch_allocator<U> const&) { }
+
+    pointer address(reference x) const { return &x; }
+    const_pointer address(const_reference x) const { return &x; }
+    pointer allocate(size_type n, void const* = 0) { return static_cast<pointer>(scratch_node_alloc(n * sizeof(T))); }
+    void deallocate(pointer p, size_type n) { scratch_node_free(p, n * sizeof(T)); }
+    size_type max_size(void) const { return static_cast<size_type>(-1) / sizeof(T); }
+    void construct(pointer p, T const& val) { new (static_cast<void*>(p)) T(val); }
+    void destroy(pointer p) { p->~T(); }
+};
+
+template<typename T1, typename T2>
+inline bool operator==(scratch_allocator<T1> const&, scratch_allocator<T2> const&) { return true; }
+
+template<typename T1, typename T2>
+inline bool operator!=(scratch_allocator<T1> const&, scratch_allocator<T2> const&) { return false; }
+
+#endif // SCRATCH_MEMORY_H
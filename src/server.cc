@@ -0,0 +1,382 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file server.cc Implementation of --serve and --client.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "commandline.h"
+#include "forward_declarations.h"
+#include "init_directories.h"
+#include "directories.h"
+#include "restore.h"
+#include "scratch_memory.h"
+#include "server.h"
+
+extern int optind;
+
+bool serving_query = false;
+
+namespace {
+
+// Requests larger than this are refused.
+size_t const max_request_size = 65536;
+
+void fill_address(std::string const& socket_path, struct sockaddr_un& address, char const* option)
+{
+  if (socket_path.length() >= sizeof(address.sun_path))
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": " << option << ": \"" << socket_path << "\": path too long for a unix socket." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, socket_path.c_str());
+}
+
+// Read the working directory of the client and the arguments of one query from 'fd'.
+// Return false if the request is incomplete or too large.
+bool read_request(int fd, std::string& cwd, std::vector<std::string>& arguments)
+{
+  std::string request;
+  char buf[4096];
+  while (request.find("\n\n") == std::string::npos && request != "\n")
+  {
+    ssize_t len = ::read(fd, buf, sizeof(buf));
+    if (len == -1 && errno == EINTR)
+      continue;
+    if (len <= 0 || request.size() + len > max_request_size)
+      return false;
+    request.append(buf, len);
+  }
+  std::string::size_type pos = 0;
+  for (;;)
+  {
+    std::string::size_type end = request.find('\n', pos);
+    if (end == pos)
+      break;
+    arguments.push_back(request.substr(pos, end - pos));
+    pos = end + 1;
+  }
+  if (arguments.empty())
+    return false;
+  cwd = arguments.front();
+  arguments.erase(arguments.begin());
+  return true;
+}
+
+// Run one query in the child process, with stdout and stderr connected to the client.
+void run_query(std::string const& cwd, std::vector<std::string> const& arguments)
+{
+  std::vector<char*> argv;
+  argv.push_back(const_cast<char*>(progname));
+  for (std::vector<std::string>::const_iterator iter = arguments.begin(); iter != arguments.end(); ++iter)
+    argv.push_back(const_cast<char*>(iter->c_str()));
+  argv.push_back(const_cast<char*>(device_name.c_str()));
+  argv.push_back(NULL);
+  int argc = argv.size() - 1;
+  char** argvp = &argv[0];
+  // The options that took effect when the server started can't be changed by a query.
+  size_t memory_limit = commandline_memory_limit;
+  std::string scratch_dir = commandline_scratch_dir;
+  int threads = commandline_threads;
+  size_t block_cache = commandline_block_cache;
+  std::string stats = commandline_stats;
+  std::string trace = commandline_trace;
+  int max_warnings = commandline_max_warnings;
+  // Start from the defaults, not from the options of the server.
+  reset_commandline_options();
+  serving_query = true;
+  optind = 0;		// Reinitialize getopt.
+  decode_commandline_options(argc, argvp);
+  commandline_memory_limit = memory_limit;
+  commandline_scratch_dir = scratch_dir;
+  commandline_threads = threads;
+  commandline_block_cache = block_cache;
+  commandline_stats = stats;
+  commandline_trace = trace;
+  commandline_max_warnings = max_warnings;
+  if (argc != 1)
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": the device is given by the server; don't pass it in a query." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // The loaded directories were filtered with the options of the server.
+  forget_parsed_directory_blocks();
+  for (all_directories_type::iterator directory = all_directories.begin(); directory != all_directories.end(); ++directory)
+    for (std::list<DirectoryBlock>::iterator block = directory->second.blocks().begin(); block != directory->second.blocks().end(); ++block)
+      block->refilter();
+  // Restore files relative to the working directory of the client.
+  outputdir = cwd + '/' + default_outputdir;
+  run_program();
+}
+
+// Write all of 'len' bytes at 'ptr' to 'fd'. Return false on error.
+bool write_all(int fd, char const* ptr, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t written = ::write(fd, ptr, len);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written == -1)
+      return false;
+    ptr += written;
+    len -= written;
+  }
+  return true;
+}
+
+// Run the query in a child process, wait for it and send its exit status to the client.
+// This runs in a child of the server, so that queries run concurrently.
+void handle_connection(int fd, std::string const& cwd, std::vector<std::string> const& arguments)
+{
+  server_trailer_st trailer;
+  std::memcpy(trailer.magic, server_trailer_magic, sizeof(trailer.magic));
+  trailer.exit_status = EXIT_FAILURE;
+  trailer.signal = 0;
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    scratch_memory_forked();
+    dup2(fd, 1);
+    dup2(fd, 2);
+    close(fd);
+    run_query(cwd, arguments);
+    exit(EXIT_SUCCESS);
+  }
+  if (pid == -1)
+  {
+    int error = errno;
+    std::string msg = std::string(progname) + ": --serve: fork: " + strerror(error) + '\n';
+    write_all(fd, msg.data(), msg.size());
+  }
+  else
+  {
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+      ASSERT(errno == EINTR);
+    if (WIFEXITED(status))
+      trailer.exit_status = WEXITSTATUS(status);
+    else if (WIFSIGNALED(status))
+      trailer.signal = WTERMSIG(status);
+  }
+  write_all(fd, reinterpret_cast<char const*>(&trailer), sizeof(trailer));
+  close(fd);
+}
+
+} // namespace
+
+void run_server(std::string const& socket_path)
+{
+  // Everything that is loaded here is inherited by the children that run the queries.
+  init_directories();
+  init_files();
+
+  struct sockaddr_un address;
+  fill_address(socket_path, address, "--serve");
+  // Remove a socket that was left behind by a previous server, but nothing else.
+  struct stat statbuf;
+  if (lstat(socket_path.c_str(), &statbuf) == 0 && S_ISSOCK(statbuf.st_mode))
+    unlink(socket_path.c_str());
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  // Only the user that runs the server may connect: queries can restore files anywhere that user can write.
+  mode_t old_umask = umask(0077);
+  bool bound = listen_fd != -1 && bind(listen_fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0;
+  umask(old_umask);
+  if (!bound || chmod(socket_path.c_str(), 0600) == -1 || listen(listen_fd, 16) == -1)
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": --serve: \"" << socket_path << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cout << "Listening on " << socket_path << std::endl;
+
+  // Queries run concurrently; the children of the server are reaped automatically.
+  signal(SIGCHLD, SIG_IGN);
+
+  for (;;)
+  {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd == -1)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      int error = errno;
+      std::cout << std::flush;
+      std::cerr << progname << ": --serve: accept: " << strerror(error) << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    std::string cwd;
+    std::vector<std::string> arguments;
+    if (!read_request(fd, cwd, arguments))
+    {
+      close(fd);
+      continue;
+    }
+    // Anything still buffered would otherwise be written again by the child.
+    std::cout << std::flush;
+    std::cerr << std::flush;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+      signal(SIGCHLD, SIG_DFL);
+      close(listen_fd);
+      handle_connection(fd, cwd, arguments);
+      _exit(EXIT_SUCCESS);	// Don't run the exit handlers of the server.
+    }
+    if (pid == -1)
+    {
+      int error = errno;
+      std::cerr << progname << ": --serve: fork: " << strerror(error) << std::endl;
+    }
+    close(fd);
+  }
+}
+
+bool client_commandline(int argc, char* argv[], std::string& socket_path, std::vector<std::string>& arguments)
+{
+  bool client = false;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strncmp(argv[i], "--client=", 9) == 0)
+    {
+      socket_path = argv[i] + 9;
+      client = true;
+    }
+    else if (std::strcmp(argv[i], "--client") == 0 && i + 1 < argc)
+    {
+      socket_path = argv[++i];
+      client = true;
+    }
+    else
+      arguments.push_back(argv[i]);
+  }
+  return client;
+}
+
+int run_client(std::string const& socket_path, std::vector<std::string> const& arguments)
+{
+  struct sockaddr_un address;
+  fill_address(socket_path, address, "--client");
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1 || connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == -1)
+  {
+    int error = errno;
+    std::cerr << progname << ": --client: \"" << socket_path << "\": " << strerror(error) << std::endl;
+    return EXIT_FAILURE;
+  }
+  // The first line is the working directory, so that files are restored where the client runs.
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd)))
+  {
+    int error = errno;
+    std::cerr << progname << ": --client: getcwd: " << strerror(error) << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (std::strchr(cwd, '\n'))
+  {
+    std::cerr << progname << ": --client: the current directory can't contain a newline." << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string request = cwd;
+  request += '\n';
+  for (std::vector<std::string>::const_iterator iter = arguments.begin(); iter != arguments.end(); ++iter)
+  {
+    if (iter->empty() || iter->find('\n') != std::string::npos)
+    {
+      std::cerr << progname << ": --client: arguments can't be empty or contain a newline." << std::endl;
+      return EXIT_FAILURE;
+    }
+    request += *iter;
+    request += '\n';
+  }
+  request += '\n';
+  if (!write_all(fd, request.data(), request.size()))
+  {
+    int error = errno;
+    std::cerr << progname << ": --client: write: " << strerror(error) << std::endl;
+    return EXIT_FAILURE;
+  }
+  shutdown(fd, SHUT_WR);
+  // The answer ends with a server_trailer_st, so the last sizeof(server_trailer_st) bytes
+  // received are held back until more data arrives.
+  size_t const trailer_size = sizeof(server_trailer_st);
+  char buf[65536 + sizeof(server_trailer_st)];
+  size_t held = 0;
+  ssize_t received;
+  while ((received = ::read(fd, buf + held, sizeof(buf) - held)) != 0)
+  {
+    if (received == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      int error = errno;
+      std::cerr << progname << ": --client: read: " << strerror(error) << std::endl;
+      return EXIT_FAILURE;
+    }
+    held += received;
+    if (held > trailer_size)
+    {
+      std::cout.write(buf, held - trailer_size);
+      std::memmove(buf, buf + held - trailer_size, trailer_size);
+      held = trailer_size;
+    }
+  }
+  std::cout << std::flush;
+  close(fd);
+  server_trailer_st trailer;
+  bool complete = held == trailer_size;
+  if (complete)
+  {
+    std::memcpy(&trailer, buf, trailer_size);
+    complete = std::memcmp(trailer.magic, server_trailer_magic, sizeof(trailer.magic)) == 0;
+  }
+  if (!complete)
+  {
+    std::cerr << progname << ": --client: the server closed the connection before the query finished." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (trailer.signal)
+  {
+    std::cerr << progname << ": --client: the query was killed by signal " << trailer.signal << " (" << strsignal(trailer.signal) << ")." << std::endl;
+    return EXIT_FAILURE;
+  }
+  return trailer.exit_status;
+}
@@ -0,0 +1,64 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file server.h Declaration of --serve and --client.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#ifndef USE_PCH
+#include <stdint.h>
+#include <string>
+#include <vector>
+#endif
+
+// The protocol between --client and --serve: the client connects to the unix
+// socket and sends the commandline options of one query, one per line, followed
+// by an empty line. The server answers with the output that ext3grep would have
+// written for those options, followed by a server_trailer_st with the exit status
+// of the query, and closes the connection.
+
+struct server_trailer_st {
+  char magic[8];		// server_trailer_magic.
+  int32_t exit_status;		// The exit status of the query, if it wasn't killed.
+  int32_t signal;		// The signal that killed the query, or 0.
+};
+
+char const server_trailer_magic[8] = { 'e', '3', 'g', 'e', 'x', 'i', 't', '1' };
+
+// True in the child process that runs a query for --serve. The query then doesn't
+// print the banner and other lines that were already printed when the server started.
+extern bool serving_query;
+
+// Load the stage 1 and 2 caches and the files, listen on 'socket_path' and answer
+// queries until the program is killed. Each query is run in a child process,
+// so that it starts with everything loaded and can't change the state of the server.
+void run_server(std::string const& socket_path);
+
+// Return true if the commandline contains --client=socket or --client socket.
+// In that case 'socket_path' is set and 'arguments' contains all other arguments.
+bool client_commandline(int argc, char* argv[], std::string& socket_path, std::vector<std::string>& arguments);
+
+// Send 'arguments' to the server listening on 'socket_path' and copy the answer to stdout.
+// Returns the exit status of the query, or EXIT_FAILURE if it was killed or the answer is incomplete.
+int run_client(std::string const& socket_path, std::vector<std::string> const& arguments);
+
+#endif // SERVER_H
@@ -0,0 +1,199 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file session.cc Implementation of class FilesystemSession and the per-thread scratch buffers.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "ext3.h"
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "inode.h"
+#include "init_consts.h"
+#include "session.h"
+
+namespace {
+
+pthread_once_t S_scratch_once = PTHREAD_ONCE_INIT;
+pthread_key_t S_scratch_key;			// Points to an array of number_of_scratch_buffers buffers.
+bool S_scratch_key_created = false;
+
+void free_scratch_blocks(void* ptr)
+{
+  unsigned char** buffers = static_cast<unsigned char**>(ptr);
+  for (int i = 0; i < number_of_scratch_buffers; ++i)
+    delete [] buffers[i];
+  delete [] buffers;
+}
+
+void create_scratch_key(void)
+{
+  int error = pthread_key_create(&S_scratch_key, free_scratch_blocks);
+  if (error)
+  {
+    std::cout << std::flush;
+    std::cerr << progname << ": pthread_key_create: " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  S_scratch_key_created = true;
+}
+
+// The destructor of S_scratch_key is not called for the main thread.
+void free_scratch_blocks_of_calling_thread(void)
+{
+  if (!S_scratch_key_created)
+    return;
+  void* buffers = pthread_getspecific(S_scratch_key);
+  if (buffers)
+  {
+    pthread_setspecific(S_scratch_key, NULL);
+    free_scratch_blocks(buffers);
+  }
+}
+
+} // namespace
+
+FilesystemSession::FilesystemSession(char const* device_path)
+{
+  struct stat statbuf;
+  if (stat(device_path, &statbuf) == -1)
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": stat \"" << device_path << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (S_ISDIR(statbuf.st_mode))
+  {
+    std::cerr << progname << ": \"" << device_path << "\" is a directory. You need to use the raw ext3 filesystem device (or a copy thereof)." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (!S_ISBLK(statbuf.st_mode) && statbuf.st_size < SUPER_BLOCK_OFFSET + 1024)
+  {
+    std::cerr << progname << ": \"" << device_path << "\" is not an ext3 fs; it's WAY too small (" << statbuf.st_size << " bytes)." << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Open the device.
+  device.open(device_path);
+  if (!device.good())
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": failed to read-only open device \"" << device_path << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  device_fd = open(device_path, O_RDONLY);
+  if (device_fd == -1)
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": failed to open device \"" << device_path << "\" for reading: " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Read the first superblock.
+
+  // The size of a super block is 1024 bytes.
+  assert(sizeof(ext3_super_block) == 1024);
+  device.seekg(SUPER_BLOCK_OFFSET);
+  if (!device.good())
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": failed to seek to position " << SUPER_BLOCK_OFFSET << " of \"" << device_path << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // super_block is initialized here.
+  device.read(reinterpret_cast<char*>(&super_block), sizeof(ext3_super_block));
+  if (!device.good())
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": failed to read first superblock from \"" << device_path << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Initialize global constants.
+  device_name = device_path;
+  init_consts();
+}
+
+FilesystemSession::~FilesystemSession()
+{
+  delete [] inodes_buf;
+  for (int group = 0; group < groups_; ++group)
+  {
+    if (block_bitmap[group])
+    {
+      delete [] inode_bitmap[group];
+      delete [] block_bitmap[group];
+#if !USE_MMAP
+      delete [] all_inodes[group];
+#endif
+    }
+#if USE_MMAP
+    if (all_inodes[group])
+      inode_unmap(group);
+#endif
+  }
+  delete [] inode_bitmap;
+  delete [] block_bitmap;
+  delete [] all_inodes;
+#if USE_MMAP
+  ASSERT(nr_mmaps == 0);
+  delete [] all_mmaps;
+  delete [] refs_to_mmap;
+#endif
+  delete [] group_descriptor_table;
+
+  device.close();
+  close(device_fd);
+
+  free_scratch_blocks_of_calling_thread();
+}
+
+unsigned char* scratch_block(scratch_buffer_type buffer)
+{
+  pthread_once(&S_scratch_once, create_scratch_key);
+  unsigned char** buffers = static_cast<unsigned char**>(pthread_getspecific(S_scratch_key));
+  if (!buffers)
+  {
+    buffers = new unsigned char* [number_of_scratch_buffers];
+    std::memset(buffers, 0, sizeof(unsigned char*) * number_of_scratch_buffers);
+    pthread_setspecific(S_scratch_key, buffers);
+  }
+  if (!buffers[buffer])
+    buffers[buffer] = new unsigned char [EXT3_MAX_BLOCK_SIZE];
+  return buffers[buffer];
+}
@@ -0,0 +1,63 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file session.h Declaration of class FilesystemSession and the per-thread scratch buffers.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SESSION_H
+#define SESSION_H
+
+// A FilesystemSession opens the device and reads the superblock, and frees what
+// was loaded from the device when it is destructed. It does not hold that state:
+// the superblock, the constants derived from it, the group descriptor table, the
+// bitmaps, the inode tables and the journal are globals (see README.globals),
+// so there can only be one session per process.
+class FilesystemSession {
+  public:
+    // Open 'device_path', read the superblock and call init_consts().
+    // Prints an error and exits if 'device_path' isn't a usable device.
+    FilesystemSession(char const* device_path);
+    // Free the loaded bitmaps and inode tables, close the device and free
+    // the scratch buffers of the calling (main) thread.
+    ~FilesystemSession();
+
+  private:
+    FilesystemSession(FilesystemSession const&);
+    FilesystemSession& operator=(FilesystemSession const&);
+};
+
+// Block sized buffers that are private to the calling thread, for functions
+// that used to have a function-local static buffer. Each function uses its
+// own buffer, so that they can call each other.
+enum scratch_buffer_type {
+  scratch_restore_file,			// restore_file_action
+  scratch_iterate_over_journal,		// iterate_over_journal
+  scratch_directory_block,		// DirectoryBlock::read_block
+  scratch_print_directory,		// print_directory_action
+  scratch_extended_directory,		// extended_directory_action
+  scratch_journal_inodes,		// get_inodes_from_journal
+  number_of_scratch_buffers
+};
+
+// Return the buffer 'buffer' of the calling thread (EXT3_MAX_BLOCK_SIZE bytes).
+// The buffers are freed when the thread exits; those of the main thread by ~FilesystemSession.
+unsigned char* scratch_block(scratch_buffer_type buffer);
+
+#endif // SESSION_H
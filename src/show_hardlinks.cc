@@ -35,6 +35,7 @@
 #include "forward_declarations.h"
 #include "init_files.h"
 #include "init_directories.h"
+#include "output.h"
 
 void show_hardlinks(void)
 {
@@ -75,7 +76,8 @@ void show_hardlinks(void)
   {
     if (iter->second.size() > 1)
     {
-      std::cout << "Inode " << iter->first << ":\n";
+      if (output_format == output_text)
+	std::cout << "Inode " << iter->first << ":\n";
       for (std::vector<path_to_inode_map_type::iterator>::iterator iter3 = iter->second.begin(); iter3 != iter->second.end(); ++iter3)
       {
 	std::string::size_type slash = (*iter3)->first.find_last_of('/');
@@ -83,7 +85,10 @@ void show_hardlinks(void)
 	std::string dirname = (*iter3)->first.substr(0, slash);
         all_directories_type::iterator iter5 = all_directories.find(dirname);
 	ASSERT(iter5 != all_directories.end());
-        std::cout << "  " << (*iter3)->first << " (" << iter5->second.inode_number() << ")\n";
+        if (output_format != output_text)
+	  output_record(OutputRecord("hardlink").path((*iter3)->first).inode(iter->first));
+	else
+	  std::cout << "  " << (*iter3)->first << " (" << iter5->second.inode_number() << ")\n";
       }
 #if 0
       // Try to figure out which directory it belongs to.
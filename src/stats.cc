@@ -0,0 +1,186 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file stats.cc Implementation of --stats.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <sys/time.h>
+#include <unistd.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "block_cache.h"
+#include "utils.h"
+#include "stats.h"
+
+uint64_t stats_counters_[max_stats_phases][number_of_stats_counters];
+int volatile stats_phase_;
+bool stats_timing_;
+
+namespace {
+
+struct PhaseStats {
+  uint64_t ns;					// The time spent in this phase, excluding nested phases.
+  long rss_kb;					// The resident set size when this phase was left the last time.
+  long peak_rss_kb;				// The peak resident set size of the process at that moment.
+  uint64_t latency[stats_latency_buckets];	// The get_block latency histogram.
+};
+
+char const* S_phase_names[max_stats_phases] = { "startup" };
+PhaseStats S_phases[max_stats_phases];
+int S_number_of_phases = 1;
+uint64_t S_start_ns = stats_now_ns();		// The start of the program.
+uint64_t S_switch_ns = S_start_ns;		// The time that the current phase was entered.
+std::string S_filename;
+long S_peak_rss_kb;				// The largest resident set size seen so far.
+
+// Read the resident set size (VmRSS) and its peak (VmHWM) from /proc/self/status,
+// so that both are measured the same way. VmHWM is not always updated when the
+// resident set shrinks, so the peak is also the largest VmRSS that was read.
+void read_rss_kb(long& rss_kb, long& peak_rss_kb)
+{
+  rss_kb = peak_rss_kb = 0;
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line))
+  {
+    if (line.compare(0, 6, "VmRSS:") == 0)
+      rss_kb = std::atol(line.c_str() + 6);
+    else if (line.compare(0, 6, "VmHWM:") == 0)
+      peak_rss_kb = std::atol(line.c_str() + 6);
+  }
+  S_peak_rss_kb = std::max(S_peak_rss_kb, std::max(rss_kb, peak_rss_kb));
+  peak_rss_kb = S_peak_rss_kb;
+}
+
+// Make 'phase' the current phase.
+void switch_phase(int phase)
+{
+  uint64_t now = stats_now_ns();
+  PhaseStats& current(S_phases[stats_phase_]);
+  current.ns += now - S_switch_ns;
+  read_rss_kb(current.rss_kb, current.peak_rss_kb);
+  S_switch_ns = now;
+  stats_phase_ = phase;
+}
+
+void write_stats(void)
+{
+  switch_phase(stats_phase_);
+  std::ofstream out(S_filename.c_str(), std::ios::trunc);
+  char const* const counter_names[number_of_stats_counters] = {
+    "get_block_calls", "block_cache_hits", "dir_block_store_hits", "blocks_read", "bytes_read",
+    "is_directory_no", "is_directory_start", "is_directory_extended",
+    "journal_descriptors", "inode_mmaps", "inode_unmaps"
+  };
+  BlockCacheStatistics block_cache = block_cache_statistics();
+  long rss_kb, peak_rss_kb;
+  read_rss_kb(rss_kb, peak_rss_kb);
+  out << "{\n  \"device\": \"" << json_escape(device_name) << "\",\n";
+  out << "  \"seconds\": " << (S_switch_ns - S_start_ns) * 1e-9 << ",\n";
+  out << "  \"peak_rss_kb\": " << peak_rss_kb << ",\n";
+  out << "  \"block_cache\": {\"hits\": " << block_cache.hits << ", \"misses\": " << block_cache.misses << "},\n";
+  out << "  \"phases\": [";
+  for (int phase = 0; phase < S_number_of_phases; ++phase)
+  {
+    PhaseStats const& stats(S_phases[phase]);
+    uint64_t const* counters = stats_counters_[phase];
+    out << (phase ? ",\n" : "\n") << "    {\"name\": \"" << S_phase_names[phase] << "\", \"seconds\": " << stats.ns * 1e-9 <<
+        ", \"rss_kb\": " << stats.rss_kb << ", \"peak_rss_kb\": " << stats.peak_rss_kb;
+    for (int counter = 0; counter < number_of_stats_counters; ++counter)
+      out << ", \"" << counter_names[counter] << "\": " << counters[counter];
+    uint64_t calls = counters[stats_get_block_calls];
+    out << ", \"block_cache_hit_rate\": " << (calls ? (double)counters[stats_block_cache_hits] / calls : 0);
+    out << ", \"get_block_latency_ns\": {";
+    char const* separator = "";
+    for (int bucket = 0; bucket < stats_latency_buckets; ++bucket)
+    {
+      if (!stats.latency[bucket])
+        continue;
+      out << separator << "\"<" << (1ULL << bucket) << "\": " << stats.latency[bucket];
+      separator = ", ";
+    }
+    out << "}}";
+  }
+  out << "\n  ]\n}\n";
+  out.close();
+  if (out.fail())
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": --stats: failed to write \"" << S_filename << "\": " << strerror(error) << std::endl;
+  }
+}
+
+} // namespace
+
+uint64_t stats_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void stats_get_block_done(uint64_t start)
+{
+  if (!start)
+    return;
+  uint64_t ns = stats_now_ns() - start;
+  int bucket = 0;
+  while (ns >> bucket && bucket < stats_latency_buckets - 1)
+    ++bucket;
+  __sync_fetch_and_add(&S_phases[stats_phase_].latency[bucket], 1);
+}
+
+StatsPhase::StatsPhase(char const* name) : M_previous(stats_phase_)
+{
+  int phase = 0;
+  while (phase < S_number_of_phases && std::strcmp(S_phase_names[phase], name) != 0)
+    ++phase;
+  if (phase == S_number_of_phases)
+  {
+    ASSERT(S_number_of_phases < max_stats_phases);
+    S_phase_names[S_number_of_phases++] = name;
+  }
+  switch_phase(phase);
+}
+
+StatsPhase::~StatsPhase()
+{
+  switch_phase(M_previous);
+}
+
+void init_stats(std::string const& filename)
+{
+  S_filename = filename;
+  stats_timing_ = true;
+  atexit(write_stats);
+}
@@ -0,0 +1,87 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file stats.h Declaration of the counters of --stats.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef STATS_H
+#define STATS_H
+
+#ifndef USE_PCH
+#include <string>
+#include <stdint.h>
+#endif
+
+// The counters of --stats. Everything is counted per phase (see StatsPhase).
+// Counting is always done, because it is cheap; get_block is only timed when --stats is used.
+enum stats_counter {
+  stats_get_block_calls,		// Calls to get_block.
+  stats_block_cache_hits,		// Calls to get_block that were answered by the block cache.
+  stats_dir_block_store_hits,		// Calls to get_block that were answered by the directory block store.
+  stats_blocks_read,			// Blocks read from the device by get_block and get_blocks.
+  stats_bytes_read,			// Bytes read from the device by get_block and get_blocks.
+  stats_is_directory_no,		// is_directory returned isdir_no.
+  stats_is_directory_start,		// is_directory returned isdir_start.
+  stats_is_directory_extended,		// is_directory returned isdir_extended.
+  stats_journal_descriptors,		// Descriptors found in the journal.
+  stats_inode_mmaps,			// Inode tables mapped by inode_mmap.
+  stats_inode_unmaps,			// Inode tables unmapped by inode_unmap.
+  number_of_stats_counters
+};
+
+int const max_stats_phases = 16;
+int const stats_latency_buckets = 32;	// Bucket i counts the calls that took at least 2^(i-1) and less than 2^i ns.
+
+extern uint64_t stats_counters_[max_stats_phases][number_of_stats_counters];
+extern int volatile stats_phase_;
+extern bool stats_timing_;
+
+// Add n to counter, in the current phase. This function is thread-safe.
+inline void stats_add(stats_counter counter, uint64_t n = 1)
+{
+  __sync_fetch_and_add(&stats_counters_[stats_phase_][counter], n);
+}
+
+uint64_t stats_now_ns(void);
+
+// Return the start time of a get_block call, or zero if get_block isn't timed.
+inline uint64_t stats_get_block_start(void)
+{
+  return stats_timing_ ? stats_now_ns() : 0;
+}
+
+// Add the time since 'start' to the get_block latency histogram of the current phase.
+void stats_get_block_done(uint64_t start);
+
+// Count everything in phase 'name' for as long as an object of this class exists.
+// Phases nest; the time of a phase does not include the time of the phases inside it.
+// Phases may only be entered and left by the main thread.
+class StatsPhase {
+  private:
+    int M_previous;
+  public:
+    StatsPhase(char const* name);
+    ~StatsPhase();
+};
+
+// Write all counters as JSON to 'filename' when the program exits.
+void init_stats(std::string const& filename);
+
+#endif // STATS_H
@@ -0,0 +1,212 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file timestamp_index.cc Implementation of the persistent timestamp index.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "parallel.h"
+#include "inode_catalog.h"
+#include "timestamp_index.h"
+#include "stats.h"
+
+// File layout (native byte order, like the .stage1.blocks file):
+//
+//   timestamp_index_header_st
+//   for atime, ctime, mtime and dtime: the times (uint32_t), the inode numbers (uint32_t)
+//     and the flags (uint8_t) of all entries, padded to a multiple of four bytes.
+//
+// The file is mmap-ed, so that a histogram only reads the pages of the requested window.
+
+namespace {
+
+char const magic[8] = { 'e', '3', 'g', 't', 'i', 'm', 'e', '1' };
+
+int const number_of_columns = 4;	// atime, ctime, mtime and dtime, in that order.
+
+struct timestamp_index_header_st {
+  char magic[8];
+  uint32_t inode_count;
+  uint32_t inodes_per_group;
+  uint32_t wtime;			// The write time of the super block when the file was created.
+  uint32_t mtime;			// The mount time of the super block when the file was created.
+  uint64_t count[number_of_columns];	// The number of entries of each column.
+  uint64_t offset[number_of_columns];	// The offset of the times of each column.
+};
+
+TimestampColumn S_columns[number_of_columns];
+bool S_initialized;
+
+size_t column_size(uint64_t count)
+{
+  return (count * (2 * sizeof(uint32_t) + sizeof(uint8_t)) + 3) & ~(size_t)3;
+}
+
+// Fill keys[column] with (time << 32 | inode number) of every inode that has that time, sorted.
+void sort_column(size_t column, void* data)
+{
+  std::vector<uint64_t>& keys(static_cast<std::vector<uint64_t>*>(data)[column]);
+  uint32_t const* const times[number_of_columns] = { inode_catalog.atime, inode_catalog.ctime, inode_catalog.mtime, inode_catalog.dtime };
+  for (size_t i = 0; i < inode_catalog.count; ++i)
+  {
+    // hist_dtime only counts inodes with a valid dtime; the others only count non-zero times.
+    bool present = (column == 3) ? (inode_catalog.flags[i] & catalog_valid_dtime) : times[column][i] != 0;
+    if (present)
+      keys.push_back((uint64_t)times[column][i] << 32 | (i + 1));
+  }
+  std::sort(keys.begin(), keys.end());
+}
+
+void create_index(std::string const& filename)
+{
+  init_inode_catalog();
+  std::vector<uint64_t> keys[number_of_columns];
+  for_each_parallel(number_of_columns, sort_column, keys);
+  timestamp_index_header_st header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.inode_count = inode_count_;
+  header.inodes_per_group = inodes_per_group_;
+  header.wtime = super_block.s_wtime;
+  header.mtime = super_block.s_mtime;
+  uint64_t offset = sizeof(header);
+  for (int column = 0; column < number_of_columns; ++column)
+  {
+    header.count[column] = keys[column].size();
+    header.offset[column] = offset;
+    offset += column_size(header.count[column]);
+  }
+  std::ofstream output(filename.c_str(), std::ios::binary | std::ios::trunc);
+  output.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  for (int column = 0; column < number_of_columns; ++column)
+  {
+    std::vector<uint64_t> const& k(keys[column]);
+    std::vector<uint32_t> times(k.size());
+    std::vector<uint32_t> inodes(k.size());
+    std::vector<uint8_t> flags(column_size(k.size()) - 2 * sizeof(uint32_t) * k.size());
+    for (size_t i = 0; i < k.size(); ++i)
+    {
+      times[i] = k[i] >> 32;
+      inodes[i] = k[i] & 0xffffffff;
+      flags[i] = inode_catalog.flags[inodes[i] - 1];
+    }
+    if (!k.empty())
+    {
+      output.write(reinterpret_cast<char const*>(&times[0]), times.size() * sizeof(uint32_t));
+      output.write(reinterpret_cast<char const*>(&inodes[0]), inodes.size() * sizeof(uint32_t));
+    }
+    if (!flags.empty())
+      output.write(reinterpret_cast<char const*>(&flags[0]), flags.size());
+  }
+  output.close();
+  if (output.fail())
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": failed to write \"" << filename << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Map filename and point S_columns into it. Returns false if the file doesn't exist or doesn't match the file system.
+bool map_index(std::string const& filename)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat statbuf;
+  timestamp_index_header_st header;
+  bool ok = fstat(fd, &statbuf) == 0 &&
+      pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+      std::memcmp(header.magic, magic, sizeof(magic)) == 0 &&
+      header.inode_count == inode_count_ &&
+      header.inodes_per_group == (uint32_t)inodes_per_group_ &&
+      header.wtime == super_block.s_wtime &&
+      header.mtime == super_block.s_mtime;
+  for (int column = 0; ok && column < number_of_columns; ++column)
+    ok = header.offset[column] + column_size(header.count[column]) <= (uint64_t)statbuf.st_size;
+  char* data = NULL;
+  if (ok)
+  {
+    data = static_cast<char*>(mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0));
+    ok = data != MAP_FAILED;
+  }
+  close(fd);
+  if (!ok)
+    return false;
+  for (int column = 0; column < number_of_columns; ++column)
+  {
+    size_t count = header.count[column];
+    char* times = data + header.offset[column];
+    S_columns[column].count = count;
+    S_columns[column].times = reinterpret_cast<uint32_t const*>(times);
+    S_columns[column].inodes = reinterpret_cast<uint32_t const*>(times + count * sizeof(uint32_t));
+    S_columns[column].flags = reinterpret_cast<uint8_t const*>(times + 2 * count * sizeof(uint32_t));
+  }
+  return true;
+}
+
+} // namespace
+
+void init_timestamp_index(void)
+{
+  if (S_initialized)
+    return;
+  DoutEntering(dc::notice, "init_timestamp_index()");
+  StatsPhase stats_phase("timestamp_index");
+  std::string device_name_basename = device_name.substr(device_name.find_last_of('/') + 1);
+  std::string filename = device_name_basename + ".ext3grep.timestamps";
+  if (!map_index(filename))
+  {
+    std::cout << std::flush;
+    std::cerr << "Writing timestamp index to '" << filename << "'." << std::endl;
+    create_index(filename);
+    if (!map_index(filename))
+    {
+      std::cout << std::flush;
+      std::cerr << progname << ": failed to read back \"" << filename << "\"." << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  S_initialized = true;
+}
+
+TimestampColumn const& timestamp_column(hist_type field)
+{
+  ASSERT(S_initialized);
+  ASSERT(field == hist_atime || field == hist_ctime || field == hist_mtime || field == hist_dtime);
+  return S_columns[field - hist_atime];
+}
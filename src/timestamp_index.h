@@ -0,0 +1,49 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file timestamp_index.h Declaration of the persistent timestamp index.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TIMESTAMP_INDEX_H
+#define TIMESTAMP_INDEX_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <stdint.h>
+#endif
+
+#include "histogram.h"	// Needed for hist_type
+
+// All inodes with a non-zero atime, ctime or mtime, or with a valid dtime, sorted by that time.
+struct TimestampColumn {
+  size_t count;
+  uint32_t const* times;		// Sorted; equal times are sorted by inode number.
+  uint32_t const* inodes;		// The inode number of each entry.
+  uint8_t const* flags;			// The InodeCatalog flags of each entry.
+};
+
+// Map <device>.ext3grep.timestamps into memory. The file is first (re)created from
+// the inode catalog if it doesn't exist or doesn't belong to this file system.
+void init_timestamp_index(void);
+
+// Return the column of hist_atime, hist_ctime, hist_mtime or hist_dtime.
+TimestampColumn const& timestamp_column(hist_type field);
+
+#endif // TIMESTAMP_INDEX_H
@@ -0,0 +1,171 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file trace.cc Implementation of --trace.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "debug.h"
+#endif
+
+#include "globals.h"
+#include "utils.h"
+#include "stats.h"
+#include "trace.h"
+
+// The events are formatted as JSON, collected in a buffer and appended to the --trace
+// file whenever the buffer is full, so that memory use doesn't grow with the number
+// of spans. The timestamps are in microseconds since the start of the program.
+
+bool trace_enabled_;
+
+namespace {
+
+size_t const buffer_size = 256 * 1024;		// Flush S_buffer when it grows larger than this.
+
+pthread_mutex_t S_mutex = PTHREAD_MUTEX_INITIALIZER;	// Protects S_buffer and S_count.
+std::string S_buffer;
+size_t S_count;					// The number of events written so far.
+uint64_t S_start_ns;
+std::string S_filename;
+int S_fd = -1;
+pid_t S_pid;					// The process that owns the file (not a child forked by --serve).
+
+// Called with S_mutex locked.
+void write_buffer(void)
+{
+  char const* ptr = S_buffer.data();
+  size_t len = S_buffer.length();
+  while (len > 0)
+  {
+    ssize_t written = write(S_fd, ptr, len);
+    if (written == -1 && errno == EINTR)
+      continue;
+    if (written == -1)
+    {
+      int error = errno;
+      std::cout << std::flush;
+      std::cerr << progname << ": --trace: failed to write \"" << S_filename << "\": " << strerror(error) << std::endl;
+      break;
+    }
+    ptr += written;
+    len -= written;
+  }
+  S_buffer.clear();
+}
+
+void add_event(std::string const& event)
+{
+  pthread_mutex_lock(&S_mutex);
+  S_buffer += S_count++ ? ",\n" : "";
+  S_buffer += event;
+  if (S_buffer.length() > buffer_size)
+    write_buffer();
+  pthread_mutex_unlock(&S_mutex);
+}
+
+void finish_trace(void)
+{
+  // A child forked by --serve has a copy of the buffer of its parent; only the parent writes.
+  if (getpid() != S_pid)
+    return;
+  pthread_mutex_lock(&S_mutex);
+  S_buffer += "\n]}\n";
+  write_buffer();
+  pthread_mutex_unlock(&S_mutex);
+  close(S_fd);
+}
+
+} // namespace
+
+void trace_event(char const* name, uint64_t start_ns, std::string const& args)
+{
+  uint64_t end_ns = stats_now_ns();
+  std::ostringstream event;
+  event << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":" << getpid() << ",\"tid\":" << syscall(SYS_gettid) <<
+      ",\"ts\":" << (start_ns - S_start_ns) / 1000.0 << ",\"dur\":" << (end_ns - start_ns) / 1000.0;
+  if (!args.empty())
+    event << ",\"args\":{" << args << '}';
+  event << '}';
+  add_event(event.str());
+}
+
+TraceSpan::TraceSpan(char const* name) : M_name(name), M_start(trace_enabled_ ? stats_now_ns() : 0)
+{
+}
+
+TraceSpan::TraceSpan(char const* name, char const* arg_name, long arg) : M_name(name), M_start(0)
+{
+  if (!trace_enabled_)
+    return;
+  std::ostringstream args;
+  args << '"' << arg_name << "\":" << arg;
+  M_args = args.str();
+  M_start = stats_now_ns();
+}
+
+TraceSpan::TraceSpan(char const* name, char const* arg_name, std::string const& arg) : M_name(name), M_start(0)
+{
+  if (!trace_enabled_)
+    return;
+  M_args = std::string("\"") + arg_name + "\":\"" + json_escape(arg) + '"';
+  M_start = stats_now_ns();
+}
+
+void trace_thread_name(char const* name)
+{
+  if (!trace_enabled_)
+    return;
+  std::ostringstream event;
+  event << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << getpid() << ",\"tid\":" << syscall(SYS_gettid) <<
+      ",\"args\":{\"name\":\"" << name << "\"}}";
+  add_event(event.str());
+}
+
+void init_trace(std::string const& filename)
+{
+  S_filename = filename;
+  S_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (S_fd == -1)
+  {
+    int error = errno;
+    std::cout << std::flush;
+    std::cerr << progname << ": --trace: failed to open \"" << filename << "\": " << strerror(error) << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  S_pid = getpid();
+  S_buffer.reserve(buffer_size + 4096);
+  S_buffer = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  S_start_ns = stats_now_ns();
+  trace_enabled_ = true;
+  trace_thread_name("main");
+  atexit(finish_trace);
+}
@@ -0,0 +1,60 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file trace.h Declaration of class TraceSpan, used by --trace.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifndef USE_PCH
+#include <string>
+#include <stdint.h>
+#endif
+
+extern bool trace_enabled_;
+
+// Record one complete event, that started at 'start_ns' (see stats_now_ns) and ends now.
+// 'args' is empty or the contents of a JSON object. This function is thread-safe.
+void trace_event(char const* name, uint64_t start_ns, std::string const& args);
+
+// Record a span from construction to destruction of the object, on the current thread.
+// Nothing is recorded, and no time is read, unless --trace is used.
+class TraceSpan {
+  private:
+    char const* M_name;
+    uint64_t M_start;			// Zero if nothing is recorded.
+    std::string M_args;
+
+  public:
+    TraceSpan(char const* name);
+    TraceSpan(char const* name, char const* arg_name, long arg);
+    TraceSpan(char const* name, char const* arg_name, std::string const& arg);
+    ~TraceSpan() { if (M_start) trace_event(M_name, M_start, M_args); }
+};
+
+// Give the current thread a name in the trace.
+void trace_thread_name(char const* name);
+
+// Write all recorded events to 'filename' in the Chrome trace event format.
+// The events are written in batches while running; the file is completed when the program exits.
+void init_trace(std::string const& filename);
+
+#endif // TRACE_H
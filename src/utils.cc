@@ -24,10 +24,14 @@
 #ifndef USE_PCH
 #include "sys.h"
 #include <sys/stat.h>
+#include <cstring>
+#include <cstdio>
+#include <string>
 #include "debug.h"
 #endif
 
 #include "globals.h"
+#include "utils.h"
 
 char const* dir_entry_file_type(int file_type, bool ls)
 {
@@ -106,3 +110,46 @@ char const* mode_str(int16_t i_mode)
   // To prevent a compiler warning.
   return "*UNKNOWN*";
 }
+
+// The matcher of --search-start (start is true) and --search: return true if
+// the block starts with, or contains, the 'len' characters of 'pattern'.
+bool search_block(unsigned char const* block, char const* pattern, size_t len, bool start)
+{
+  if (start)
+    return std::memcmp(block, pattern, len) == 0;
+  for (unsigned char const* ptr = block; ptr < block + block_size_ - len; ++ptr)
+  {
+    if (*ptr == *pattern &&
+	(len == 1 || (ptr[1] == pattern[1] &&
+	(len == 2 || (ptr[2] == pattern[2] && std::memcmp(ptr, pattern, len) == 0)))))
+      return true;
+  }
+  return false;
+}
+
+// Escape 's' for use inside a JSON string. Control characters and bytes that
+// are not ASCII are written as \u00XX, so that file names that are not UTF-8
+// still result in valid JSON.
+std::string json_escape(std::string const& s)
+{
+  std::string result;
+  result.reserve(s.size());
+  for (std::string::const_iterator iter = s.begin(); iter != s.end(); ++iter)
+  {
+    unsigned char c = *iter;
+    if (c == '"' || c == '\\')
+    {
+      result += '\\';
+      result += c;
+    }
+    else if (c < 0x20 || c >= 0x7f)
+    {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      result += buf;
+    }
+    else
+      result += c;
+  }
+  return result;
+}
@@ -26,10 +26,14 @@
 
 #ifndef USE_PCH
 #include <stdint.h>
+#include <cstddef>
+#include <string>
 #endif
 
 char const* dir_entry_file_type(int file_type, bool ls);
 mode_t inode_mode_to_mkdir_mode(uint16_t mode);
 char const* mode_str(int16_t i_mode);
+bool search_block(unsigned char const* block, char const* pattern, size_t len, bool start);
+std::string json_escape(std::string const& s);
 
 #endif // UTILS_H
@@ -0,0 +1,128 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file xxhash.cc Implementation of the 64-bit xxHash (XXH64) function.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef USE_PCH
+#include "sys.h"
+#include <cstring>
+#endif
+
+#include "xxhash.h"
+
+// This is a straight forward implementation of XXH64, see http://cyan4973.github.io/xxHash/.
+// ext3grep only runs on little endian machines, so no byte swapping is needed.
+
+namespace {
+
+uint64_t const prime1 = 11400714785074694791ULL;
+uint64_t const prime2 = 14029467366897019727ULL;
+uint64_t const prime3 = 1609587929392839161ULL;
+uint64_t const prime4 = 9650029242287828579ULL;
+uint64_t const prime5 = 2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(unsigned char const* ptr)
+{
+  uint64_t val;
+  std::memcpy(&val, ptr, sizeof(val));
+  return val;
+}
+
+inline uint32_t read32(unsigned char const* ptr)
+{
+  uint32_t val;
+  std::memcpy(&val, ptr, sizeof(val));
+  return val;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+  acc += input * prime2;
+  acc = rotl(acc, 31);
+  return acc * prime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t val)
+{
+  acc ^= round(0, val);
+  return acc * prime1 + prime4;
+}
+
+} // namespace
+
+uint64_t xxhash64(unsigned char const* data, size_t len, uint64_t seed)
+{
+  unsigned char const* ptr = data;
+  unsigned char const* const end = data + len;
+  uint64_t hash;
+  if (len >= 32)
+  {
+    uint64_t v1 = seed + prime1 + prime2;
+    uint64_t v2 = seed + prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - prime1;
+    unsigned char const* const limit = end - 32;
+    do
+    {
+      v1 = round(v1, read64(ptr));
+      v2 = round(v2, read64(ptr + 8));
+      v3 = round(v3, read64(ptr + 16));
+      v4 = round(v4, read64(ptr + 24));
+      ptr += 32;
+    }
+    while (ptr <= limit);
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = merge_round(hash, v1);
+    hash = merge_round(hash, v2);
+    hash = merge_round(hash, v3);
+    hash = merge_round(hash, v4);
+  }
+  else
+    hash = seed + prime5;
+  hash += len;
+  for (; ptr + 8 <= end; ptr += 8)
+  {
+    hash ^= round(0, read64(ptr));
+    hash = rotl(hash, 27) * prime1 + prime4;
+  }
+  if (ptr + 4 <= end)
+  {
+    hash ^= read32(ptr) * prime1;
+    hash = rotl(hash, 23) * prime2 + prime3;
+    ptr += 4;
+  }
+  for (; ptr < end; ++ptr)
+  {
+    hash ^= *ptr * prime5;
+    hash = rotl(hash, 11) * prime1;
+  }
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
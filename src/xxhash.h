@@ -0,0 +1,35 @@
+// ext3grep -- An ext3 file system investigation and undelete tool
+//
+//! @file xxhash.h Declaration of function xxhash64.
+//
+// Copyright (C) 2008, by
+// 
+// Carlo Wood, Run on IRC <carlo@alinoe.com>
+// RSA-1024 0x624ACAD5 1997-01-26                    Sign & Encrypt
+// Fingerprint16 = 32 EC A7 B6 AC DB 65 A6  F6 F6 55 DD 1C DC FF 61
+// 
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 2 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+// 
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef XXHASH_H
+#define XXHASH_H
+
+#ifndef USE_PCH
+#include <cstddef>
+#include <stdint.h>
+#endif
+
+// Return the 64-bit xxHash (XXH64) of 'len' bytes starting at 'data'.
+uint64_t xxhash64(unsigned char const* data, size_t len, uint64_t seed = 0);
+
+#endif // XXHASH_H